@@ -0,0 +1,153 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for a simple arena allocator.
+ */
+
+#include "arena.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logging.h"
+
+/* The size of a regular chunk. Larger objects get a chunk of their own. */
+#define ARENA_CHUNK_BYTES	(64 * 1024)
+
+/* The alignment of every object, which suits any type we allocate. */
+#define ARENA_ALIGN		16
+
+/* A chunk of memory from which we allocate objects. The objects
+ * follow the header, which is padded to keep them aligned.
+ */
+struct arena_chunk {
+	struct arena_chunk *next;	/* next older chunk */
+	size_t size;			/* bytes available for objects */
+	size_t used;			/* bytes handed out so far */
+} __attribute__((aligned(ARENA_ALIGN)));
+
+struct arena {
+	struct arena_chunk *chunks;	/* newest chunk first */
+};
+
+/* Return the first byte of the objects in the chunk. */
+static inline u8 *chunk_data(struct arena_chunk *chunk)
+{
+	return (u8 *)(chunk + 1);
+}
+
+/* Allocate a zeroed chunk with room for the given number of bytes. */
+static struct arena_chunk *chunk_new(size_t size)
+{
+	struct arena_chunk *chunk =
+		calloc(1, sizeof(struct arena_chunk) + size);
+
+	if (chunk == NULL)
+		die_perror("calloc");
+	chunk->size = size;
+	return chunk;
+}
+
+struct arena *arena_new(void)
+{
+	return calloc(1, sizeof(struct arena));
+}
+
+void *arena_alloc(struct arena *arena, size_t bytes)
+{
+	struct arena_chunk *chunk = arena->chunks;
+	void *object = NULL;
+
+	bytes = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (bytes > ARENA_CHUNK_BYTES / 4) {
+		/* Give big objects their own chunk, behind the current
+		 * one, so we keep allocating from the current one.
+		 */
+		struct arena_chunk *big = chunk_new(bytes);
+
+		big->used = bytes;
+		if (chunk != NULL) {
+			big->next = chunk->next;
+			chunk->next = big;
+		} else {
+			arena->chunks = big;
+		}
+		return chunk_data(big);
+	}
+
+	if (chunk == NULL || chunk->size - chunk->used < bytes) {
+		chunk = chunk_new(ARENA_CHUNK_BYTES);
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+	object = chunk_data(chunk) + chunk->used;
+	chunk->used += bytes;
+	return object;
+}
+
+char *arena_strndup(struct arena *arena, const char *s, size_t len)
+{
+	char *copy = NULL;
+
+	len = strnlen(s, len);
+	copy = arena_alloc(arena, len + 1);
+	memcpy(copy, s, len);
+	return copy;		/* arena memory is zeroed, so NUL-terminated */
+}
+
+char *arena_strdup(struct arena *arena, const char *s)
+{
+	return arena_strndup(arena, s, strlen(s));
+}
+
+char *arena_sprintf(struct arena *arena, const char *format, ...)
+{
+	va_list ap;
+	char *s = NULL;
+	int len = 0;
+
+	va_start(ap, format);
+	len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	assert(len >= 0);
+
+	s = arena_alloc(arena, len + 1);
+	va_start(ap, format);
+	vsnprintf(s, len + 1, format, ap);
+	va_end(ap);
+	return s;
+}
+
+void arena_free(struct arena *arena)
+{
+	struct arena_chunk *chunk = NULL;
+
+	if (arena == NULL)
+		return;
+	chunk = arena->chunks;
+	while (chunk != NULL) {
+		struct arena_chunk *dead = chunk;
+
+		chunk = chunk->next;
+		free(dead);
+	}
+	free(arena);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A simple arena allocator. Objects are carved out of large chunks
+ * and are never freed one at a time; instead the whole arena, with
+ * everything allocated from it, is released in one step. We use this
+ * for the objects the parser builds for a script, which all live
+ * exactly as long as the script.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "types.h"
+
+#include <stddef.h>
+
+struct arena;
+
+/* Return a new, empty arena. */
+extern struct arena *arena_new(void);
+
+/* Return a pointer to the given number of zeroed bytes in the
+ * arena, aligned for any type.
+ */
+extern void *arena_alloc(struct arena *arena, size_t bytes);
+
+/* Return a NUL-terminated copy of the first len bytes of s. */
+extern char *arena_strndup(struct arena *arena, const char *s, size_t len);
+
+/* Return a copy of the NUL-terminated string s. */
+extern char *arena_strdup(struct arena *arena, const char *s);
+
+/* Return a string formatted as by sprintf(). */
+extern char *arena_sprintf(struct arena *arena, const char *format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Free the arena and everything allocated from it, if it is not NULL. */
+extern void arena_free(struct arena *arena);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for per-host calibration of the timing tolerances.
+ */
+
+#include "calibrate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "logging.h"
+#include "netdev.h"
+#include "packet_checksum.h"
+#include "run.h"
+#include "socket.h"
+#include "tcp_packet.h"
+
+/* How many probes we send, and how many must be answered for the
+ * percentile to mean anything.
+ */
+#define NUM_PROBES		48
+#define MIN_PROBES		(NUM_PROBES / 2)
+
+/* How long after sending a probe we wait for its RST before we take
+ * the probe as lost.
+ */
+#define PROBE_TIMEOUT_USECS	300000
+
+/* The percentile of the probes we derive tolerances from. */
+#define PROBE_PERCENTILE	95
+
+/* A few dozen probes rarely see the worst of a host, so we allow
+ * this multiple of the percentile, plus a floor.
+ */
+#define TOLERANCE_MARGIN	2
+#define MIN_TOLERANCE_USECS	100
+
+/* The source port of the first probe; each probe uses the next one,
+ * so a late RST is never taken for the answer to a later probe.
+ */
+#define PROBE_SRC_PORT		49152
+
+/* How long we sleep before each probe, in turn. Scripts wait anywhere
+ * from a fraction of a millisecond to many, and after longer sleeps
+ * the CPU may be in a deeper idle state that takes longer to leave.
+ */
+static const s64 probe_gap_usecs[] = { 500, 1000, 2000, 5000, 10000 };
+
+static int compare_s64(const void *a, const void *b)
+{
+	const s64 x = *(const s64 *)a, y = *(const s64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Sort the given values and return their PROBE_PERCENTILE. */
+static s64 percentile(s64 *values, int num_values)
+{
+	qsort(values, num_values, sizeof(s64), compare_s64);
+	return values[num_values * PROBE_PERCENTILE / 100];
+}
+
+/* Return the tolerance for times late by the given probe values. */
+static s64 derive_tolerance(s64 *values, int num_values)
+{
+	return TOLERANCE_MARGIN * percentile(values, num_values) +
+		MIN_TOLERANCE_USECS;
+}
+
+/* Return the length of a kernel timer tick, or 0 if we cannot tell. */
+static s64 timer_tick_usecs(void)
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+	struct timespec res;
+
+	/* The coarse clocks only advance once per tick. */
+	if (clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0)
+		return res.tv_sec * 1000000LL + res.tv_nsec / 1000;
+#endif
+	return 0;
+}
+
+/* Open a TCP socket bound to, but not listening on, a free port of our
+ * local address, so the kernel answers SYNs to that port with a RST.
+ * Returns the fd and fills in the port.
+ */
+static int open_closed_port(const struct config *config, u16 *port)
+{
+	struct sockaddr_storage address;
+	struct ip_address ip;
+	socklen_t length = sizeof(address);
+	int fd = socket(config->wire_protocol, SOCK_STREAM, IPPROTO_TCP);
+
+	if (fd < 0)
+		die_perror("calibrate: socket");
+	ip_to_sockaddr(&config->live_local_ip, 0,
+		       (struct sockaddr *)&address, &length);
+	if (bind(fd, (struct sockaddr *)&address, length) < 0)
+		die_perror("calibrate: bind");
+	length = sizeof(address);
+	if (getsockname(fd, (struct sockaddr *)&address, &length) < 0)
+		die_perror("calibrate: getsockname");
+	ip_from_sockaddr((struct sockaddr *)&address, length, &ip, port);
+	return fd;
+}
+
+/* Return a SYN from the remote address and the given source port to
+ * the given local port, ready to inject.
+ */
+static struct packet *new_probe(const struct config *config,
+				u16 src_port, u16 port)
+{
+	struct packet *packet = NULL;
+	struct tuple tuple;
+	char *error = NULL;
+
+	packet = new_tcp_packet(-1, config->wire_protocol,
+				DIRECTION_INBOUND, ECN_NONE,
+				"S", 0, 0, 0, 65535, NULL, &error);
+	if (packet == NULL)
+		die("calibrate: %s\n", error);
+
+	memset(&tuple, 0, sizeof(tuple));
+	tuple.src.ip = config->live_remote_ip;
+	tuple.src.port = htons(src_port);
+	tuple.dst.ip = config->live_local_ip;
+	tuple.dst.port = htons(port);
+	set_packet_tuple(packet, &tuple);
+	checksum_packet(packet);
+	return packet;
+}
+
+/* Sniff only the RST answering the probe from the given source port,
+ * so neither the probe itself nor a late RST for an earlier probe
+ * wakes us up.
+ */
+static void filter_reset(struct state *state, u16 src_port, u16 port)
+{
+	struct packet_socket_flow flow;
+
+	memset(&flow, 0, sizeof(flow));
+	flow.protocol = IPPROTO_TCP;
+	flow.src_port = htons(port);
+	flow.dst_port = htons(src_port);
+	netdev_set_flow_filter(state->netdev, &flow, 1);
+}
+
+/* Sniff packets until we see the RST answering the given probe.
+ * Returns NULL if it has not come by the given time.
+ */
+static struct packet *receive_reset(struct state *state,
+				    u16 src_port, u16 port,
+				    s64 deadline_usecs)
+{
+	struct packet *packet = NULL;
+	char *error = NULL;
+
+	while (1) {
+		const s64 timeout_usecs = deadline_usecs - now_usecs();
+
+		if (timeout_usecs <= 0 ||
+		    !netdev_wait(state->netdev, timeout_usecs))
+			return NULL;
+		if (netdev_receive(state->netdev, &packet, &error))
+			die("calibrate: %s\n", error);
+		if (packet->tcp != NULL && packet->tcp->rst &&
+		    ntohs(packet->tcp->src_port) == port &&
+		    ntohs(packet->tcp->dst_port) == src_port)
+			return packet;
+		packet_free(packet);
+		packet = NULL;
+	}
+}
+
+void calibrate_tolerances(struct state *state)
+{
+	struct config *config = state->config;
+	s64 wakeup[NUM_PROBES], inject[NUM_PROBES], sniff[NUM_PROBES];
+	s64 event[NUM_PROBES], kernel[NUM_PROBES];
+	s64 event_usecs, kernel_usecs;
+	const s64 tick_usecs = timer_tick_usecs();
+	u16 port = 0;
+	int fd = open_closed_port(config, &port);
+	int i, n = 0;
+
+	for (i = 0; i < NUM_PROBES; ++i) {
+		const u16 src_port = PROBE_SRC_PORT + i;
+		struct packet *probe = new_probe(config, src_port, port);
+		struct packet *reset = NULL;
+		s64 wake_usecs, send_usecs, receive_usecs;
+
+		filter_reset(state, src_port, port);
+		wake_usecs = now_usecs() +
+			probe_gap_usecs[i % ARRAY_SIZE(probe_gap_usecs)];
+		sleep_until(state, wake_usecs);
+
+		send_usecs = now_usecs();
+		if (netdev_send(state->netdev, probe))
+			die("calibrate: error injecting probe\n");
+		reset = receive_reset(state, src_port, port,
+				      send_usecs + PROBE_TIMEOUT_USECS);
+		receive_usecs = now_usecs();
+		packet_free(probe);
+
+		/* A lost probe tells us nothing about timing. */
+		if (reset == NULL) {
+			DEBUGP("calibrate: probe %d lost\n", i);
+			continue;
+		}
+
+		wakeup[n] = send_usecs - wake_usecs;
+		inject[n] = max(reset->time_usecs - send_usecs, 0);
+		sniff[n] = max(receive_usecs - reset->time_usecs, 0);
+		event[n] = max(wakeup[n], sniff[n]);
+		kernel[n] = wakeup[n] + inject[n];
+		++n;
+
+		packet_free(reset);
+	}
+	close(fd);
+
+	if (n < MIN_PROBES)
+		die("%s: --calibrate: only %d of %d probes were answered "
+		    "within %d ms; is something dropping SYNs to port %u "
+		    "or their RSTs?\n",
+		    config->script_path, n, NUM_PROBES,
+		    PROBE_TIMEOUT_USECS / 1000, port);
+
+	event_usecs = derive_tolerance(event, n);
+	kernel_usecs = derive_tolerance(kernel, n);
+	state->tolerance_usecs[TOLERANCE_EVENT] = event_usecs;
+	state->tolerance_usecs[TOLERANCE_KERNEL] = kernel_usecs + tick_usecs;
+
+	if (config->verbose) {
+		printf("calibration: %d of %d probes answered; "
+		       "p%d wakeup %lld inject %lld sniff %lld "
+		       "usecs; tolerance event %d kernel %d usecs\n",
+		       n, NUM_PROBES, PROBE_PERCENTILE,
+		       percentile(wakeup, n),
+		       percentile(inject, n),
+		       percentile(sniff, n),
+		       state->tolerance_usecs[TOLERANCE_EVENT],
+		       state->tolerance_usecs[TOLERANCE_KERNEL]);
+	}
+
+	/* The timer tick is how the kernel works, not noise. */
+	if (event_usecs > config->tolerance_usecs ||
+	    kernel_usecs > config->tolerance_usecs) {
+		fprintf(stderr,
+			"%s: warning: host timing is too noisy to trust: "
+			"calibrated tolerances of %lld and %lld usecs "
+			"exceed --tolerance_usecs=%d\n",
+			config->script_path, event_usecs, kernel_usecs,
+			config->tolerance_usecs);
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Per-host calibration of the timing tolerances, for --calibrate.
+ *
+ * A single --tolerance_usecs has to cover the slowest machine we run
+ * on, so it is too loose to catch timing regressions on quiet hosts.
+ * With --calibrate, before the script starts we send a few SYNs to a
+ * closed local port, each after sleeping like wait_for_event() does,
+ * and time the kernel's RSTs. For each probe we measure:
+ *
+ *   wakeup: how late we woke up for the time we slept until
+ *   inject: from writing the SYN to the kernel sending its RST
+ *   sniff:  from the kernel sending the RST to our reading it
+ *
+ * Our own events are late by a late wakeup, or by a late sniff of
+ * the outbound packet before them. Packets the kernel sends and
+ * blocking calls it returns are late by a late wakeup for the event
+ * that caused them plus the injection latency, or by up to a timer
+ * tick when a kernel timer caused them. So we derive a tolerance for
+ * each of these two kinds of times from a high percentile of the
+ * probes, and use them instead of --tolerance_usecs. If the host is
+ * so noisy that a derived tolerance is looser than --tolerance_usecs
+ * we warn that its results cannot be trusted.
+ *
+ * Calibration needs the kernel to answer a SYN to a closed port with
+ * a RST; like any outbound packet a script expects, we wait for it.
+ */
+
+#ifndef __CALIBRATE_H__
+#define __CALIBRATE_H__
+
+#include "types.h"
+
+/* The kinds of times we check, each with its own tolerance. */
+enum tolerance_t {
+	TOLERANCE_EVENT,	/* the start of an event we run */
+	TOLERANCE_KERNEL,	/* outbound packets, blocking call returns */
+	NUM_TOLERANCES,
+};
+
+struct state;
+
+/* Measure this host's timing and set state->tolerance_usecs[]. */
+extern void calibrate_tolerances(struct state *state);
+
+#endif /* __CALIBRATE_H__ */
@@ -578,6 +578,12 @@ void run_code_event(struct state *state, struct event *event,
 	/* Wait for the right time before firing off this event. */
 	wait_for_event(state);
 
+	/* The socket state we would collect is in the kernel, which a
+	 * replay does not have.
+	 */
+	if (state->config->replay_path != NULL)
+		return;
+
 	//TODO modify to support multi socket support
 	/*
 	 * Idea: extend event struct to put a socked_fd and get this fd from
@@ -22,6 +22,7 @@
  * Helper functions for configuration information for a test run.
  */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -47,6 +48,8 @@ enum option_codes {
 	OPT_NETMASK_IP,
 	OPT_SPEED,
 	OPT_MTU,
+	OPT_XDP,
+	OPT_XDP_MODE,
 	OPT_INIT_SCRIPTS,
 	OPT_TOLERANCE_USECS,
 	OPT_WIRE_CLIENT,
@@ -58,6 +61,17 @@ enum option_codes {
 	OPT_TCP_TS_TICK_USECS,
 	OPT_NON_FATAL,
 	OPT_DRY_RUN,
+	OPT_STREAM,
+	OPT_PERF_COUNTERS,
+	OPT_PCAP_OUT,
+	OPT_REPLAY,
+	OPT_FUZZ,
+	OPT_FUZZ_SEED,
+	OPT_FUZZ_DIR,
+	OPT_CALIBRATE,
+	OPT_MAIN_CPU,
+	OPT_SYSCALL_CPU,
+	OPT_NET_CPU,
 	OPT_VERBOSE = 'v',	/* our only single-letter option */
 };
 
@@ -75,6 +89,8 @@ struct option options[] = {
 	{ "netmask_ip",		.has_arg = true,  NULL, OPT_NETMASK_IP },
 	{ "speed",		.has_arg = true,  NULL, OPT_SPEED },
 	{ "mtu",		.has_arg = true,  NULL, OPT_MTU },
+	{ "xdp",		.has_arg = false, NULL, OPT_XDP },
+	{ "xdp_mode",		.has_arg = true,  NULL, OPT_XDP_MODE },
 	{ "init_scripts",	.has_arg = true,  NULL, OPT_INIT_SCRIPTS },
 	{ "tolerance_usecs",	.has_arg = true,  NULL, OPT_TOLERANCE_USECS },
 	{ "wire_client",	.has_arg = false, NULL, OPT_WIRE_CLIENT },
@@ -86,6 +102,17 @@ struct option options[] = {
 	{ "tcp_ts_tick_usecs",	.has_arg = true,  NULL, OPT_TCP_TS_TICK_USECS },
 	{ "non_fatal",		.has_arg = true,  NULL, OPT_NON_FATAL },
 	{ "dry_run",		.has_arg = false, NULL, OPT_DRY_RUN },
+	{ "stream",		.has_arg = false, NULL, OPT_STREAM },
+	{ "perf_counters",	.has_arg = false, NULL, OPT_PERF_COUNTERS },
+	{ "pcap_out",		.has_arg = true,  NULL, OPT_PCAP_OUT },
+	{ "replay",		.has_arg = true,  NULL, OPT_REPLAY },
+	{ "fuzz",		.has_arg = true,  NULL, OPT_FUZZ },
+	{ "fuzz_seed",		.has_arg = true,  NULL, OPT_FUZZ_SEED },
+	{ "fuzz_dir",		.has_arg = true,  NULL, OPT_FUZZ_DIR },
+	{ "calibrate",		.has_arg = false, NULL, OPT_CALIBRATE },
+	{ "main_cpu",		.has_arg = true,  NULL, OPT_MAIN_CPU },
+	{ "syscall_cpu",	.has_arg = true,  NULL, OPT_SYSCALL_CPU },
+	{ "net_cpu",		.has_arg = true,  NULL, OPT_NET_CPU },
 	{ "verbose",		.has_arg = false, NULL, OPT_VERBOSE },
 	{ NULL },
 };
@@ -106,7 +133,14 @@ void show_usage(void)
 		"\t[--init_scripts=<comma separated filenames>]\n"
 		"\t[--speed=<speed in Mbps>]\n"
 		"\t[--mtu=<MTU in bytes>]\n"
+		"\t[--xdp]\n"
+		"\t[--xdp_mode=[generic,native]]\n"
 		"\t[--tolerance_usecs=tolerance_usecs]\n"
+		"\t[--calibrate]\n"
+		"\t[--main_cpu=<CPU to pin the main thread to; "
+		"the --stream parser thread is not pinned>]\n"
+		"\t[--syscall_cpu=<CPU to pin the system call thread to>]\n"
+		"\t[--net_cpu=<CPU to process packets we inject on>]\n"
 		"\t[--tcp_ts_tick_usecs=<microseconds per TCP TS val tick>]\n"
 		"\t[--non_fatal=<comma separated types: packet,syscall>]\n"
 		"\t[--wire_client]\n"
@@ -116,6 +150,13 @@ void show_usage(void)
 		"\t[--wire_client_dev=<eth_dev_name>]\n"
 		"\t[--wire_server_dev=<eth_dev_name>]\n"
 		"\t[--dry_run]\n"
+		"\t[--stream]\n"
+		"\t[--perf_counters]\n"
+		"\t[--pcap_out=<pcapng file for injected and sniffed packets>]\n"
+		"\t[--replay=<pcapng file from --pcap_out to run against>]\n"
+		"\t[--fuzz=<number of mutated cases to run>]\n"
+		"\t[--fuzz_seed=<seed of first fuzz case>]\n"
+		"\t[--fuzz_dir=<dir for crashing and hanging fuzz cases>]\n"
 		"\t[--verbose|-v]\n"
 		"\tscript_path ...\n");
 }
@@ -197,6 +238,9 @@ void set_default_config(struct config *config)
 	config->default_live_bind_port	= 8080;
 	config->default_live_connect_port	= 8080;
 	config->tolerance_usecs		= 4000;
+	config->main_cpu		= -1;
+	config->syscall_cpu		= -1;
+	config->net_cpu			= -1;
 	config->speed			= TUN_DRIVER_SPEED_CUR;
 	config->mtu			= TUN_DRIVER_DEFAULT_MTU;
 
@@ -218,6 +262,8 @@ void set_default_config(struct config *config)
 	config->wire_server_port	= 8081;
 	config->wire_client_device	= "eth0";
 	config->wire_server_device	= "eth0";
+
+	config->fuzz_dir		= ".";
 }
 
 static void set_remote_ip_and_prefix(struct config *config)
@@ -316,6 +362,42 @@ void finalize_config(struct config *config)
 		break;
 		/* omitting default so compiler will catch missing cases */
 	}
+
+	/* The wire server parses the script on its own, in step with
+	 * the client, so it needs the whole script up front.
+	 */
+	if (config->stream && (config->is_wire_client ||
+			       config->is_wire_server))
+		die("%s: --stream is not supported in wire mode\n",
+		    config->script_path);
+
+	/* A replay stands in for the local kernel and network device. */
+	if (config->replay_path != NULL &&
+	    (config->is_wire_client || config->is_wire_server ||
+	     config->use_xdp))
+		die("%s: --replay is not supported in wire or --xdp mode\n",
+		    config->script_path);
+
+	/* Fuzz cases mutate the parsed events, so need them all up front. */
+	if (config->fuzz_cases > 0 &&
+	    (config->is_wire_client || config->is_wire_server ||
+	     config->stream || config->replay_path != NULL))
+		die("%s: --fuzz is not supported with wire mode, --stream, "
+		    "or --replay\n", config->script_path);
+
+	/* We calibrate by probing the local kernel through our netdev. */
+	if (config->calibrate &&
+	    (config->is_wire_client || config->is_wire_server ||
+	     config->replay_path != NULL))
+		die("%s: --calibrate is not supported in wire mode "
+		    "or with --replay\n", config->script_path);
+
+	/* We steer packets only on the netdevs we set up ourselves. */
+	if (config->net_cpu >= 0 &&
+	    (config->is_wire_client || config->is_wire_server ||
+	     config->replay_path != NULL))
+		die("%s: --net_cpu is not supported in wire mode "
+		    "or with --replay\n", config->script_path);
 }
 
 /* Expect that arg is comma-delimited, allowing for spaces. */
@@ -340,6 +422,17 @@ void parse_non_fatal_arg(char *arg, struct config *config)
 }
 
 
+/* Return the CPU number given for the named option, or die. */
+static int parse_cpu(const char *option, char *optarg, char *where)
+{
+	char *end = NULL;
+	long cpu = strtol(optarg, &end, 10);
+
+	if (end == optarg || *end || cpu < 0 || cpu > INT_MAX)
+		die("%s: bad --%s: %s\n", where, option, optarg);
+	return cpu;
+}
+
 /* Process a command line option */
 static void process_option(int opt, char *optarg, struct config *config,
 			   char *where)
@@ -397,6 +490,17 @@ static void process_option(int opt, char *optarg, struct config *config,
 		if (config->mtu < 0)
 			die("%s: bad --mtu: %s\n", where, optarg);
 		break;
+	case OPT_XDP:
+		config->use_xdp = true;
+		break;
+	case OPT_XDP_MODE:
+		if (strcmp(optarg, "generic") == 0)
+			config->xdp_native = false;
+		else if (strcmp(optarg, "native") == 0)
+			config->xdp_native = true;
+		else
+			die("%s: bad --xdp_mode: %s\n", where, optarg);
+		break;
 	case OPT_NETMASK_IP:
 		strncpy(config->live_netmask_ip_string, optarg,	ADDR_STR_LEN-1);
 		break;
@@ -449,6 +553,41 @@ static void process_option(int opt, char *optarg, struct config *config,
 	case OPT_DRY_RUN:
 		config->dry_run = true;
 		break;
+	case OPT_STREAM:
+		config->stream = true;
+		break;
+	case OPT_PERF_COUNTERS:
+		config->perf_counters = true;
+		break;
+	case OPT_PCAP_OUT:
+		config->pcap_out_path = strdup(optarg);
+		break;
+	case OPT_REPLAY:
+		config->replay_path = strdup(optarg);
+		break;
+	case OPT_FUZZ:
+		config->fuzz_cases = atoi(optarg);
+		if (config->fuzz_cases <= 0)
+			die("%s: bad --fuzz: %s\n", where, optarg);
+		break;
+	case OPT_FUZZ_SEED:
+		config->fuzz_seed = strtoull(optarg, NULL, 0);
+		break;
+	case OPT_FUZZ_DIR:
+		config->fuzz_dir = strdup(optarg);
+		break;
+	case OPT_CALIBRATE:
+		config->calibrate = true;
+		break;
+	case OPT_MAIN_CPU:
+		config->main_cpu = parse_cpu("main_cpu", optarg, where);
+		break;
+	case OPT_SYSCALL_CPU:
+		config->syscall_cpu = parse_cpu("syscall_cpu", optarg, where);
+		break;
+	case OPT_NET_CPU:
+		config->net_cpu = parse_cpu("net_cpu", optarg, where);
+		break;
 	case OPT_VERBOSE:
 		config->verbose = true;
 		break;
@@ -501,7 +640,10 @@ static void parse_script_options(struct config *config,
 				break;
 			}
 		}
-		if (c != 0) {
+		if (c != 0 && options[i].has_arg && opt->value == NULL) {
+			die("%s: option '%s' needs a value\n",
+			    config->script_path, opt->name);
+		} else if (c != 0) {
 			process_option(options[i].val,
 				       opt->value, config,
 				       config->script_path);
@@ -76,6 +76,7 @@ struct config {
 	int live_prefix_len;		/* IPv4/IPv6 interface prefix len */
 
 	int tolerance_usecs;		/* tolerance for time divergence */
+	bool calibrate;			/* measure tolerances first? */
 	int tcp_ts_tick_usecs;		/* microseconds per TS val tick */
 
 	u32 speed;			/* speed reported by tun driver;
@@ -83,10 +84,24 @@ struct config {
 					 */
 	int mtu;			/* MTU of tun device */
 
+	int main_cpu;			/* CPU for main thread, or -1 */
+	int syscall_cpu;		/* CPU for syscall thread, or -1 */
+	int net_cpu;			/* CPU for inbound packets, or -1 */
+
+	bool use_xdp;			/* use AF_XDP on veth, not tun? */
+	bool xdp_native;		/* attach XDP in driver, not skb, mode */
+
 	bool non_fatal_packet;		/* treat packet asserts as non-fatal */
 	bool non_fatal_syscall;		/* treat syscall asserts as non-fatal */
 
 	bool dry_run;			/* parse script but don't execute? */
+	bool stream;			/* run script while parsing it? */
+	bool perf_counters;		/* report kernel CPU cost of script? */
+	char *pcap_out_path;		/* pcapng file to save packets to */
+	char *replay_path;		/* pcapng trace to replay, or NULL */
+	int fuzz_cases;			/* mutated cases to run, or 0 */
+	u64 fuzz_seed;			/* first fuzz seed, or 0 for any */
+	char *fuzz_dir;			/* dir to save findings in */
 
 	bool verbose;			/* print detailed debug info? */
 	char *script_path;		/* pathname of script file */
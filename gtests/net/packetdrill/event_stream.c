@@ -0,0 +1,276 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for streaming events from a parser thread.
+ */
+
+#include "event_stream.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "logging.h"
+
+/* A batch of consecutive events whose objects share an arena. */
+struct event_batch {
+	struct arena *arena;		/* objects of the batch's events */
+	struct event *first;		/* first event in the batch */
+	int events;			/* number of events in the batch */
+	struct event_batch *next;	/* next newer batch */
+};
+
+struct event_stream {
+	int (*parse)(struct event_stream *stream, void *arg);	/* parser */
+	void *parse_arg;		/* argument for the parse function */
+	pthread_t thread;		/* the parser thread */
+
+	pthread_mutex_t mutex;		/* protects all of the fields below */
+	pthread_cond_t changed;		/* signaled after each change */
+
+	bool is_streaming;		/* is the parser streaming events? */
+	bool is_parse_done;		/* has the parser finished? */
+	int parse_result;		/* result of the parser, once done */
+	bool is_closed;			/* has the run loop stopped reading? */
+
+	struct event_batch *oldest;	/* oldest batch still in memory */
+	struct event_batch *filling;	/* batch the parser is adding to */
+	struct event_batch *running;	/* batch of the run loop's event */
+	int running_events;		/* events taken from 'running' */
+
+	struct event *last;		/* newest event from the parser */
+	struct event *next;		/* next event for the run loop */
+	int lookahead;			/* events parsed but not yet taken */
+};
+
+static void stream_lock(struct event_stream *stream)
+{
+	if (pthread_mutex_lock(&stream->mutex) != 0)
+		die_perror("pthread_mutex_lock");
+}
+
+static void stream_unlock(struct event_stream *stream)
+{
+	if (pthread_mutex_unlock(&stream->mutex) != 0)
+		die_perror("pthread_mutex_unlock");
+}
+
+static void stream_wait(struct event_stream *stream)
+{
+	if (pthread_cond_wait(&stream->changed, &stream->mutex) != 0)
+		die_perror("pthread_cond_wait");
+}
+
+static void stream_signal(struct event_stream *stream)
+{
+	if (pthread_cond_broadcast(&stream->changed) != 0)
+		die_perror("pthread_cond_broadcast");
+}
+
+static struct event_batch *batch_new(void)
+{
+	struct event_batch *batch = calloc(1, sizeof(struct event_batch));
+
+	batch->arena = arena_new();
+	return batch;
+}
+
+/* Free the batch, with its events. Packets are not in the arena. */
+static void batch_free(struct event_batch *batch)
+{
+	struct event *event = batch->first;
+	int i;
+
+	for (i = 0; i < batch->events; ++i) {
+		if (event->type == PACKET_EVENT)
+			packet_free(event->event.packet);
+		event = event->next;
+	}
+	arena_free(batch->arena);
+	free(batch);
+}
+
+/* Free the batches older than the given one. */
+static void free_batches_before(struct event_stream *stream,
+				struct event_batch *keep)
+{
+	while (stream->oldest != keep) {
+		struct event_batch *dead = stream->oldest;
+
+		stream->oldest = dead->next;
+		batch_free(dead);
+	}
+}
+
+static void *parse_thread(void *arg)
+{
+	struct event_stream *stream = arg;
+	int result = stream->parse(stream, stream->parse_arg);
+
+	stream_lock(stream);
+	stream->is_parse_done = true;
+	stream->parse_result = result;
+	stream_signal(stream);
+	stream_unlock(stream);
+	return NULL;
+}
+
+struct event_stream *event_stream_new(
+	int (*parse)(struct event_stream *stream, void *arg), void *arg)
+{
+	struct event_stream *stream = calloc(1, sizeof(struct event_stream));
+
+	stream->parse = parse;
+	stream->parse_arg = arg;
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0)
+		die_perror("pthread_mutex_init");
+	if (pthread_cond_init(&stream->changed, NULL) != 0)
+		die_perror("pthread_cond_init");
+	if (pthread_create(&stream->thread, NULL, parse_thread, stream) != 0)
+		die_perror("pthread_create");
+	return stream;
+}
+
+int event_stream_wait(struct event_stream *stream, bool *is_streaming)
+{
+	int result = STATUS_OK;
+
+	stream_lock(stream);
+	while (!stream->is_streaming && !stream->is_parse_done)
+		stream_wait(stream);
+	*is_streaming = stream->is_streaming;
+	if (stream->is_parse_done)
+		result = stream->parse_result;
+	stream_unlock(stream);
+	return result;
+}
+
+struct arena *event_stream_begin(struct event_stream *stream)
+{
+	stream_lock(stream);
+	assert(!stream->is_streaming);
+	stream->oldest = stream->filling = batch_new();
+	stream->is_streaming = true;
+	stream_signal(stream);
+	stream_unlock(stream);
+	return stream->filling->arena;
+}
+
+struct arena *event_stream_put(struct event_stream *stream,
+			       struct event *event)
+{
+	struct event_batch *batch = NULL;
+
+	stream_lock(stream);
+	while (!stream->is_closed &&
+	       stream->lookahead >= STREAM_MAX_LOOKAHEAD)
+		stream_wait(stream);
+
+	batch = stream->filling;
+	if (batch->first == NULL)
+		batch->first = event;
+	if (stream->last != NULL)
+		stream->last->next = event;
+	++batch->events;
+	stream->last = event;
+
+	if (!stream->is_closed) {
+		if (stream->next == NULL)
+			stream->next = event;
+		++stream->lookahead;
+	}
+
+	/* Once the batch is full, the events that follow go in a new
+	 * one. When the parser calls us, its only lookahead token is
+	 * the time of the next event, so nothing of the next event is
+	 * in the full batch's arena.
+	 */
+	if (batch->events == STREAM_BATCH_EVENTS) {
+		batch->next = batch_new();
+		stream->filling = batch->next;
+		if (stream->is_closed) {
+			/* No one will run these events. */
+			free_batches_before(stream, stream->filling);
+			stream->last = NULL;
+		}
+	}
+
+	stream_signal(stream);
+	stream_unlock(stream);
+	return stream->filling->arena;
+}
+
+int event_stream_next(struct event_stream *stream, bool can_free,
+		      struct event **event, char **error)
+{
+	struct event_batch *previous = NULL;
+
+	stream_lock(stream);
+	while (stream->next == NULL && !stream->is_parse_done)
+		stream_wait(stream);
+
+	if (stream->is_parse_done && stream->parse_result != STATUS_OK) {
+		asprintf(error, "error parsing script");
+		stream_unlock(stream);
+		return STATUS_ERR;
+	}
+
+	*event = stream->next;
+	if (*event == NULL) {
+		stream_unlock(stream);
+		return STATUS_OK;	/* script is done */
+	}
+	stream->next = (*event)->next;
+	--stream->lookahead;
+
+	/* Track the batch of the event, and the one before it. */
+	previous = stream->running;
+	if (stream->running == NULL) {
+		stream->running = stream->oldest;
+	} else if (stream->running_events == stream->running->events) {
+		stream->running = stream->running->next;
+		stream->running_events = 0;
+	}
+	++stream->running_events;
+	if (previous == NULL)
+		previous = stream->running;
+
+	if (can_free)
+		free_batches_before(stream, previous);
+
+	stream_signal(stream);
+	stream_unlock(stream);
+	return STATUS_OK;
+}
+
+void event_stream_free(struct event_stream *stream)
+{
+	stream_lock(stream);
+	stream->is_closed = true;
+	stream_signal(stream);
+	stream_unlock(stream);
+
+	if (pthread_join(stream->thread, NULL) != 0)
+		die_perror("pthread_join");
+
+	free_batches_before(stream, NULL);
+	if (pthread_cond_destroy(&stream->changed) != 0)
+		die_perror("pthread_cond_destroy");
+	if (pthread_mutex_destroy(&stream->mutex) != 0)
+		die_perror("pthread_mutex_destroy");
+	free(stream);
+}
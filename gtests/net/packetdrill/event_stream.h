@@ -0,0 +1,93 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * A stream of events from a parser thread to the run loop, so that
+ * long scripts can run while they are being parsed.
+ *
+ * Without --stream, the parser runs in the caller's thread and no
+ * stream exists. With --stream, the parser runs in its own thread,
+ * which the stream owns. Once the parser has the final configuration,
+ * it decides whether to stream. If it does not (e.g. --dry_run), it
+ * builds the script's event list as usual and the stream only reports
+ * when it is done. If it does, it hands
+ * each event to the stream as soon as it is parsed, blocking while
+ * the run loop is too far behind, and the run loop takes them out of
+ * the stream in order.
+ *
+ * Streamed events are allocated in batches, each with its own arena,
+ * and a batch is freed once the run loop no longer needs any of its
+ * events. So memory use stays flat however long the script is.
+ */
+
+#ifndef __EVENT_STREAM_H__
+#define __EVENT_STREAM_H__
+
+#include "types.h"
+
+#include "arena.h"
+#include "script.h"
+
+/* The most events the parser may get ahead of the run loop. */
+#define STREAM_MAX_LOOKAHEAD	4096
+
+/* The number of events in each batch of events, which share an arena. */
+#define STREAM_BATCH_EVENTS	256
+
+struct event_stream;
+
+/* Return a new stream, with a parser thread running parse(stream, arg).
+ * The parse function returns STATUS_OK or STATUS_ERR.
+ */
+extern struct event_stream *event_stream_new(
+	int (*parse)(struct event_stream *stream, void *arg), void *arg);
+
+/* Wait until the parser has either started streaming events or
+ * finished. Set *is_streaming to tell which. Return STATUS_ERR if the
+ * parser finished with an error, and otherwise STATUS_OK.
+ */
+extern int event_stream_wait(struct event_stream *stream, bool *is_streaming);
+
+/* Called by the parser, once it has the final configuration and
+ * before it parses the first event, to start streaming events.
+ * Returns the arena for the objects of the events that follow.
+ */
+extern struct arena *event_stream_begin(struct event_stream *stream);
+
+/* Called by the parser to hand the run loop a newly parsed event.
+ * Blocks while the parser is too far ahead of the run loop. Returns
+ * the arena for the objects of the events that follow.
+ */
+extern struct arena *event_stream_put(struct event_stream *stream,
+				      struct event *event);
+
+/* Called by the run loop to take the next event out of the stream,
+ * waiting for the parser if need be. Sets *event to NULL at the end
+ * of the script. The event returned by the previous call stays valid
+ * too; if can_free is true, all earlier events may be freed. On a
+ * parse error, returns STATUS_ERR and fills in *error.
+ */
+extern int event_stream_next(struct event_stream *stream, bool can_free,
+			     struct event **event, char **error);
+
+/* Wait for the parser thread to finish and free the stream, along
+ * with all the events in it.
+ */
+extern void event_stream_free(struct event_stream *stream);
+
+#endif /* __EVENT_STREAM_H__ */
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for the flight recorder.
+ */
+
+#include "flight_recorder.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include "ip.h"
+#include "ipv6.h"
+#include "packet.h"
+#include "run.h"
+#include "script.h"
+#include "tcp.h"
+#include "udp.h"
+
+/* A record in the ring. The seq field is written last, so the dump can
+ * tell records that are complete from ones a thread is still writing.
+ */
+struct flight_record {
+	u64 seq;		/* 1 + number of the record; 0 if unused */
+	s64 usecs;		/* live time of the record */
+	s64 value;		/* event type, packet bytes, or result */
+	s64 aux;		/* script time of event, or errno */
+	s32 line;		/* script line, or 0 if none */
+	u16 type;		/* enum flight_record_t */
+	u16 data_bytes;		/* bytes used in data */
+	u8 data[FLIGHT_RECORDER_PACKET_BYTES];	/* headers or call name */
+};
+
+static struct flight_record flight_ring[FLIGHT_RECORDER_RECORDS];
+static u64 flight_next_record;	/* number of the next record to write */
+static s64 flight_start_usecs;	/* live start time of the script */
+static int flight_dumped;	/* whether we dumped the ring already */
+
+static const char *event_type_names[NUM_EVENT_TYPES] = {
+	[INVALID_EVENT]		= "invalid",
+	[PACKET_EVENT]		= "packet",
+	[SYSCALL_EVENT]		= "syscall",
+	[COMMAND_EVENT]		= "command",
+	[CODE_EVENT]		= "code",
+	[PACING_EVENT]		= "pacing",
+};
+
+/* Claim the next slot of the ring and fill in the common fields. The
+ * caller fills in the rest and then commits the record with *seq.
+ */
+static struct flight_record *flight_record_claim(enum flight_record_t type,
+						 int line, s64 usecs, u64 *seq)
+{
+	u64 n = __atomic_fetch_add(&flight_next_record, 1, __ATOMIC_RELAXED);
+	struct flight_record *record =
+		&flight_ring[n % FLIGHT_RECORDER_RECORDS];
+
+	__atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+	record->usecs = usecs;
+	record->line = line;
+	record->type = type;
+	record->value = 0;
+	record->aux = 0;
+	record->data_bytes = 0;
+	*seq = n + 1;
+	return record;
+}
+
+/* Make the record visible to the dump. */
+static void flight_record_commit(struct flight_record *record, u64 seq)
+{
+	__atomic_store_n(&record->seq, seq, __ATOMIC_RELEASE);
+}
+
+void flight_recorder_start(s64 live_start_usecs)
+{
+	flight_start_usecs = live_start_usecs;
+}
+
+void flight_record_event(int line, int event_type, s64 script_usecs)
+{
+	u64 seq;
+	struct flight_record *record =
+		flight_record_claim(FLIGHT_EVENT, line, now_usecs(), &seq);
+
+	record->value = event_type;
+	record->aux = script_usecs;
+	flight_record_commit(record, seq);
+}
+
+void flight_record_packet(enum flight_record_t type, int line,
+			  struct packet *packet)
+{
+	const u8 *start = ip_start(packet);
+	int bytes = packet_end(packet) - start;
+	s64 usecs = packet->time_usecs ? packet->time_usecs : now_usecs();
+	u64 seq;
+	struct flight_record *record =
+		flight_record_claim(type, line, usecs, &seq);
+
+	if (bytes > FLIGHT_RECORDER_PACKET_BYTES)
+		bytes = FLIGHT_RECORDER_PACKET_BYTES;
+	memcpy(record->data, start, bytes);
+	record->data_bytes = bytes;
+	record->value = packet->ip_bytes;
+	flight_record_commit(record, seq);
+}
+
+/* Keep as much of the name of the system call as fits. */
+static void flight_record_name(struct flight_record *record, const char *name)
+{
+	int bytes = strlen(name);
+
+	if (bytes > FLIGHT_RECORDER_PACKET_BYTES)
+		bytes = FLIGHT_RECORDER_PACKET_BYTES;
+	memcpy(record->data, name, bytes);
+	record->data_bytes = bytes;
+}
+
+void flight_record_syscall_begin(int line, const char *name)
+{
+	u64 seq;
+	struct flight_record *record =
+		flight_record_claim(FLIGHT_SYSCALL_BEGIN, line, now_usecs(),
+				    &seq);
+
+	flight_record_name(record, name);
+	flight_record_commit(record, seq);
+}
+
+void flight_record_syscall_end(int line, const char *name,
+			       int result, int err)
+{
+	u64 seq;
+	struct flight_record *record =
+		flight_record_claim(FLIGHT_SYSCALL_END, line, now_usecs(),
+				    &seq);
+
+	flight_record_name(record, name);
+	record->value = result;
+	record->aux = err;
+	flight_record_commit(record, seq);
+}
+
+/* Print the TCP or UDP header that starts at the given offset of the
+ * recorded headers, if we have it.
+ */
+static void dump_layer4(const struct flight_record *record, int protocol,
+			int offset, FILE *f)
+{
+	const u8 *data = record->data + offset;
+	int bytes = record->data_bytes - offset;
+
+	if (protocol == IPPROTO_TCP && bytes >= (int)sizeof(struct tcp)) {
+		const struct tcp *tcp = (const struct tcp *)data;
+
+		fprintf(f, "tcp %u > %u %s%s%s%s%s%s%s%s seq %u ack %u win %u",
+			ntohs(tcp->src_port), ntohs(tcp->dst_port),
+			tcp->syn ? "S" : "", tcp->fin ? "F" : "",
+			tcp->rst ? "R" : "", tcp->psh ? "P" : "",
+			tcp->ack ? "." : "", tcp->urg ? "U" : "",
+			tcp->ece ? "E" : "", tcp->cwr ? "W" : "",
+			ntohl(tcp->seq), ntohl(tcp->ack_seq),
+			ntohs(tcp->window));
+	} else if (protocol == IPPROTO_UDP &&
+		   bytes >= (int)sizeof(struct udp)) {
+		const struct udp *udp = (const struct udp *)data;
+
+		fprintf(f, "udp %u > %u len %u",
+			ntohs(udp->src_port), ntohs(udp->dst_port),
+			ntohs(udp->len));
+	} else {
+		fprintf(f, "protocol %d", protocol);
+	}
+}
+
+/* Print the addresses and layer 4 header of the recorded packet, or
+ * its bytes in hex if it is not IPv4 or IPv6.
+ */
+static void dump_packet(const struct flight_record *record, FILE *f)
+{
+	char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+	const u8 *data = record->data;
+	int i;
+
+	if (record->data_bytes >= (int)sizeof(struct ipv4) &&
+	    (data[0] >> 4) == 4) {
+		const struct ipv4 *ipv4 = (const struct ipv4 *)data;
+
+		inet_ntop(AF_INET, &ipv4->src_ip, src, sizeof(src));
+		inet_ntop(AF_INET, &ipv4->dst_ip, dst, sizeof(dst));
+		fprintf(f, "%s > %s ", src, dst);
+		dump_layer4(record, ipv4->protocol, ipv4->ihl * 4, f);
+	} else if (record->data_bytes >= (int)sizeof(struct ipv6) &&
+		   (data[0] >> 4) == 6) {
+		const struct ipv6 *ipv6 = (const struct ipv6 *)data;
+
+		inet_ntop(AF_INET6, &ipv6->src_ip, src, sizeof(src));
+		inet_ntop(AF_INET6, &ipv6->dst_ip, dst, sizeof(dst));
+		fprintf(f, "%s > %s ", src, dst);
+		dump_layer4(record, ipv6->next_header, sizeof(struct ipv6), f);
+	} else {
+		for (i = 0; i < record->data_bytes && i < 40; ++i)
+			fprintf(f, "%02x", data[i]);
+	}
+}
+
+static void dump_record(const struct flight_record *record, FILE *f)
+{
+	fprintf(f, "%10.6f line %4d ",
+		usecs_to_secs(record->usecs - flight_start_usecs),
+		record->line);
+	switch ((enum flight_record_t)record->type) {
+	case FLIGHT_EVENT:
+		fprintf(f, "event %s at script time %.6f",
+			event_type_names[record->value],
+			usecs_to_secs(record->aux));
+		break;
+	case FLIGHT_INJECT:
+	case FLIGHT_SNIFF:
+		fprintf(f, "%s %lld bytes ",
+			record->type == FLIGHT_INJECT ? "inject" : "sniff ",
+			record->value);
+		dump_packet(record, f);
+		break;
+	case FLIGHT_SYSCALL_BEGIN:
+		fprintf(f, "syscall begin %.*s",
+			record->data_bytes, (const char *)record->data);
+		break;
+	case FLIGHT_SYSCALL_END:
+		fprintf(f, "syscall end   %.*s = %lld",
+			record->data_bytes, (const char *)record->data,
+			record->value);
+		if (record->value < 0)
+			fprintf(f, " (errno %lld %s)",
+				record->aux, strerror(record->aux));
+		break;
+	case NUM_FLIGHT_RECORD_TYPES:
+		fprintf(f, "bad record type");
+		break;
+	/* We omit default case so compiler catches missing values. */
+	}
+	fprintf(f, "\n");
+}
+
+void flight_recorder_dump(FILE *f)
+{
+	u64 next = __atomic_load_n(&flight_next_record, __ATOMIC_ACQUIRE);
+	u64 n = 0;
+
+	if (next == 0 ||
+	    __atomic_exchange_n(&flight_dumped, 1, __ATOMIC_ACQ_REL))
+		return;
+	if (next > FLIGHT_RECORDER_RECORDS)
+		n = next - FLIGHT_RECORDER_RECORDS;
+
+	fprintf(f, "flight recorder: last %llu of %llu records "
+		"(seconds since script start):\n", next - n, next);
+	for (; n < next; ++n) {
+		const struct flight_record *record =
+			&flight_ring[n % FLIGHT_RECORDER_RECORDS];
+
+		/* Skip records other threads are still writing. */
+		if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != n + 1)
+			continue;
+		dump_record(record, f);
+	}
+	fflush(f);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * An always-on flight recorder for the harness: a fixed-size ring of
+ * binary records of the events we dispatch, the packets we inject and
+ * sniff, and the system calls we begin and end, with their times.
+ *
+ * Recording only copies a few words and the first bytes of packet
+ * headers into the ring, with no formatting and no allocation, so it
+ * does not disturb the timing of the script the way --verbose output
+ * does. The ring is decoded and printed only when we die(), to help
+ * diagnose timing failures that are hard to reproduce.
+ *
+ * Both the main thread and the system call thread record; each record
+ * claims its own slot with an atomic increment.
+ */
+
+#ifndef __FLIGHT_RECORDER_H__
+#define __FLIGHT_RECORDER_H__
+
+#include "types.h"
+
+#include <stdio.h>
+
+struct packet;
+
+/* How many of the most recent records we keep. */
+#define FLIGHT_RECORDER_RECORDS		1024
+
+/* How many bytes of each packet we keep: enough for IPv4 or IPv6 and
+ * a TCP header with its options.
+ */
+#define FLIGHT_RECORDER_PACKET_BYTES	100
+
+/* Types of records. */
+enum flight_record_t {
+	FLIGHT_EVENT,			/* run loop starts an event */
+	FLIGHT_INJECT,			/* we inject a packet */
+	FLIGHT_SNIFF,			/* we sniff a packet */
+	FLIGHT_SYSCALL_BEGIN,		/* we start a system call */
+	FLIGHT_SYSCALL_END,		/* a system call returned */
+	NUM_FLIGHT_RECORD_TYPES,
+};
+
+/* Print times in the dump relative to the given live start time of
+ * the script.
+ */
+extern void flight_recorder_start(s64 live_start_usecs);
+
+/* Record that the run loop starts the event of the given type that the
+ * script has at the given line and time.
+ */
+extern void flight_record_event(int line, int event_type, s64 script_usecs);
+
+/* Record that we inject (FLIGHT_INJECT) or sniff (FLIGHT_SNIFF) the
+ * given packet while running the event at the given line.
+ */
+extern void flight_record_packet(enum flight_record_t type, int line,
+				 struct packet *packet);
+
+/* Record that we start the named system call of the given line. */
+extern void flight_record_syscall_begin(int line, const char *name);
+
+/* Record that the named system call of the given line returned the
+ * given result and errno.
+ */
+extern void flight_record_syscall_end(int line, const char *name,
+				      int result, int err);
+
+/* Decode the records in the ring, oldest first, and print them. Prints
+ * nothing if nothing was recorded. Only the first call prints.
+ */
+extern void flight_recorder_dump(FILE *f);
+
+#endif /* __FLIGHT_RECORDER_H__ */
@@ -0,0 +1,483 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for the in-process script fuzzer.
+ */
+
+#include "fuzz.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "logging.h"
+#include "mptcp.h"
+#include "packet.h"
+#include "run.h"
+#include "tcp.h"
+#include "tcp_options_iterator.h"
+
+/* How long past the end of its script a case may run before we call
+ * it hung and kill it. This leaves time for the harness itself to give
+ * up on a blocking system call that never returns.
+ */
+#define FUZZ_HANG_SLACK_USECS	(10 * 1000000LL)
+
+/* How often we check whether a case is done. */
+#define FUZZ_POLL_USECS		1000
+
+/* The most mutations we make in one case. */
+#define FUZZ_MAX_MUTATIONS	3
+
+/* The most we move the time of an inbound packet, either way. */
+#define FUZZ_MAX_TIME_SHIFT_USECS	50000
+
+/* The offset of the byte with the flags in a TCP header. */
+#define TCP_FLAGS_OFFSET	13
+
+/* The kinds of mutations we make. */
+enum fuzz_mutation_t {
+	FUZZ_FLAGS,			/* flip a TCP flag */
+	FUZZ_SEQ,			/* move the sequence number */
+	FUZZ_ACK,			/* move the ACK number */
+	FUZZ_WINDOW,			/* change the receive window */
+	FUZZ_URG,			/* change the urgent pointer */
+	FUZZ_OPTION,			/* change a TCP or MPTCP option */
+	FUZZ_TIME,			/* move the time of the packet */
+	NUM_FUZZ_MUTATIONS,
+};
+
+/* What a case did. */
+enum fuzz_outcome_t {
+	FUZZ_PASSED,			/* script passed */
+	FUZZ_FAILED,			/* script failed, as most do */
+	FUZZ_CRASHED,			/* harness died of a signal */
+	FUZZ_HUNG,			/* we had to kill the harness */
+	FUZZ_TAINTED,			/* kernel taint flags changed */
+	NUM_FUZZ_OUTCOMES,
+};
+
+/* Names of outcomes, also used for the files we save findings in. */
+static const char *fuzz_outcome_names[NUM_FUZZ_OUTCOMES] = {
+	[FUZZ_PASSED]	= "passed",
+	[FUZZ_FAILED]	= "failed",
+	[FUZZ_CRASHED]	= "crash",
+	[FUZZ_HUNG]	= "hang",
+	[FUZZ_TAINTED]	= "taint",
+};
+
+/* Return the next value of a splitmix64 generator. We keep our own
+ * generator, rather than using rand_64(), so that the mutations of a
+ * case depend only on its seed.
+ */
+static u64 fuzz_random(u64 *rng)
+{
+	u64 z = (*rng += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Return a random number in [0, n). */
+static u32 fuzz_below(u64 *rng, u32 n)
+{
+	return fuzz_random(rng) % n;
+}
+
+/* Return a random change to a sequence or ACK number: usually a small
+ * one, to probe the edges of the window, and sometimes any value.
+ */
+static u32 seq_delta(u64 *rng)
+{
+	u32 delta;
+
+	if (fuzz_below(rng, 4) == 0)
+		return fuzz_random(rng);
+	delta = 1 + fuzz_below(rng, 0xffff);
+	return fuzz_below(rng, 2) ? delta : -delta;
+}
+
+/* Is this an event for an inbound TCP packet, which we can mutate? */
+static bool is_fuzz_target(const struct event *event)
+{
+	return event->type == PACKET_EVENT &&
+	       packet_direction(event->event.packet) == DIRECTION_INBOUND &&
+	       event->event.packet->tcp != NULL;
+}
+
+/* Return the number of inbound TCP packet events in the script. */
+static int count_fuzz_targets(const struct script *script)
+{
+	const struct event *event;
+	int count = 0;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (is_fuzz_target(event))
+			++count;
+	}
+	return count;
+}
+
+/* Return the inbound TCP packet event with the given index. */
+static struct event *get_fuzz_target(struct script *script, int index)
+{
+	struct event *event;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (is_fuzz_target(event) && index-- == 0)
+			return event;
+	}
+	assert(!"no such fuzz target");
+	return NULL;
+}
+
+/* Return roughly how long the script runs, in microseconds. */
+static s64 script_duration_usecs(const struct script *script)
+{
+	const struct event *event;
+	s64 usecs = 0;
+
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (is_event_time_absolute((struct event *)event))
+			usecs = max(usecs, max(event->time_usecs,
+					       event->time_usecs_end));
+		else if (event->time_type != ANY_TIME)
+			usecs += max(event->time_usecs, event->time_usecs_end);
+		if (event->type == SYSCALL_EVENT &&
+		    event->event.syscall->end_usecs > usecs)
+			usecs = event->event.syscall->end_usecs;
+	}
+	return usecs;
+}
+
+/* Change a random byte of the packet's TCP options, half the time in
+ * its MPTCP option if it has one. Returns false if it has no options.
+ */
+static bool mutate_option(struct packet *packet, int line, u64 *rng,
+			  FILE *record)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option;
+	u8 *options = packet_tcp_options(packet);
+	u8 *start = options, *byte, old;
+	int bytes = packet_tcp_options_len(packet);
+	char *error = NULL;
+
+	if (bytes == 0)
+		return false;
+
+	if (fuzz_below(rng, 2)) {
+		for (option = tcp_options_begin(packet, &iter);
+		     option != NULL;
+		     option = tcp_options_next(&iter, &error)) {
+			if (option->kind == TCPOPT_MPTCP &&
+			    option->length > 0) {
+				start = (u8 *)option;
+				bytes = option->length;
+				break;
+			}
+		}
+		free(error);
+	}
+
+	byte = start + fuzz_below(rng, bytes);
+	old = *byte;
+	if (fuzz_below(rng, 2))
+		*byte ^= 1 << fuzz_below(rng, 8);
+	else
+		*byte = fuzz_random(rng);
+	fprintf(record, "line %d: tcp option byte %d: %#x -> %#x\n",
+		line, (int)(byte - options), old, *byte);
+	return true;
+}
+
+/* Move the time of the given inbound packet event, but not to before
+ * the time of the last absolute event before it.
+ */
+static void mutate_time(struct script *script, struct event *target,
+			u64 *rng, FILE *record)
+{
+	struct event *event;
+	s64 earliest = 0, old = target->time_usecs;
+	s64 shift = (s64)fuzz_below(rng, 2 * FUZZ_MAX_TIME_SHIFT_USECS + 1) -
+		    FUZZ_MAX_TIME_SHIFT_USECS;
+
+	if (is_event_time_absolute(target)) {
+		for (event = script->event_list; event != target;
+		     event = event->next) {
+			if (is_event_time_absolute(event))
+				earliest = event->time_usecs;
+		}
+	}
+	target->time_usecs = max(earliest, old + shift);
+	fprintf(record, "line %d: time %lld -> %lld usecs\n",
+		target->line_number, old, target->time_usecs);
+}
+
+/* Make one random mutation of the given inbound TCP packet event. */
+static void mutate_event(struct script *script, struct event *event,
+			 u64 *rng, FILE *record)
+{
+	struct packet *packet = event->event.packet;
+	struct tcp *tcp = packet->tcp;
+	u8 *flags = (u8 *)tcp + TCP_FLAGS_OFFSET;
+	int line = event->line_number;
+	u32 old;
+
+	switch (fuzz_below(rng, NUM_FUZZ_MUTATIONS)) {
+	case FUZZ_OPTION:
+		if (mutate_option(packet, line, rng, record))
+			break;
+		/* With no options, flip a flag instead. */
+	case FUZZ_FLAGS:
+		old = *flags;
+		*flags ^= 1 << fuzz_below(rng, 8);
+		fprintf(record, "line %d: tcp flags %#x -> %#x\n",
+			line, old, *flags);
+		break;
+	case FUZZ_SEQ:
+		old = ntohl(tcp->seq);
+		tcp->seq = htonl(old + seq_delta(rng));
+		fprintf(record, "line %d: tcp seq %u -> %u\n",
+			line, old, ntohl(tcp->seq));
+		break;
+	case FUZZ_ACK:
+		old = ntohl(tcp->ack_seq);
+		tcp->ack_seq = htonl(old + seq_delta(rng));
+		fprintf(record, "line %d: tcp ack %u -> %u\n",
+			line, old, ntohl(tcp->ack_seq));
+		break;
+	case FUZZ_WINDOW:
+		old = ntohs(tcp->window);
+		tcp->window = fuzz_below(rng, 4) ? htons(fuzz_random(rng)) : 0;
+		fprintf(record, "line %d: tcp window %u -> %u\n",
+			line, old, ntohs(tcp->window));
+		break;
+	case FUZZ_URG:
+		old = ntohs(tcp->urg_ptr);
+		tcp->urg_ptr = htons(fuzz_random(rng));
+		tcp->urg = fuzz_below(rng, 2);
+		fprintf(record, "line %d: tcp urg %u urg_ptr %u -> %u\n",
+			line, tcp->urg, old, ntohs(tcp->urg_ptr));
+		break;
+	case FUZZ_TIME:
+		mutate_time(script, event, rng, record);
+		break;
+	case NUM_FUZZ_MUTATIONS:
+		assert(!"bad mutation");
+		break;
+	/* We omit default case so compiler catches missing values. */
+	}
+}
+
+/* Make the mutations for the case with the given seed, and save the
+ * seed and mutations in the given file.
+ */
+static void mutate_script(struct config *config, struct script *script,
+			  u64 seed, char *record_path)
+{
+	const int num_targets = count_fuzz_targets(script);
+	FILE *record = fopen(record_path, "w");
+	u64 rng = seed;
+	int i, num_mutations;
+
+	if (record == NULL)
+		die_perror(record_path);
+
+	fprintf(record, "script: %s\n", config->script_path);
+	fprintf(record, "seed: %llu\n", seed);
+	num_mutations = 1 + fuzz_below(&rng, FUZZ_MAX_MUTATIONS);
+	for (i = 0; i < num_mutations; ++i) {
+		mutate_event(script,
+			     get_fuzz_target(script,
+					     fuzz_below(&rng, num_targets)),
+			     &rng, record);
+	}
+
+	/* Make sure the record survives if the case panics the kernel. */
+	if (fflush(record) != 0 || fdatasync(fileno(record)) != 0)
+		die_perror(record_path);
+	fclose(record);
+}
+
+/* Run the case with the given seed in this child process; does not
+ * return.
+ */
+static void run_case(struct config *config, struct script *script,
+		     struct netdev *netdev, u64 seed,
+		     char *record_path, char *log_path)
+{
+	int fd;
+
+	mutate_script(config, script, seed, record_path);
+
+	fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		die_perror(log_path);
+	if (dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0)
+		die_perror("dup2");
+	close(fd);
+	/* Keep what we print even if the case crashes or is killed. */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	run_script(config, script, netdev);
+	exit(EXIT_SUCCESS);
+}
+
+/* Wait for the case in the given child to finish, and return what it
+ * did. We kill it if it runs past the given time. If it died of a
+ * signal, fills in the signal.
+ */
+static enum fuzz_outcome_t await_case(pid_t pid, s64 deadline_usecs,
+				      int *term_signal)
+{
+	int status = 0;
+	pid_t done;
+
+	while (1) {
+		done = waitpid(pid, &status, WNOHANG);
+		if (done < 0 && errno != EINTR)
+			die_perror("waitpid");
+		if (done == pid)
+			break;
+		if (now_usecs() > deadline_usecs) {
+			if (kill(pid, SIGKILL) != 0)
+				die_perror("kill");
+			if (waitpid(pid, &status, 0) < 0)
+				die_perror("waitpid");
+			return FUZZ_HUNG;
+		}
+		usleep(FUZZ_POLL_USECS);
+	}
+
+	if (WIFSIGNALED(status)) {
+		*term_signal = WTERMSIG(status);
+		return FUZZ_CRASHED;
+	}
+	if (WEXITSTATUS(status) == EXIT_SUCCESS)
+		return FUZZ_PASSED;
+	return FUZZ_FAILED;
+}
+
+/* Return the kernel's taint flags, or 0 if we cannot read them. */
+static u64 kernel_taint(void)
+{
+	FILE *f = fopen("/proc/sys/kernel/tainted", "r");
+	u64 taint = 0;
+
+	if (f == NULL)
+		return 0;
+	if (fscanf(f, "%llu", &taint) != 1)
+		taint = 0;
+	fclose(f);
+	return taint;
+}
+
+/* Keep the record and log of the given case under the given name. */
+static void save_finding(const struct config *config, const char *name,
+			 u64 seed, char *record_path,
+			 char *log_path)
+{
+	char *path = NULL;
+
+	asprintf(&path, "%s/%s-%llu.txt", config->fuzz_dir, name, seed);
+	if (rename(record_path, path) != 0)
+		die_perror(path);
+	printf("%s: fuzz case %llu: %s; see %s\n",
+	       config->script_path, seed, name, path);
+	free(path);
+
+	asprintf(&path, "%s/%s-%llu.log", config->fuzz_dir, name, seed);
+	if (rename(log_path, path) != 0)
+		die_perror(path);
+	free(path);
+}
+
+int fuzz_script(struct config *config, struct script *script)
+{
+	int counts[NUM_FUZZ_OUTCOMES] = { 0 };
+	const s64 timeout_usecs =
+		script_duration_usecs(script) + FUZZ_HANG_SLACK_USECS;
+	u64 seed = config->fuzz_seed ? config->fuzz_seed : now_usecs();
+	char *record_path = NULL, *log_path = NULL;
+	struct netdev *netdev = NULL;
+	int i, term_signal = 0;
+
+	if (count_fuzz_targets(script) == 0)
+		die("%s: --fuzz: script has no inbound TCP packets\n",
+		    config->script_path);
+
+	asprintf(&record_path, "%s/current.txt", config->fuzz_dir);
+	asprintf(&log_path, "%s/current.log", config->fuzz_dir);
+	printf("%s: running %d fuzz cases from seed %llu\n",
+	       config->script_path, config->fuzz_cases, seed);
+
+	netdev = script_netdev_new(config);
+	for (i = 0; i < config->fuzz_cases; ++i, ++seed) {
+		const u64 taint = kernel_taint();
+		enum fuzz_outcome_t outcome;
+		pid_t pid;
+
+		/* Don't let the child print our buffered output again. */
+		fflush(stdout);
+		fflush(stderr);
+		pid = fork();
+		if (pid < 0)
+			die_perror("fork");
+		if (pid == 0)
+			run_case(config, script, netdev, seed,
+				 record_path, log_path);
+
+		outcome = await_case(pid, now_usecs() + timeout_usecs,
+				     &term_signal);
+		/* The child shared our netdev, so discard whatever it left
+		 * queued, lest the next case sniff it as its own.
+		 */
+		netdev_drain(netdev);
+		if (kernel_taint() != taint)
+			outcome = FUZZ_TAINTED;
+		++counts[outcome];
+		if (outcome == FUZZ_CRASHED)
+			printf("%s: fuzz case %llu: killed by signal %d\n",
+			       config->script_path, seed, term_signal);
+		if (outcome >= FUZZ_CRASHED)
+			save_finding(config, fuzz_outcome_names[outcome], seed,
+				     record_path, log_path);
+	}
+	netdev_free(netdev);
+
+	printf("%s: %d fuzz cases: %d passed, %d failed, %d crashed, "
+	       "%d hung, %d tainted the kernel\n",
+	       config->script_path, config->fuzz_cases,
+	       counts[FUZZ_PASSED], counts[FUZZ_FAILED],
+	       counts[FUZZ_CRASHED], counts[FUZZ_HUNG],
+	       counts[FUZZ_TAINTED]);
+
+	free(record_path);
+	free(log_path);
+	free_mp_state();
+	script_free(script);
+	return counts[FUZZ_CRASHED] + counts[FUZZ_HUNG] +
+	       counts[FUZZ_TAINTED];
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * An in-process fuzzer for test scripts. With --fuzz=N we run N cases
+ * of each script, each with a few random mutations of its inbound TCP
+ * packets, in their header fields and their TCP and MPTCP option
+ * bytes, and of the times we inject them.
+ *
+ * We parse the script and set up the network device only once. Each
+ * case then runs in a child we fork from the pristine parsed script,
+ * so starting a case costs only a fork(), its mutations die with it,
+ * and a case that crashes the harness does not end the run. Since most
+ * mutated cases end with the kernel not doing what the script expects,
+ * those cases still reset their connections as they die.
+ *
+ * A case's mutations depend only on its seed; the first case uses
+ * --fuzz_seed, or a seed from the clock, and each case after it the
+ * next seed. Before running a case we save its seed and mutations in
+ * current.txt in --fuzz_dir, so they survive a kernel panic, and its
+ * output goes to current.log. If the case crashes the harness, hangs,
+ * or changes the kernel's taint flags (e.g. with a first WARN or an
+ * oops), we keep these as <crash|hang|taint>-<seed>.txt and .log. To
+ * rerun a case, use --fuzz=1 --fuzz_seed=<seed>.
+ */
+
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "script.h"
+
+/* Run config->fuzz_cases mutated cases of the given parsed script,
+ * and free the script. Returns the number of cases that crashed, hung,
+ * or tainted the kernel.
+ */
+extern int fuzz_script(struct config *config, struct script *script);
+
+#endif /* __FUZZ_H__ */
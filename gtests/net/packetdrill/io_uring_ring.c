@@ -0,0 +1,204 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Ring management for io_uring instances created by test scripts.
+ * We talk to the kernel with the raw system calls and shared rings
+ * rather than liburing, so there is no extra build dependency.
+ */
+
+#include "io_uring_ring.h"
+
+#ifdef linux
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "logging.h"
+
+static void *map_ring_region(int fd, size_t bytes, off_t pgoff,
+			     char **error)
+{
+	void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (map == MAP_FAILED) {
+		asprintf(error, "mmap io_uring ring: %s", strerror(errno));
+		return NULL;
+	}
+	return map;
+}
+
+int io_uring_ring_new(int fd, const struct io_uring_params *params,
+		      struct io_uring_ring **ring_ptr, char **error)
+{
+	struct io_uring_ring *ring = calloc(1, sizeof(struct io_uring_ring));
+	u8 *sq, *cq;
+
+	ring->fd = fd;
+	ring->sq_map_bytes = params->sq_off.array +
+			     params->sq_entries * sizeof(u32);
+	ring->cq_map_bytes = params->cq_off.cqes +
+			     params->cq_entries * sizeof(struct io_uring_cqe);
+	/* Newer kernels share one mapping for both rings. */
+	if (params->features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_map_bytes > ring->sq_map_bytes)
+			ring->sq_map_bytes = ring->cq_map_bytes;
+		ring->cq_map_bytes = 0;
+	}
+
+	ring->sq_map = map_ring_region(fd, ring->sq_map_bytes,
+				       IORING_OFF_SQ_RING, error);
+	if (ring->sq_map == NULL)
+		goto error_out;
+	if (ring->cq_map_bytes == 0) {
+		ring->cq_map = ring->sq_map;
+	} else {
+		ring->cq_map = map_ring_region(fd, ring->cq_map_bytes,
+					       IORING_OFF_CQ_RING, error);
+		if (ring->cq_map == NULL)
+			goto error_out;
+	}
+	ring->sqes_bytes = params->sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = map_ring_region(fd, ring->sqes_bytes, IORING_OFF_SQES,
+				     error);
+	if (ring->sqes == NULL)
+		goto error_out;
+
+	sq = ring->sq_map;
+	ring->sq_head	 = (u32 *)(sq + params->sq_off.head);
+	ring->sq_tail	 = (u32 *)(sq + params->sq_off.tail);
+	ring->sq_array	 = (u32 *)(sq + params->sq_off.array);
+	ring->sq_mask	 = *(u32 *)(sq + params->sq_off.ring_mask);
+	ring->sq_entries = params->sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+
+	cq = ring->cq_map;
+	ring->cq_head	 = (u32 *)(cq + params->cq_off.head);
+	ring->cq_tail	 = (u32 *)(cq + params->cq_off.tail);
+	ring->cq_mask	 = *(u32 *)(cq + params->cq_off.ring_mask);
+	ring->cq_entries = params->cq_entries;
+	ring->cqes	 = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+	/* We never have more ops in flight than the CQ ring can hold. */
+	ring->ops = calloc(ring->cq_entries, sizeof(struct ring_op));
+
+	DEBUGP("io_uring fd %d: %u SQ entries, %u CQ entries\n",
+	       fd, ring->sq_entries, ring->cq_entries);
+	*ring_ptr = ring;
+	return STATUS_OK;
+
+error_out:
+	io_uring_ring_free(ring);
+	*ring_ptr = NULL;
+	return STATUS_ERR;
+}
+
+void io_uring_ring_free(struct io_uring_ring *ring)
+{
+	u32 i;
+
+	if (ring == NULL)
+		return;
+
+	if (ring->ops != NULL) {
+		for (i = 0; i < ring->cq_entries; ++i)
+			ring_op_free(&ring->ops[i]);
+		free(ring->ops);
+	}
+	if (ring->sqes != NULL)
+		munmap(ring->sqes, ring->sqes_bytes);
+	if (ring->cq_map != NULL && ring->cq_map != ring->sq_map)
+		munmap(ring->cq_map, ring->cq_map_bytes);
+	if (ring->sq_map != NULL)
+		munmap(ring->sq_map, ring->sq_map_bytes);
+	memset(ring, 0, sizeof(*ring));  /* paranoia to help catch bugs */
+	free(ring);
+}
+
+struct io_uring_sqe *io_uring_ring_get_sqe(struct io_uring_ring *ring,
+					   struct ring_op **op)
+{
+	u32 head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	u32 index;
+	u32 i;
+	struct io_uring_sqe *sqe;
+
+	if (ring->sq_local_tail - head >= ring->sq_entries)
+		return NULL;
+
+	for (i = 0; i < ring->cq_entries; ++i) {
+		if (!ring->ops[i].in_use)
+			break;
+	}
+	if (i == ring->cq_entries)
+		return NULL;
+
+	*op = &ring->ops[i];
+	memset(*op, 0, sizeof(**op));
+	(*op)->in_use = true;
+
+	index = ring->sq_local_tail & ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = i;
+	ring->sq_array[index] = index;
+	++ring->sq_local_tail;
+	return sqe;
+}
+
+u32 io_uring_ring_publish(struct io_uring_ring *ring)
+{
+	u32 count = ring->sq_local_tail - *ring->sq_tail;
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	return count;
+}
+
+void io_uring_ring_discard(struct io_uring_ring *ring)
+{
+	ring->sq_local_tail = *ring->sq_tail;
+}
+
+bool io_uring_ring_pop_cqe(struct io_uring_ring *ring,
+			   struct io_uring_cqe *cqe, struct ring_op **op)
+{
+	u32 head = *ring->cq_head;
+	u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return false;
+
+	*cqe = ring->cqes[head & ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	*op = NULL;
+	if (cqe->user_data < ring->cq_entries &&
+	    ring->ops[cqe->user_data].in_use)
+		*op = &ring->ops[cqe->user_data];
+	return true;
+}
+
+void ring_op_free(struct ring_op *op)
+{
+	free(op->buf);
+	memset(op, 0, sizeof(*op));
+}
+
+#endif  /* linux */
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Our side of the submission and completion rings of an io_uring
+ * instance that a test script created, and the bookkeeping for the
+ * operations the script has in flight on it.
+ */
+
+#ifndef __IO_URING_RING_H__
+#define __IO_URING_RING_H__
+
+#include "types.h"
+
+#ifdef linux
+
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+/* An operation the script submitted whose completion we have not
+ * reaped yet. We own the buffers the kernel reads or writes for it,
+ * so they must live until the CQE arrives. The kernel user_data of
+ * each SQE is the index of its op, so we can find it from the CQE.
+ */
+struct ring_op {
+	bool in_use;			/* is this slot taken? */
+	u8 opcode;			/* IORING_OP_* */
+	int script_fd;			/* fd the op was submitted on */
+	u64 script_user_data;		/* user_data the script gave */
+	void *buf;			/* data buffer for send/recv */
+	struct sockaddr_storage addr;	/* address for accept/connect */
+	socklen_t addrlen;		/* length of addr */
+};
+
+/* The mmap()-ed rings of one io_uring instance. */
+struct io_uring_ring {
+	int fd;				/* the io_uring fd */
+
+	void *sq_map;			/* start of SQ ring mmap */
+	size_t sq_map_bytes;
+	u32 *sq_head;			/* consumed by the kernel */
+	u32 *sq_tail;			/* produced by us */
+	u32 *sq_array;			/* indices into sqes */
+	u32 sq_mask;
+	u32 sq_entries;
+	u32 sq_local_tail;		/* tail including unpublished SQEs */
+
+	struct io_uring_sqe *sqes;	/* SQE array mmap */
+	size_t sqes_bytes;
+
+	void *cq_map;			/* start of CQ ring mmap */
+	size_t cq_map_bytes;
+	u32 *cq_head;			/* consumed by us */
+	u32 *cq_tail;			/* produced by the kernel */
+	u32 cq_mask;
+	u32 cq_entries;
+	struct io_uring_cqe *cqes;
+
+	struct ring_op *ops;		/* cq_entries op slots */
+};
+
+/* Map the rings of the io_uring instance with the given fd, as set up
+ * with the given params. Returns STATUS_OK on success; on failure
+ * returns STATUS_ERR and sets error message.
+ */
+extern int io_uring_ring_new(int fd, const struct io_uring_params *params,
+			     struct io_uring_ring **ring, char **error);
+
+/* Unmap the rings and free all op state. Does not close the fd. */
+extern void io_uring_ring_free(struct io_uring_ring *ring);
+
+/* Return a zeroed SQE and a free op slot for it, with the SQE's
+ * user_data already pointing at the slot. Returns NULL if the SQ ring
+ * or the op slots are full.
+ */
+extern struct io_uring_sqe *io_uring_ring_get_sqe(struct io_uring_ring *ring,
+						  struct ring_op **op);
+
+/* Make all SQEs obtained since the last call visible to the kernel.
+ * Returns how many were published.
+ */
+extern u32 io_uring_ring_publish(struct io_uring_ring *ring);
+
+/* Forget all SQEs obtained since the last publish. The caller must
+ * release their op slots.
+ */
+extern void io_uring_ring_discard(struct io_uring_ring *ring);
+
+/* Copy out and consume the next CQE, if any, and find its op slot.
+ * Returns false if the CQ ring is empty.
+ */
+extern bool io_uring_ring_pop_cqe(struct io_uring_ring *ring,
+				  struct io_uring_cqe *cqe, struct ring_op **op);
+
+/* Release an op slot once its final CQE has been handled. */
+extern void ring_op_free(struct ring_op *op);
+
+#endif  /* linux */
+
+#endif /* __IO_URING_RING_H__ */
@@ -26,6 +26,25 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include "flight_recorder.h"
+
+/* The function to call before exiting, or NULL. */
+static void (*die_hook)(void);
+
+void set_die_hook(void (*hook)(void))
+{
+	die_hook = hook;
+}
+
+/* Run the die hook, if there is one and it is not already running. */
+static void run_die_hook(void)
+{
+	void (*hook)(void) = die_hook;
+
+	die_hook = NULL;
+	if (hook != NULL)
+		hook();
+}
 
 extern void die(char *format, ...)
 {
@@ -35,6 +54,8 @@ extern void die(char *format, ...)
 	vfprintf(stderr, format, ap);
 	va_end(ap);
 
+	flight_recorder_dump(stderr);
+	run_die_hook();
 	exit(EXIT_FAILURE);
 }
 
@@ -42,5 +63,7 @@ void die_perror(char *message)
 {
 	perror(message);
 
+	flight_recorder_dump(stderr);
+	run_die_hook();
 	exit(EXIT_FAILURE);
 }
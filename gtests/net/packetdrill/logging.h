@@ -37,10 +37,20 @@
 		fflush(stdout);			\
 	}
 
-/* Log the message to stderr and then exit with a failure status code. */
+/* Log the message to stderr, dump the flight recorder, run the die
+ * hook if any, and then exit with a failure status code.
+ */
 extern void die(char *format, ...);
 
-/* Call perror() with message and then exit with a failure status code. */
+/* Call perror() with message, dump the flight recorder, run the die
+ * hook if any, and then exit with a failure status code.
+ */
 extern void die_perror(char *message);
 
+/* Set a function for die() and die_perror() to call before exiting,
+ * e.g. to clean up kernel state, or NULL for none. The hook is called
+ * at most once; if it dies itself, we just exit.
+ */
+extern void set_die_hook(void (*hook)(void));
+
 #endif /* __LOGGING_H__ */
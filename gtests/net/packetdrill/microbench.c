@@ -0,0 +1,372 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Microbenchmarks for the hot paths of the harness: parsing packets,
+ * checksums, walking and comparing TCP options, filling in MPTCP
+ * option fields, parsing scripts, and the hash map.
+ *
+ * Each benchmark runs its operation a fixed number of times on fixed
+ * inputs, once to warm up and then BENCH_REPETITIONS more times, and
+ * we report the fastest and the median time per operation. Output is
+ * one tab-separated line per benchmark, after a '#' header line, so
+ * that runs are easy to compare with a script:
+ *
+ *   # benchmark  iterations  min_ns_per_op  median_ns_per_op
+ *
+ * Pass a benchmark name, or part of one, to run only those benchmarks.
+ */
+
+#include "types.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "checksum.h"
+#include "config.h"
+#include "hash_map.h"
+#include "ip.h"
+#include "logging.h"
+#include "mptcp.h"
+#include "open_memstream.h"
+#include "packet.h"
+#include "packet_parser.h"
+#include "run.h"
+#include "run_packet.h"
+#include "script.h"
+#include "tcp.h"
+#include "tcp_options_iterator.h"
+
+/* How many timed runs of each benchmark we make. */
+#define BENCH_REPETITIONS	7
+
+/* How many keys we put in the hash map. */
+#define BENCH_HASH_KEYS		1024
+
+/* How many data segments the generated script sends and ACKs. */
+#define BENCH_SCRIPT_SEGMENTS	2000
+
+/* A benchmark: the setup is not timed, the run is. */
+struct benchmark {
+	const char *name;		/* name in our output */
+	void (*setup)(void);		/* prepare the inputs, or NULL */
+	void (*run)(int iterations);	/* do the operation this many times */
+	int iterations;			/* operations per timed run */
+};
+
+/* Results go here, so the compiler cannot drop the work. */
+static volatile u64 sink;
+
+/* A TCP/IPv4 packet with SACK and timestamp options:
+ * 192.0.2.1:53055 > 192.168.0.1:8080
+ * . 1:1(0) ack 2202903899 win 257
+ * <sack 2202905347:2202906795,TS val 300 ecr 1623332896>
+ */
+static const u8 tcp_ipv4_data[] = {
+	0x45, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0x06, 0x39, 0x11, 0xc0, 0x00, 0x02, 0x01,
+	0xc0, 0xa8, 0x00, 0x01, 0xcf, 0x3f, 0x1f, 0x90,
+	0x00, 0x00, 0x00, 0x01, 0x83, 0x4d, 0xa5, 0x5b,
+	0xa0, 0x10, 0x01, 0x01, 0xdb, 0x2d, 0x00, 0x00,
+	0x05, 0x0a, 0x83, 0x4d, 0xab, 0x03, 0x83, 0x4d,
+	0xb0, 0xab, 0x08, 0x0a, 0x00, 0x00, 0x01, 0x2c,
+	0x60, 0xc2, 0x18, 0x20
+};
+
+/* The same flow with timestamps and an MPTCP MP_FASTCLOSE option:
+ * . 1:1(0) ack 2202903899 win 257
+ * <nop,nop,TS val 300 ecr 1623332896,mp_fastclose 0x0102030405060708>
+ * The IP checksum is filled in by our setup.
+ */
+static const u8 mptcp_ipv4_data[] = {
+	0x45, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0x06, 0x00, 0x00, 0xc0, 0x00, 0x02, 0x01,
+	0xc0, 0xa8, 0x00, 0x01, 0xcf, 0x3f, 0x1f, 0x90,
+	0x00, 0x00, 0x00, 0x01, 0x83, 0x4d, 0xa5, 0x5b,
+	0xb0, 0x10, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x01, 0x08, 0x0a, 0x00, 0x00, 0x01, 0x2c,
+	0x60, 0xc2, 0x18, 0x20, 0x1e, 0x0c, 0x70, 0x00,
+	0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+};
+
+static struct packet *parse_packet_buffer;
+static struct packet *tcp_packet, *tcp_packet_copy;
+static struct packet *mptcp_packet, *mptcp_live_packet;
+static u8 payload[1460];
+static struct hash_map *hash_map;
+static u32 hash_keys[BENCH_HASH_KEYS];
+static char *script_text;
+
+/* Return a packet parsed from the given bytes; dies if they are bad. */
+static struct packet *bench_packet(const u8 *data, int bytes)
+{
+	struct packet *packet = packet_new(bytes);
+	char *error = NULL;
+
+	memcpy(packet->buffer, data, bytes);
+	if (parse_packet(packet, bytes, PACKET_LAYER_3_IP, &error) !=
+	    PACKET_OK)
+		die("microbench: bad packet: %s\n", error);
+	return packet;
+}
+
+static void setup_packets(void)
+{
+	u8 mptcp_data[sizeof(mptcp_ipv4_data)];
+	struct ipv4 *ipv4 = (struct ipv4 *)mptcp_data;
+	int i;
+
+	if (tcp_packet != NULL)
+		return;
+	tcp_packet = bench_packet(tcp_ipv4_data, sizeof(tcp_ipv4_data));
+	tcp_packet_copy = bench_packet(tcp_ipv4_data, sizeof(tcp_ipv4_data));
+	parse_packet_buffer = bench_packet(tcp_ipv4_data,
+					   sizeof(tcp_ipv4_data));
+
+	memcpy(mptcp_data, mptcp_ipv4_data, sizeof(mptcp_data));
+	ipv4->check = ipv4_checksum(ipv4, sizeof(*ipv4));
+	mptcp_packet = bench_packet(mptcp_data, sizeof(mptcp_data));
+	mptcp_live_packet = bench_packet(mptcp_data, sizeof(mptcp_data));
+
+	for (i = 0; i < sizeof(payload); ++i)
+		payload[i] = i;
+}
+
+static void run_parse_packet(int iterations)
+{
+	char *error = NULL;
+	int i;
+
+	/* A packet is parsed only once, so clear the headers and
+	 * length the last parse found.
+	 */
+	for (i = 0; i < iterations; ++i) {
+		memset(parse_packet_buffer->headers, 0,
+		       sizeof(parse_packet_buffer->headers));
+		parse_packet_buffer->ip_bytes = 0;
+		if (parse_packet(parse_packet_buffer, sizeof(tcp_ipv4_data),
+				 PACKET_LAYER_3_IP, &error) != PACKET_OK)
+			die("microbench: %s\n", error);
+	}
+}
+
+static void run_ipv4_checksum(int iterations)
+{
+	int i;
+
+	for (i = 0; i < iterations; ++i)
+		sink += ipv4_checksum(tcp_packet->ipv4,
+				      sizeof(*tcp_packet->ipv4));
+}
+
+static void run_tcp_checksum_1460(int iterations)
+{
+	int i;
+
+	for (i = 0; i < iterations; ++i)
+		sink += tcp_udp_v4_checksum(tcp_packet->ipv4->src_ip,
+					    tcp_packet->ipv4->dst_ip,
+					    IPPROTO_TCP, payload,
+					    sizeof(payload));
+}
+
+static void run_tcp_options_walk(int iterations)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option;
+	int i;
+
+	for (i = 0; i < iterations; ++i) {
+		for (option = tcp_options_begin(tcp_packet, &iter);
+		     option != NULL;
+		     option = tcp_options_next(&iter, NULL))
+			sink += option->kind;
+	}
+}
+
+static void run_same_tcp_options(int iterations)
+{
+	int i;
+
+	for (i = 0; i < iterations; ++i)
+		sink += same_tcp_options(tcp_packet, tcp_packet_copy);
+}
+
+static void run_mptcp_fields(int iterations)
+{
+	struct tcp_option *option =
+		get_mptcp_option(mptcp_packet, MP_FASTCLOSE_SUBTYPE);
+	int i;
+
+	/* Each run fills in the key the kernel sent, so unset it again. */
+	for (i = 0; i < iterations; ++i) {
+		option->data.mp_fastclose.receiver_key = UNDEFINED;
+		sink += mptcp_insert_and_extract_opt_fields(
+			mptcp_packet, mptcp_live_packet, DIRECTION_OUTBOUND);
+	}
+}
+
+static void setup_hash_map(void)
+{
+	int i;
+
+	if (hash_map != NULL)
+		return;
+	hash_map = hash_map_new(BENCH_HASH_KEYS);
+	for (i = 0; i < BENCH_HASH_KEYS; ++i) {
+		/* Spread the keys the way sequence numbers are. */
+		hash_keys[i] = i * 2654435761U;
+		hash_map_set(hash_map, hash_keys[i], i);
+	}
+}
+
+static void run_hash_map_get(int iterations)
+{
+	u32 value = 0;
+	int i;
+
+	for (i = 0; i < iterations; ++i) {
+		hash_map_get(hash_map, hash_keys[i % BENCH_HASH_KEYS], &value);
+		sink += value;
+	}
+}
+
+/* Generate a script that accepts a connection and then sends and ACKs
+ * many data segments with timestamps.
+ */
+static void setup_script(void)
+{
+	size_t bytes = 0;
+	FILE *f;
+	int i;
+
+	if (script_text != NULL)
+		return;
+	f = open_memstream(&script_text, &bytes);
+	fprintf(f,
+		"0 socket(..., SOCK_STREAM, IPPROTO_TCP) = 3\n"
+		"+0 setsockopt(3, SOL_SOCKET, SO_REUSEADDR, [1], 4) = 0\n"
+		"+0 bind(3, ..., ...) = 0\n"
+		"+0 listen(3, 1) = 0\n"
+		"+0 < S 0:0(0) win 32792 <mss 1000,sackOK,TS val 1 ecr 0,"
+		"nop,wscale 7>\n"
+		"+0 > S. 0:0(0) ack 1 <mss 1460,sackOK,TS val 100 ecr 1,"
+		"nop,wscale 8>\n"
+		"+.1 < . 1:1(0) ack 1 win 257 <nop,nop,TS val 2 ecr 100>\n"
+		"+0 accept(3, ..., ...) = 4\n");
+	for (i = 0; i < BENCH_SCRIPT_SEGMENTS; ++i) {
+		fprintf(f,
+			"+0 write(4, ..., 1000) = 1000\n"
+			"+0 > P. %d:%d(1000) ack 1 <nop,nop,TS val %d ecr %d>\n"
+			"+.01 < . 1:1(0) ack %d win 257 "
+			"<nop,nop,TS val %d ecr %d>\n",
+			1 + i * 1000, 1 + (i + 1) * 1000, 101 + i, 2 + i,
+			1 + (i + 1) * 1000, 3 + i, 101 + i);
+	}
+	fclose(f);
+}
+
+static void run_parse_script(int iterations)
+{
+	char *argv[] = { "microbench", NULL };
+	struct config config;
+	struct script script;
+	int i;
+
+	for (i = 0; i < iterations; ++i) {
+		if (parse_script_and_set_config(1, argv, &config, &script,
+						"microbench.pkt", script_text))
+			die("microbench: cannot parse generated script\n");
+		sink += script.length;
+		script_free(&script);
+		free_mp_state();
+	}
+}
+
+static const struct benchmark benchmarks[] = {
+	{ "parse_packet_tcp_ipv4", setup_packets, run_parse_packet,
+	  1000000 },
+	{ "ipv4_checksum", setup_packets, run_ipv4_checksum, 10000000 },
+	{ "tcp_checksum_1460", setup_packets, run_tcp_checksum_1460,
+	  1000000 },
+	{ "tcp_options_walk", setup_packets, run_tcp_options_walk,
+	  10000000 },
+	{ "same_tcp_options", setup_packets, run_same_tcp_options,
+	  1000000 },
+	{ "mptcp_insert_and_extract", setup_packets, run_mptcp_fields,
+	  1000000 },
+	{ "parse_script_6k_lines", setup_script, run_parse_script, 10 },
+	{ "hash_map_get", setup_hash_map, run_hash_map_get, 10000000 },
+};
+
+/* Return the monotonic time in nanoseconds. */
+static s64 now_nsecs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		die_perror("clock_gettime");
+	return (s64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_s64(const void *a, const void *b)
+{
+	const s64 x = *(const s64 *)a, y = *(const s64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Run the given benchmark and print its line of results. */
+static void run_benchmark(const struct benchmark *benchmark)
+{
+	s64 nsecs[BENCH_REPETITIONS];
+	int i;
+
+	if (benchmark->setup != NULL)
+		benchmark->setup();
+	benchmark->run(benchmark->iterations);	/* warm up */
+	for (i = 0; i < BENCH_REPETITIONS; ++i) {
+		const s64 start = now_nsecs();
+
+		benchmark->run(benchmark->iterations);
+		nsecs[i] = now_nsecs() - start;
+	}
+	qsort(nsecs, BENCH_REPETITIONS, sizeof(nsecs[0]), compare_s64);
+
+	printf("%s\t%d\t%.2f\t%.2f\n", benchmark->name,
+	       benchmark->iterations,
+	       (double)nsecs[0] / benchmark->iterations,
+	       (double)nsecs[BENCH_REPETITIONS / 2] / benchmark->iterations);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+	int i;
+
+	printf("# benchmark\titerations\tmin_ns_per_op\tmedian_ns_per_op\n");
+	for (i = 0; i < ARRAY_SIZE(benchmarks); ++i) {
+		if (filter == NULL || strstr(benchmarks[i].name, filter))
+			run_benchmark(&benchmarks[i]);
+	}
+	return 0;
+}
@@ -4,6 +4,7 @@
 
 #include "mptcp.h"
 #include "packet_to_string.h"
+#include "probes.h"
 
 //#include "mptcp_sha1.h"
 
@@ -1992,6 +1993,7 @@ int mptcp_insert_and_extract_opt_fields(struct packet *packet_to_modify,
 	struct tcp_option *tcp_opt_to_modify =
 			tcp_options_begin(packet_to_modify, &tcp_opt_iter);
 	int error = STATUS_OK;
+	PROBE2(mptcp__fields__start, direction, packet_to_modify->ip_bytes);
 	while(tcp_opt_to_modify != NULL){
 		if(tcp_opt_to_modify->kind == TCPOPT_MPTCP){
 			switch(tcp_opt_to_modify->data.mp_capable.subtype){
@@ -2047,5 +2049,6 @@ int mptcp_insert_and_extract_opt_fields(struct packet *packet_to_modify,
 		tcp_opt_to_modify = tcp_options_next(&tcp_opt_iter, NULL);
 	}
 
+	PROBE2(mptcp__fields__done, direction, error);
 	return error;
 }
@@ -24,6 +24,7 @@
 
 #include "net_utils.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <net/if.h>
 #include <unistd.h>
@@ -170,3 +171,26 @@ void net_setup_dev_address(const char *dev_name,
 		net_del_dev_address(cur_dev_name, ip, prefix_len);
 	net_add_dev_address(dev_name, ip, prefix_len);
 }
+
+void net_set_rps_cpu(const char *dev_name, int cpu)
+{
+#ifdef linux
+	char *path = NULL;
+	FILE *f;
+	int word;
+
+	/* The mask is in comma-separated 32-bit words, highest first. */
+	asprintf(&path, "/sys/class/net/%s/queues/rx-0/rps_cpus", dev_name);
+	f = fopen(path, "w");
+	if (f == NULL)
+		die_perror(path);
+	for (word = cpu / 32; word >= 0; --word)
+		fprintf(f, "%08x%s", word == cpu / 32 ? 1U << (cpu % 32) : 0,
+			word > 0 ? "," : "\n");
+	if (fclose(f) != 0)
+		die_perror(path);
+	free(path);
+#else
+	die("--net_cpu is only supported on Linux\n");
+#endif
+}
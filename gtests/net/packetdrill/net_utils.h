@@ -53,4 +53,9 @@ extern void net_setup_dev_address(const char *dev_name,
 				  const struct ip_address *ip,
 				  int prefix_len);
 
+/* Steer the receive processing of packets arriving on the given device
+ * to the given CPU, with RPS.
+ */
+extern void net_set_rps_cpu(const char *dev_name, int cpu);
+
 #endif /* __NET_UTILS_H__ */
@@ -65,6 +65,9 @@ struct local_netdev {
 	int ipv6_control_fd;	/* fd for IPv6 configuration of tun interface */
 	int index;		/* interface index from if_nametoindex */
 	struct packet_socket *psock;	/* for sniffing packets (owned) */
+
+	struct packet_socket_flow *flows;	/* flows psock is filtering */
+	int num_flows;		/* or -1 if no flow filter is installed */
 };
 
 struct netdev_ops local_netdev_ops;
@@ -111,8 +114,10 @@ static void check_remote_address(struct config *config,
 /* Create a tun device for the lifetime of this test. */
 static void create_device(struct config *config, struct local_netdev *netdev)
 {
-	/* Open the tun device, which "clones" it for our purposes. */
-	int tun_fd = open(TUN_PATH, O_RDWR);
+	/* Open the tun device, which "clones" it for our purposes. We
+	 * only read it to consume what is queued, so it is non-blocking.
+	 */
+	int tun_fd = open(TUN_PATH, O_RDWR | O_NONBLOCK);
 	if (tun_fd < 0)
 		die_perror("open tun device");
 
@@ -271,6 +276,7 @@ struct netdev *local_netdev_new(struct config *config)
 	struct local_netdev *netdev = calloc(1, sizeof(struct local_netdev));
 
 	netdev->netdev.ops = &local_netdev_ops;
+	netdev->num_flows = -1;
 
 	cleanup_old_device(config, netdev);
 
@@ -284,6 +290,8 @@ struct netdev *local_netdev_new(struct config *config)
 			      config->live_prefix_len);
 
 	route_traffic_to_device(config, netdev);
+	if (config->net_cpu >= 0)
+		net_set_rps_cpu(netdev->name, config->net_cpu);
 	netdev->psock = packet_socket_new(netdev->name);
 
 	return (struct netdev *)netdev;
@@ -303,6 +311,7 @@ static void local_netdev_free(struct netdev *a_netdev)
 		close(netdev->ipv6_control_fd);
 	if (netdev->name != NULL)
 		free(netdev->name);
+	free(netdev->flows);
 	memset(netdev, 0, sizeof(*netdev));  /* paranoia to help catch bugs */
 	free(netdev);
 }
@@ -363,31 +372,39 @@ static int local_netdev_send(struct netdev *a_netdev,
 	return STATUS_OK;
 }
 
-/* Read the given number of packets out of the tun device. We read
- * these packets so that the kernel can exercise its normal code paths
- * for packet transmit completion, since this code path may feed back
- * to TCP behavior; e.g., see the Linux patch "tcp: avoid retransmits
- * of TCP packets hanging in host queues".  We don't need to actually
+/* Read all the packets queued in the tun device. We read these
+ * packets so that the kernel can exercise its normal code paths for
+ * packet transmit completion, since this code path may feed back to
+ * TCP behavior; e.g., see the Linux patch "tcp: avoid retransmits of
+ * TCP packets hanging in host queues".  We don't need to actually
  * need the packet contents, but on Linux we need to read at least 1
  * byte of packet data to consume the packet.
+ *
+ * The tun queue holds every packet the kernel sent, including those
+ * our flow filter kept from the packet socket, so it is not in step
+ * with what we sniffed; we just consume whatever is queued, without
+ * blocking.
  */
-static void local_netdev_read_queue(struct local_netdev *netdev,
-				    int num_packets)
+static void local_netdev_read_queue(struct local_netdev *netdev)
 {
 	char buf[1];
-	int i = 0, in_bytes = 0;
+	int in_bytes = 0;
 
-	for (i = 0; i < num_packets; ++i) {
+	while (1) {
 		in_bytes = read(netdev->tun_fd, buf, sizeof(buf));
 		assert(in_bytes <= (int)sizeof(buf));
 
+		if (in_bytes == 0)
+			return;
 		if (in_bytes < 0) {
 			if (errno == EINTR)
 				continue;
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;		/* queue is empty */
 			else
 				die_perror("tun read()");
 		}
-       }
+	}
 }
 
 static int local_netdev_receive(struct netdev *a_netdev,
@@ -402,10 +419,53 @@ static int local_netdev_receive(struct netdev *a_netdev,
 	status = netdev_receive_loop(netdev->psock, PACKET_LAYER_3_IP,
 				     DIRECTION_OUTBOUND, packet, &num_packets,
 				     error);
-	local_netdev_read_queue(netdev, num_packets);
+	local_netdev_read_queue(netdev);
 	return status;
 }
 
+static void local_netdev_set_flow_filter(
+	struct netdev *a_netdev,
+	const struct packet_socket_flow *flows,
+	int num_flows)
+{
+	struct local_netdev *netdev = to_local_netdev(a_netdev);
+	size_t bytes = num_flows * sizeof(*flows);
+
+	/* We get called for every packet event, so skip the
+	 * setsockopt() if the set of flows has not changed.
+	 */
+	if (num_flows == netdev->num_flows &&
+	    memcmp(flows, netdev->flows, bytes) == 0)
+		return;
+
+	DEBUGP("local_netdev_set_flow_filter: %d flows\n", num_flows);
+
+	packet_socket_set_flow_filter(netdev->psock, PACKET_LAYER_3_IP,
+				      DIRECTION_OUTBOUND, flows, num_flows);
+
+	free(netdev->flows);
+	netdev->flows = malloc(bytes + 1);
+	memcpy(netdev->flows, flows, bytes);
+	netdev->num_flows = num_flows;
+}
+
+static void local_netdev_drain(struct netdev *a_netdev)
+{
+	struct local_netdev *netdev = to_local_netdev(a_netdev);
+
+	DEBUGP("local_netdev_drain\n");
+
+	packet_socket_drain(netdev->psock);
+	local_netdev_read_queue(netdev);
+}
+
+static bool local_netdev_wait(struct netdev *a_netdev, s64 timeout_usecs)
+{
+	struct local_netdev *netdev = to_local_netdev(a_netdev);
+
+	return packet_socket_wait(netdev->psock, timeout_usecs);
+}
+
 int netdev_receive_loop(struct packet_socket *psock,
 			enum packet_layer_t layer,
 			enum direction_t direction,
@@ -450,4 +510,7 @@ struct netdev_ops local_netdev_ops = {
 	.free = local_netdev_free,
 	.send = local_netdev_send,
 	.receive = local_netdev_receive,
+	.set_flow_filter = local_netdev_set_flow_filter,
+	.drain = local_netdev_drain,
+	.wait = local_netdev_wait,
 };
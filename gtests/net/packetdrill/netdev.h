@@ -54,6 +54,25 @@ struct netdev_ops {
 	 */
 	int (*receive)(struct netdev *netdev,
 		       struct packet **packet, char **error);
+
+	/* Only sniff packets belonging to the given flows from now on.
+	 * Optional: may be NULL if the netdev cannot filter.
+	 */
+	void (*set_flow_filter)(struct netdev *netdev,
+				const struct packet_socket_flow *flows,
+				int num_flows);
+
+	/* Discard any packets already queued for sniffing, without
+	 * blocking. Optional: may be NULL if nothing is left queued
+	 * between runs.
+	 */
+	void (*drain)(struct netdev *netdev);
+
+	/* Wait up to the given number of microseconds for a packet to
+	 * sniff, and return true if there is one. Optional: may be NULL
+	 * if the netdev cannot tell, in which case receive just blocks.
+	 */
+	bool (*wait)(struct netdev *netdev, s64 timeout_usecs);
 };
 
 
@@ -81,6 +100,33 @@ static inline int netdev_receive(struct netdev *netdev,
 	return netdev->ops->receive(netdev, packet, error);
 }
 
+/* Only sniff packets belonging to the given flows from now on. */
+static inline void netdev_set_flow_filter(
+	struct netdev *netdev,
+	const struct packet_socket_flow *flows,
+	int num_flows)
+{
+	if (netdev->ops->set_flow_filter != NULL)
+		netdev->ops->set_flow_filter(netdev, flows, num_flows);
+}
+
+/* Discard any packets already queued for sniffing. */
+static inline void netdev_drain(struct netdev *netdev)
+{
+	if (netdev->ops->drain != NULL)
+		netdev->ops->drain(netdev);
+}
+
+/* Wait up to the given time for a packet to sniff. Returns false if
+ * none arrived in time.
+ */
+static inline bool netdev_wait(struct netdev *netdev, s64 timeout_usecs)
+{
+	if (netdev->ops->wait == NULL)
+		return true;
+	return netdev->ops->wait(netdev, timeout_usecs);
+}
+
 
 /* Keep sniffing packets leaving the kernel until we see one we know
  * about and can parse. Return a pointer to the newly-allocated
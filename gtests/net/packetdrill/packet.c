@@ -32,6 +32,7 @@
 #include "gre_packet.h"
 #include "ip_packet.h"
 #include "mpls_packet.h"
+#include "verify_plan.h"
 
 
 /* Info for all types of header we support. */
@@ -57,6 +58,7 @@ struct packet *packet_new(u32 buffer_bytes)
 
 void packet_free(struct packet *packet)
 {
+	verify_plan_free(packet->verify_plan);
 	free(packet->buffer);
 	memset(packet, 0, sizeof(*packet));  /* paranoia to help catch bugs */
 	free(packet);
@@ -154,6 +156,8 @@ static struct packet *packet_copy_with_headroom(struct packet *old_packet,
 	packet->flags		= old_packet->flags;
 	packet->ecn		= old_packet->ecn;
 	packet->socket_script_fd = old_packet->socket_script_fd;
+	packet->train_bytes	= old_packet->train_bytes;
+	packet->train_mss	= old_packet->train_mss;
 
 	packet_copy_headers(packet, old_packet, bytes_headroom);
 
@@ -175,7 +179,11 @@ static struct packet *packet_copy_with_headroom(struct packet *old_packet,
 
 struct packet *packet_copy(struct packet *old_packet)
 {
-	return packet_copy_with_headroom(old_packet, 0);
+	struct packet *packet = packet_copy_with_headroom(old_packet, 0);
+
+	/* With no headroom the headers stay put, so the plan holds. */
+	packet->verify_plan = verify_plan_copy(old_packet->verify_plan);
+	return packet;
 }
 
 /* Finalize all the headers once we know what's inside inner layers. */
@@ -198,6 +206,23 @@ static void packet_finish_encapsulation_headers(struct packet *packet)
 	}
 }
 
+void packet_trim_payload(struct packet *packet, int bytes)
+{
+	int i;
+
+	assert(bytes >= 0);
+	assert(bytes <= packet_payload_len(packet));
+
+	for (i = 0; i < ARRAY_SIZE(packet->headers); ++i) {
+		if (packet->headers[i].type == HEADER_NONE)
+			break;
+		packet->headers[i].total_bytes -= bytes;
+	}
+	packet->ip_bytes -= bytes;
+
+	packet_finish_encapsulation_headers(packet);
+}
+
 struct packet *packet_encapsulate(struct packet *outer, struct packet *inner)
 {
 	struct packet *packet = NULL;
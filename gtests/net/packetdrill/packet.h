@@ -66,6 +66,8 @@ static const int PACKET_READ_BYTES = 64 * 1024;
  * gives the total space in the buffer, which may be bigger than the
  * actual amount occupied by the packet data.
  */
+struct verify_plan;
+
 struct packet {
 	u8 *buffer;		/* data buffer: full contents of packet */
 	u32 buffer_bytes;	/* bytes of space in data buffer */
@@ -102,6 +104,22 @@ struct packet {
 	u32 flags;		/* various meta-flags */
 #define FLAG_WIN_NOCHECK	0x1  /* don't check TCP receive window */
 #define FLAG_OPTIONS_NOCHECK	0x2  /* don't check TCP options */
+#define FLAG_PSH_NOCHECK	0x4  /* don't check TCP PSH bit */
+#define FLAG_TIME_NOCHECK	0x8  /* don't check event time */
+
+	/* A script packet may stand for a whole train of TCP segments,
+	 * carrying train_bytes of payload. Inbound trains are injected
+	 * in train_mss sized pieces; outbound ones may arrive in pieces
+	 * of any size, as TSO leaves that to the kernel.
+	 * The packet itself holds the first segment of the train.
+	 */
+	u32 train_bytes;	/* payload bytes in whole train, or 0 */
+	u16 train_mss;		/* payload bytes in each inbound segment */
+
+	/* For script packets, how to verify the live packets that
+	 * should match them; see verify_plan.h.
+	 */
+	struct verify_plan *verify_plan;	/* or NULL if none */
 
 	enum ip_ecn_t ecn;	/* IPv4/IPv6 ECN treatment for packet */
 
@@ -118,6 +136,11 @@ extern void packet_free(struct packet *packet);
 /* Create a packet that is a copy of the contents of the given packet. */
 extern struct packet *packet_copy(struct packet *old_packet);
 
+/* Drop the given number of bytes from the end of the packet payload,
+ * and update the lengths in all the headers that enclose it.
+ */
+extern void packet_trim_payload(struct packet *packet, int bytes);
+
 /* Return the number of headers in the given packet. */
 extern int packet_header_count(const struct packet *packet);
 
@@ -34,9 +34,20 @@
 #include "ethernet.h"
 #include "ip_address.h"
 #include "packet.h"
+#include "packet_parser.h"
 
 struct packet_socket;
 
+/* A flow whose packets we want to sniff, in the given direction. Ports
+ * are in network order. A zero src_port matches any source port, and
+ * a zero dst_port matches any port at all.
+ */
+struct packet_socket_flow {
+	u8 protocol;		/* IPPROTO_TCP or IPPROTO_UDP */
+	u16 src_port;		/* source port, or 0 for any */
+	u16 dst_port;		/* destination port, or 0 for any */
+};
+
 /* Allocate and initialize a packet socket. */
 extern struct packet_socket *packet_socket_new(const char *device_name);
 
@@ -49,6 +60,19 @@ extern void packet_socket_set_filter(
 	const struct ether_addr *client_ether_addr,
 	const struct ip_address *client_live_ip);
 
+/* Replace any filter with one that passes only IPv4/IPv6 packets going
+ * over the device in the given direction that belong to one of the
+ * given flows, so that unrelated traffic is dropped in the kernel
+ * before it is copied to us. The layer says whether packets on this
+ * device start with an Ethernet header or with the IP header.
+ */
+extern void packet_socket_set_flow_filter(
+	struct packet_socket *psock,
+	enum packet_layer_t layer,
+	enum direction_t direction,
+	const struct packet_socket_flow *flows,
+	int num_flows);
+
 /* Send the given packet using writev. Return STATUS_OK on success,
  * or STATUS_ERR if writev returns an error.
  */
@@ -66,4 +90,15 @@ extern int packet_socket_receive(struct packet_socket *psock,
 				 enum direction_t direction,
 				 struct packet *packet, int *in_bytes);
 
+/* Discard all the packets already sniffed and waiting to be received,
+ * without blocking.
+ */
+extern void packet_socket_drain(struct packet_socket *psock);
+
+/* Wait up to the given number of microseconds for a sniffed packet.
+ * Return true if there is one to receive.
+ */
+extern bool packet_socket_wait(struct packet_socket *psock,
+			       s64 timeout_usecs);
+
 #endif /* __PACKET_SOCKET_H__ */
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <net/if.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -39,6 +40,7 @@
 #include <linux/filter.h>
 
 #include "ethernet.h"
+#include "ipv6.h"
 #include "logging.h"
 
 /* Number of bytes to buffer in the packet socket we use for sniffing. */
@@ -180,6 +182,145 @@ void packet_socket_set_filter(struct packet_socket *psock,
 	}
 }
 
+/* Append a classic BPF instruction to the given program, returning
+ * its index so the caller can patch jump offsets later.
+ */
+static int bpf_emit(struct sock_filter *prog, int *len,
+		    u16 code, u8 jt, u8 jf, u32 k)
+{
+	struct sock_filter insn = { code, jt, jf, k };
+
+	prog[*len] = insn;
+	return (*len)++;
+}
+
+/* With the IP protocol in the accumulator, fall through if it is one
+ * of the protocols we want and drop the packet otherwise.
+ */
+static void bpf_emit_protocol_check(struct sock_filter *prog, int *len,
+				    bool want_tcp, bool want_udp)
+{
+	if (want_tcp && want_udp) {
+		bpf_emit(prog, len, BPF_JMP|BPF_JEQ|BPF_K, 2, 0, IPPROTO_TCP);
+		bpf_emit(prog, len, BPF_JMP|BPF_JEQ|BPF_K, 1, 0, IPPROTO_UDP);
+	} else {
+		bpf_emit(prog, len, BPF_JMP|BPF_JEQ|BPF_K, 1, 0,
+			 want_tcp ? IPPROTO_TCP : IPPROTO_UDP);
+	}
+	bpf_emit(prog, len, BPF_RET|BPF_K, 0, 0, 0);
+}
+
+void packet_socket_set_flow_filter(struct packet_socket *psock,
+				   enum packet_layer_t layer,
+				   enum direction_t direction,
+				   const struct packet_socket_flow *flows,
+				   int num_flows)
+{
+	/* Offset of the IP header: tun devices have no link layer. */
+	const u32 l3 = (layer == PACKET_LAYER_2_ETHERNET) ?
+		sizeof(struct ether_header) : 0;
+	const u32 accept = 0xffff;
+	bool want_tcp = false, want_udp = false;
+	struct sock_fprog bpfcode;
+	struct sock_filter *prog = NULL;
+	int len = 0, to_ipv6 = 0, to_ports = 0, i;
+
+	assert(direction == DIRECTION_OUTBOUND ||
+	       direction == DIRECTION_INBOUND);
+
+	for (i = 0; i < num_flows; ++i) {
+		if (flows[i].protocol == IPPROTO_TCP)
+			want_tcp = true;
+		else if (flows[i].protocol == IPPROTO_UDP)
+			want_udp = true;
+		else
+			assert(!"bad flow protocol");
+	}
+
+	/* At most 22 instructions of header checks plus 5 per flow. */
+	prog = calloc(22 + 5 * num_flows + 1, sizeof(*prog));
+
+	if (num_flows == 0) {
+		bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, 0);
+		goto attach;
+	}
+
+	/* Only packets going the way we are sniffing. */
+	bpf_emit(prog, &len, BPF_LD|BPF_W|BPF_ABS, 0, 0,
+		 SKF_AD_OFF + SKF_AD_PKTTYPE);
+	bpf_emit(prog, &len, BPF_JMP|BPF_JEQ|BPF_K, 1, 0,
+		 direction == DIRECTION_OUTBOUND ?
+		 PACKET_OUTGOING : PACKET_HOST);
+	bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, 0);
+
+	/* Dispatch on the IP version nibble. */
+	bpf_emit(prog, &len, BPF_LD|BPF_B|BPF_ABS, 0, 0, l3);
+	bpf_emit(prog, &len, BPF_ALU|BPF_AND|BPF_K, 0, 0, 0xf0);
+	to_ipv6 = bpf_emit(prog, &len, BPF_JMP|BPF_JEQ|BPF_K, 0, 0, 0x40);
+
+	/* IPv4: check the protocol, skip non-first fragments, and load
+	 * the variable IP header length into X.
+	 */
+	bpf_emit(prog, &len, BPF_LD|BPF_B|BPF_ABS, 0, 0, l3 + 9);
+	bpf_emit_protocol_check(prog, &len, want_tcp, want_udp);
+	bpf_emit(prog, &len, BPF_LD|BPF_H|BPF_ABS, 0, 0, l3 + 6);
+	bpf_emit(prog, &len, BPF_JMP|BPF_JSET|BPF_K, 0, 1, 0x1fff);
+	bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, 0);
+	bpf_emit(prog, &len, BPF_LDX|BPF_B|BPF_MSH, 0, 0, l3);
+	to_ports = bpf_emit(prog, &len, BPF_JMP|BPF_JA, 0, 0, 0);
+
+	/* IPv6: we only handle a TCP or UDP header right after the
+	 * fixed header, just like our packet parser.
+	 */
+	prog[to_ipv6].jf = len - to_ipv6 - 1;
+	bpf_emit(prog, &len, BPF_JMP|BPF_JEQ|BPF_K, 1, 0, 0x60);
+	bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, 0);
+	bpf_emit(prog, &len, BPF_LD|BPF_B|BPF_ABS, 0, 0, l3 + 6);
+	bpf_emit_protocol_check(prog, &len, want_tcp, want_udp);
+	bpf_emit(prog, &len, BPF_LDX|BPF_W|BPF_IMM, 0, 0,
+		 sizeof(struct ipv6));
+
+	/* Ports: the layer 4 header starts X bytes after the IP header.
+	 * TCP and UDP both start with the source and destination ports.
+	 */
+	prog[to_ports].k = len - to_ports - 1;
+	for (i = 0; i < num_flows; ++i) {
+		if (flows[i].dst_port == 0) {
+			bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, accept);
+			break;
+		}
+		bpf_emit(prog, &len, BPF_LD|BPF_H|BPF_IND, 0, 0, l3 + 2);
+		if (flows[i].src_port != 0) {
+			bpf_emit(prog, &len, BPF_JMP|BPF_JEQ|BPF_K, 0, 3,
+				 ntohs(flows[i].dst_port));
+			bpf_emit(prog, &len, BPF_LD|BPF_H|BPF_IND, 0, 0, l3);
+			bpf_emit(prog, &len, BPF_JMP|BPF_JEQ|BPF_K, 0, 1,
+				 ntohs(flows[i].src_port));
+		} else {
+			bpf_emit(prog, &len, BPF_JMP|BPF_JEQ|BPF_K, 0, 1,
+				 ntohs(flows[i].dst_port));
+		}
+		bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, accept);
+	}
+	bpf_emit(prog, &len, BPF_RET|BPF_K, 0, 0, 0);
+
+attach:
+	if (DEBUG_LOGGING) {
+		DEBUGP("flow filter for %d flows:\n", num_flows);
+		for (i = 0; i < len; ++i)
+			DEBUGP("{ 0x%x, %d, %d, 0x%08x },\n", prog[i].code,
+			       prog[i].jt, prog[i].jf, prog[i].k);
+	}
+
+	bpfcode.len	= len;
+	bpfcode.filter	= prog;
+	if (setsockopt(psock->packet_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+		       &bpfcode, sizeof(bpfcode)) < 0) {
+		die_perror("setsockopt SOL_SOCKET, SO_ATTACH_FILTER");
+	}
+	free(prog);
+}
+
 struct packet_socket *packet_socket_new(const char *device_name)
 {
 	struct packet_socket *psock = calloc(1, sizeof(struct packet_socket));
@@ -270,4 +411,34 @@ int packet_socket_receive(struct packet_socket *psock,
 	return STATUS_OK;
 }
 
+void packet_socket_drain(struct packet_socket *psock)
+{
+	char buf[1];
+
+	while (1) {
+		if (recv(psock->packet_fd, buf, sizeof(buf),
+			 MSG_DONTWAIT) >= 0)
+			continue;
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return;		/* nothing left */
+		die_perror("packet socket recv()");
+	}
+}
+
+bool packet_socket_wait(struct packet_socket *psock, s64 timeout_usecs)
+{
+	struct pollfd pfd = { .fd = psock->packet_fd, .events = POLLIN };
+	int result;
+
+	/* Round up, so we never give up before the time is over. */
+	do {
+		result = poll(&pfd, 1, (timeout_usecs + 999) / 1000);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0)
+		die_perror("packet socket poll()");
+	return result > 0;
+}
+
 #endif  /* linux */
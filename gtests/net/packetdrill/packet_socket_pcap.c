@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <net/if.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -160,6 +161,58 @@ void packet_socket_set_filter(struct packet_socket *psock,
 	free(filter_str);
 }
 
+void packet_socket_set_flow_filter(struct packet_socket *psock,
+				   enum packet_layer_t layer,
+				   enum direction_t direction,
+				   const struct packet_socket_flow *flows,
+				   int num_flows)
+{
+	struct bpf_program bpf_code;
+	char *filter_str = NULL;
+	char *old_str = NULL;
+	int i;
+
+	/* libpcap already knows the link layer and direction is
+	 * checked when we receive, so we only need to describe flows.
+	 */
+	filter_str = strdup(num_flows == 0 ? "ip and not ip" : "");
+	for (i = 0; i < num_flows; ++i) {
+		old_str = filter_str;
+		if (flows[i].dst_port == 0) {
+			asprintf(&filter_str, "%s%s(%s)",
+				 old_str, i == 0 ? "" : " or ",
+				 flows[i].protocol == IPPROTO_TCP ?
+				 "tcp" : "udp");
+		} else if (flows[i].src_port != 0) {
+			asprintf(&filter_str,
+				 "%s%s(%s dst port %u and src port %u)",
+				 old_str, i == 0 ? "" : " or ",
+				 flows[i].protocol == IPPROTO_TCP ?
+				 "tcp" : "udp",
+				 ntohs(flows[i].dst_port),
+				 ntohs(flows[i].src_port));
+		} else {
+			asprintf(&filter_str, "%s%s(%s dst port %u)",
+				 old_str, i == 0 ? "" : " or ",
+				 flows[i].protocol == IPPROTO_TCP ?
+				 "tcp" : "udp",
+				 ntohs(flows[i].dst_port));
+		}
+		free(old_str);
+	}
+
+	DEBUGP("setting BPF filter: %s\n", filter_str);
+
+	if (pcap_compile(psock->pcap, &bpf_code, filter_str, 1, 0) != 0)
+		die_pcap_perror(psock->pcap, "pcap_compile");
+
+	if (pcap_setfilter(psock->pcap, &bpf_code) != 0)
+		die_pcap_perror(psock->pcap, "pcap_setfilter");
+
+	pcap_freecode(&bpf_code);
+	free(filter_str);
+}
+
 struct packet_socket *packet_socket_new(const char *device_name)
 {
 	struct packet_socket *psock = calloc(1, sizeof(struct packet_socket));
@@ -287,4 +340,34 @@ int packet_socket_receive(struct packet_socket *psock,
 	return STATUS_OK;
 }
 
+void packet_socket_drain(struct packet_socket *psock)
+{
+	struct pcap_pkthdr *pkt_header = NULL;
+	const u8 *pkt_data = NULL;
+	int status = 0;
+
+	/* As above, pcap_next_ex() returns 0 once nothing is waiting. */
+	while ((status = pcap_next_ex(psock->pcap, &pkt_header,
+				      &pkt_data)) == 1)
+		;
+	if (status == -1)
+		die_pcap_perror(psock->pcap, "pcap_next_ex");
+}
+
+bool packet_socket_wait(struct packet_socket *psock, s64 timeout_usecs)
+{
+	struct pollfd pfd = { .events = POLLIN };
+	int result;
+
+	pfd.fd = pcap_get_selectable_fd(psock->pcap);
+
+	/* Round up, so we never give up before the time is over. */
+	do {
+		result = poll(&pfd, 1, (timeout_usecs + 999) / 1000);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0)
+		die_perror("packet socket poll()");
+	return result > 0;
+}
+
 #endif  /* USE_LIBPCAP */
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <unistd.h>
 #include "config.h"
+#include "fuzz.h"
 #include "parse.h"
 #include "run.h"
 #include "script.h"
@@ -41,7 +42,8 @@ static void run_init_scripts(struct config *config)
 {
 	char *cp1, *cp2, *scripts, *error;
 
-	if (config->init_scripts == NULL)
+	/* A replay runs no commands, as with the script's init command. */
+	if (config->init_scripts == NULL || config->replay_path != NULL)
 		return;
 
 	cp1 = scripts = strdup(config->init_scripts);
@@ -64,6 +66,7 @@ static void run_init_scripts(struct config *config)
 int main(int argc, char *argv[])
 {
 	struct config config;
+	bool found = false;	/* did --fuzz find crashes or hangs? */
 	set_default_config(&config);
 	/* Get command line options and list of test scripts. */
 	char **arg = parse_command_line_options(argc, argv, &config);
@@ -102,12 +105,22 @@ int main(int argc, char *argv[])
 			exit(EXIT_FAILURE);
 
 		/* If --dry_run, then don't actually execute the script. */
-		if (config.dry_run)
+		if (config.dry_run) {
+			script_free(&script);
 			continue;
+		}
 
 		run_init_scripts(&config);
-		run_script(&config, &script);
+
+		/* With --fuzz, run mutated cases of the script instead. */
+		if (config.fuzz_cases > 0) {
+			if (fuzz_script(&config, &script) > 0)
+				found = true;
+			continue;
+		}
+
+		run_script(&config, &script, script_netdev_new(&config));
 	}
 
-	return 0;
+	return found ? EXIT_FAILURE : 0;
 }
@@ -56,4 +56,9 @@ extern int parse_script(const struct config *config,
 			struct script *script,
 			struct invocation *callback_invocation);
 
+/* Return a copy of the first len bytes of s, allocated from the arena
+ * of the script being parsed. The lexer uses this for token strings.
+ */
+extern char *parse_strndup(const char *s, int len);
+
 #endif /* __PARSER_H__ */
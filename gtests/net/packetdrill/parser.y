@@ -99,11 +99,14 @@
 #include "mpls_packet.h"
 #include "tcp_packet.h"
 #include "udp_packet.h"
+#include "event_stream.h"
 #include "parse.h"
 #include "script.h"
 #include "tcp.h"
 #include "tcp_options.h"
 #include "tcp_options_iterator.h"
+#include "template.h"
+#include "verify_plan.h"
 #include "queue/queue.h"
 
 /* This include of the bison-generated .h file must go last so that we
@@ -149,6 +152,36 @@ static const struct config *in_config = NULL;
  */
 static struct script *out_script = NULL;
 
+/* If we are streaming events to the run loop, the stream to put
+ * them in; otherwise NULL.
+ */
+static struct event_stream *out_stream = NULL;
+
+/* The arena for parse-time objects. This is the script's arena, or
+ * when streaming events, the arena of the current batch of events.
+ */
+static struct arena *parse_arena = NULL;
+
+/* Return zeroed memory for a parse-time object. Such objects live in
+ * an arena and are never freed one by one; script_free() frees them
+ * all at once, or the event stream frees them a batch at a time.
+ */
+static void *parse_alloc(size_t bytes)
+{
+	return arena_alloc(parse_arena, bytes);
+}
+
+/* Return a copy of the string in the arena for parse-time objects. */
+static char *parse_strdup(const char *s)
+{
+	return arena_strdup(parse_arena, s);
+}
+
+char *parse_strndup(const char *s, int len)
+{
+	return arena_strndup(parse_arena, s, len);
+}
+
 /* The test invocation to pass back to parse_and_finalize_config(). */
 struct invocation *invocation;
 
@@ -217,14 +250,27 @@ void read_script(const char *script_path, struct script *script)
 }
 
 
-/* The public entry point for the script parser. Parses the
- * text script file with the given path name and fills in the script
- * object with the parsed representation.
+/* What the parser thread needs to parse a script. */
+struct parse_job {
+	const struct config *config;
+	struct script *script;
+	struct invocation *invocation;
+};
+
+/* Parse the script of the given malloc-allocated job, and free the
+ * job. With --stream this runs in the parser thread of the given event
+ * stream; otherwise the stream is NULL and it runs in our caller's
+ * thread.
  */
-int parse_script(const struct config *config,
-			 struct script *script,
-			 struct invocation *callback_invocation)
+static int run_parser(struct event_stream *stream, void *arg)
 {
+	struct parse_job *job = arg;
+	const struct config *config = job->config;
+	struct script *script = job->script;
+	struct invocation *callback_invocation = job->invocation;
+
+	free(job);
+
 	/* This bison-generated parser is not multi-thread safe, so we
 	 * have a lock to prevent more than one thread using the
 	 * parser at the same time. This is useful in the wire server
@@ -238,14 +284,24 @@ int parse_script(const struct config *config,
 	yydebug = 1;
 #endif
 
-	/* Now parse the script from our buffer. */
-	yyin = fmemopen(script->buffer, script->length, "r");
+	/* Instantiate any connection templates, then parse the
+	 * script from the expanded text.
+	 */
+	char *text = NULL, *error = NULL;
+	int length = 0;
+	if (expand_templates(script->buffer, script->length,
+			     &text, &length, &error))
+		die("%s:%s\n", config->script_path, error);
+
+	yyin = fmemopen(text, length, "r");
 	if (yyin == NULL)
 		die_perror("fmemopen: parse error opening script buffer");
 
 	current_script_path = config->script_path;
 	in_config = config;
 	out_script = script;
+	out_stream = stream;
+	parse_arena = script->arena;
 	invocation = callback_invocation;
 
 	/* We have to reset the line number here since the wire server
@@ -255,9 +311,12 @@ int parse_script(const struct config *config,
 
 	int result = yyparse();		/* invoke bison-generated parser */
 	current_script_path = NULL;
+	out_stream = NULL;
+	parse_arena = NULL;
 
 	if (fclose(yyin))
 		die_perror("fclose: error closing script buffer");
+	free(text);
 
 	/* Unlock parser. */
 	if (pthread_mutex_unlock(&parser_mutex) != 0)
@@ -265,6 +324,107 @@ int parse_script(const struct config *config,
 	return result ? STATUS_ERR : STATUS_OK;
 }
 
+/* Return true if the given character may be in an option name. */
+static bool is_option_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Return true if the options at the start of the given script text
+ * include --stream. We need to know before we parse the script, since
+ * only a streamed script is parsed in a thread of its own. Like the
+ * lexer, we skip whitespace and comments between options.
+ */
+static bool script_has_stream_option(const char *text, int length)
+{
+	const char *p = text, *end = text + length;
+
+	while (p < end) {
+		const char *name = NULL;
+
+		if (isspace((unsigned char)*p)) {
+			++p;
+		} else if (end - p >= 2 && p[0] == '/' && p[1] == '/') {
+			while (p < end && *p != '\n')
+				++p;
+		} else if (end - p >= 2 && p[0] == '/' && p[1] == '*') {
+			p += 2;
+			while (p < end && !(end - p >= 2 && p[0] == '*' &&
+					    p[1] == '/'))
+				++p;
+			p = (p < end) ? p + 2 : end;
+		} else if (end - p >= 2 && p[0] == '-' && p[1] == '-') {
+			name = p + 2;
+			for (p = name; p < end && is_option_char(*p); ++p)
+				;
+			if (p - name == strlen("stream") &&
+			    strncmp(name, "stream", p - name) == 0)
+				return true;
+			/* Skip the option's value, if any. */
+			if (p < end && *p == '=') {
+				++p;
+				while (p < end && isspace((unsigned char)*p))
+					++p;
+				if (p < end && *p == '"') {
+					++p;
+					while (p < end && *p != '"')
+						++p;
+				}
+				while (p < end && !isspace((unsigned char)*p))
+					++p;
+			}
+		} else {
+			return false;	/* the first event or command */
+		}
+	}
+	return false;
+}
+
+/* The public entry point for the script parser. Parses the
+ * text script file with the given path name and fills in the script
+ * object with the parsed representation. With --stream, returns as
+ * soon as the parser starts streaming events, which the run loop
+ * then takes from script->stream.
+ */
+int parse_script(const struct config *config,
+			 struct script *script,
+			 struct invocation *callback_invocation)
+{
+	struct parse_job *job = calloc(1, sizeof(struct parse_job));
+	struct event_stream *stream = NULL;
+	bool is_streaming = false;
+	int result = STATUS_ERR;
+
+	job->config = config;
+	job->script = script;
+	job->invocation = callback_invocation;
+
+	/* Without --stream, parse the whole script right here. */
+	if (!config->stream &&
+	    !script_has_stream_option(script->buffer, script->length))
+		return run_parser(NULL, job);
+
+	stream = event_stream_new(run_parser, job);
+	result = event_stream_wait(stream, &is_streaming);
+	if (is_streaming)
+		script->stream = stream;
+	else
+		event_stream_free(stream);
+	return result;
+}
+
+/* Called just before we parse the first event. If the configuration
+ * asks for it, start streaming events to the run loop. Everything
+ * parsed so far, like the options, stays in the script's arena.
+ */
+static void start_events(void)
+{
+	if (out_stream != NULL && in_config->stream && !in_config->dry_run)
+		parse_arena = event_stream_begin(out_stream);
+	else
+		out_stream = NULL;
+}
+
 /* Bison emits code to call this method when there's a parse-time error.
  * We print the line number and the error message.
  */
@@ -285,6 +445,39 @@ static void semantic_error(const char* message)
 	    current_script_path, current_script_line, message);
 }
 
+/* The MPTCP code passes the variables and values of MPTCP options
+ * from the parser to the run loop in global queues, which are not
+ * locked and hold far fewer entries than a stream may be ahead of the
+ * run loop. So scripts we stream may not use MPTCP variables.
+ */
+static void check_mptcp_vars_not_streamed(void)
+{
+	if (out_stream != NULL)
+		semantic_error("MPTCP variables are not supported "
+			       "with --stream");
+}
+
+/* Queue the given MPTCP variable for the run loop. */
+static int enqueue_mptcp_var(void *var)
+{
+	check_mptcp_vars_not_streamed();
+	return queue_enqueue(&mp_state.vars_queue, var);
+}
+
+/* Queue a copy of the given MPTCP variable name for the run loop. */
+static int enqueue_mptcp_var_name(char *name)
+{
+	check_mptcp_vars_not_streamed();
+	return enqueue_var(name);
+}
+
+/* Queue the given value of an MPTCP option for the run loop. */
+static int enqueue_mptcp_val(u64 val)
+{
+	check_mptcp_vars_not_streamed();
+	return queue_enqueue_val(&mp_state.vals_queue, val);
+}
+
 /* This standard callback is invoked by flex when it encounters
  * the end of a file. We return 1 to tell flex to return EOF.
  */
@@ -296,7 +489,7 @@ int yywrap(void)
 /* Create and initalize a new expression. */
 static struct expression *new_expression(enum expression_t type)
 {
-	struct expression *expression = calloc(1, sizeof(struct expression));
+	struct expression *expression = parse_alloc(sizeof(struct expression));
 	expression->type = type;
 	return expression;
 }
@@ -317,7 +510,7 @@ static struct expression_list *new_expression_list(
 	struct expression *expression)
 {
 	struct expression_list *list;
-	list = calloc(1, sizeof(struct expression_list));
+	list = parse_alloc(sizeof(struct expression_list));
 	list->expression = expression;
 	list->next = NULL;
 	return list;
@@ -336,7 +529,7 @@ static void expression_list_append(struct expression_list *list,
 /* Create and initialize a new option. */
 static struct option_list *new_option(char *name, char *value)
 {
-	struct option_list *opt = calloc(1, sizeof(struct option_list));
+	struct option_list *opt = parse_alloc(sizeof(struct option_list));
 	opt->name = name;
 	opt->value = value;
 	return opt;
@@ -345,7 +538,7 @@ static struct option_list *new_option(char *name, char *value)
 /* Create and initialize a new event. */
 static struct event *new_event(enum event_t type)
 {
-	struct event *e = calloc(1, sizeof(struct event));
+	struct event *e = parse_alloc(sizeof(struct event));
 	e->type = type;
 	e->time_usecs_end = NO_TIME_RANGE;
 	e->offset_usecs = NO_TIME_RANGE;
@@ -485,7 +678,7 @@ struct tcp_option *mp_join_do_syn(bool is_backup,
 	if(mp_join_script_info->syn_or_syn_ack.rand_script_defined)
 		mp_join_script_info->syn_or_syn_ack.rand = rand;
 
-	if(queue_enqueue(&mp_state.vars_queue, mp_join_script_info)==STATUS_ERR)
+	if(enqueue_mptcp_var(mp_join_script_info)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
 	return opt;
 }
@@ -546,7 +739,7 @@ struct tcp_option *mp_join_do_syn_ack(bool is_backup,
 	if(mp_join_script_info->syn_or_syn_ack.rand_script_defined)
 		mp_join_script_info->syn_or_syn_ack.rand = rand;
 
-	if(queue_enqueue(&mp_state.vars_queue, mp_join_script_info)==STATUS_ERR)
+	if(enqueue_mptcp_var(mp_join_script_info)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
 	return opt;
 }
@@ -575,7 +768,7 @@ struct tcp_option *mp_join_do_ack(char *str, char *str2, bool automatic){
 	}else
 		mp_join_script_info->ack.is_var = true;
 
-	if(queue_enqueue(&mp_state.vars_queue, mp_join_script_info)==STATUS_ERR)
+	if(enqueue_mptcp_var(mp_join_script_info)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
 
 	return opt;
@@ -701,7 +894,12 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %}
 
 %locations
-%expect 1  /* we expect a shift/reduce conflict for the | binary expression */
+/* A | binary expression groups to the right, and the value of a
+ * name=value field takes the whole | expression after the '=', so
+ * that state=A|B means state=(A|B).
+ */
+%nonassoc FIELD_VALUE
+%right '|'
 /* The %union section specifies the set of possible types for values
  * for all nonterminal and terminal symbols in the grammar.
  */
@@ -722,6 +920,8 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 		int protocol;		/* IPPROTO_TCP or IPPROTO_UDP */
 		u32 start_sequence;
 		u16 payload_bytes;
+		u32 train_bytes;	/* for a packet train, or 0 */
+		u16 train_mss;
 	} tcp_sequence_info;
 	struct {
 		int type; //4 or 8 octects mptcp DSN or -1 (none)
@@ -759,6 +959,7 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 	struct syscall_spec *syscall;
 	struct command_spec *command;
 	struct code_spec *code;
+	struct pacing_spec *pacing;
 	struct tcp_option *tcp_option;
 	struct tcp_options *tcp_options;
 	struct expression *expression;
@@ -772,7 +973,12 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
  */
 %token ELLIPSIS
 %token <reserved> SA_FAMILY SIN_PORT SIN_ADDR _HTONS_ INET_ADDR
-%token <reserved> MSG_NAME MSG_IOV MSG_FLAGS
+%token <reserved> MSG_NAME MSG_IOV MSG_FLAGS MSG_CONTROL MSG_HDR MSG_LEN
+%token <reserved> CMSG_LEVEL CMSG_TYPE CMSG_DATA
+%token <reserved> EE_ERRNO EE_ORIGIN EE_TYPE EE_CODE EE_INFO EE_DATA
+%token <reserved> OPCODE LEN USER_DATA RES
+%token <reserved> ADDRESS LENGTH RECV_SKIP_HINT
+%token <reserved> PACING GAP RATE TOLERANCE OFF
 %token <reserved> FD EVENTS REVENTS ONOFF LINGER
 %token <reserved> ACK ECR EOL MSS NOP SACK SACKOK TIMESTAMP VAL WIN WSCALE PRO SOCK
 %token <reserved> MP_CAPABLE MP_CAPABLE_NO_CS MP_FASTCLOSE FLAG_A FLAG_B FLAG_C FLAG_D FLAG_E FLAG_F FLAG_G FLAG_H NO_FLAGS
@@ -801,6 +1007,7 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %type <syscall> syscall_spec
 %type <command> command_spec
 %type <code> code_spec
+%type <pacing> pacing_spec
 %type <mpls_stack> mpls_stack
 %type <mpls_stack_entry> mpls_stack_entry
 %type <integer> opt_mpls_stack_bottom
@@ -825,7 +1032,9 @@ struct tcp_option *dss_do_dsn_dack( int dack_type, int dack_val,
 %type <expression_list> expression_list function_arguments
 %type <expression> expression binary_expression array
 %type <expression> decimal_integer hex_integer
-%type <expression> inaddr sockaddr msghdr iovec pollfd opt_revents linger
+%type <expression> inaddr sockaddr msghdr iovec pollfd opt_revents epollev
+%type <expression> linger mmsghdr opt_msg_control cmsghdr sock_extended_err
+%type <expression> io_uring_sqe io_uring_cqe tcp_zerocopy_receive field
 %type <errno_info> opt_errno
 
 %%  /* The grammar follows. */
@@ -862,24 +1071,27 @@ option
 : option_flag '=' option_value {
 	$$ = new_option($1, $3);
 }
+| option_flag {			/* for options without a value */
+	$$ = new_option($1, NULL);
+}
 
 option_flag
 : OPTION	{ $$ = $1; }
 ;
 
 option_value
-: INTEGER	{ $$ = strdup(yytext); }
+: INTEGER	{ $$ = parse_strdup(yytext); }
 | WORD		{ $$ = $1; }
 | STRING	{ $$ = $1; }
 | IPV4_ADDR	{ $$ = $1; }
 | IPV6_ADDR	{ $$ = $1; }
-| IPV4		{ $$ = strdup("ipv4"); }
-| IPV6		{ $$ = strdup("ipv6"); }
+| IPV4		{ $$ = parse_strdup("ipv4"); }
+| IPV6		{ $$ = parse_strdup("ipv6"); }
 ;
 
 opt_init_command
-:               { }
-| init_command  { }
+:               { start_events(); }
+| init_command  { start_events(); }
 ;
 
 init_command
@@ -888,12 +1100,19 @@ init_command
 
 events
 : event        {
-	out_script->event_list = $1;  /* save pointer to event list as output
-				       * of parser */
+	if (out_stream != NULL)
+		parse_arena = event_stream_put(out_stream, $1);
+	else
+		out_script->event_list = $1;  /* save pointer to event list
+					       * as output of parser */
 	$$ = $1;          /* return the tail so that we can append to it */
 }
 | events event {
-	$1->next = $2;    /* link new event to the end of the existing list */
+	/* When streaming, the run loop may have freed $1 by now. */
+	if (out_stream != NULL)
+		parse_arena = event_stream_put(out_stream, $2);
+	else
+		$1->next = $2;    /* link new event to the end of the list */
 	$$ = $2;          /* return the tail so that we can append to it */
 }
 ;
@@ -923,7 +1142,6 @@ event
 		semantic_error("event time range can only be used with "
 			       "outbound packets");
 	}
-	free($1);
 }
 ;
 
@@ -981,6 +1199,7 @@ action
 | syscall_spec { $$ = new_event(SYSCALL_EVENT); $$->event.syscall = $1; }
 | command_spec { $$ = new_event(COMMAND_EVENT); $$->event.command = $1; }
 | code_spec    { $$ = new_event(CODE_EVENT);    $$->event.code    = $1; }
+| pacing_spec  { $$ = new_event(PACING_EVENT);  $$->event.pacing  = $1; }
 ;
 
 packet_spec
@@ -1006,19 +1225,32 @@ tcp_packet_spec
 			       "outbound packets");
 	}
 
+	if ($4.train_bytes > 0) {
+		if (packet_header_count(outer) > 0) {
+			semantic_error("packet trains cannot be encapsulated");
+		}
+		if (strspn($3, ".PEW") != strlen($3)) {
+			semantic_error("packet trains can only carry "
+				       "data segments");
+		}
+	}
+
 	inner = new_tcp_packet($8, in_config->wire_protocol,
 			       direction, $2, $3,
 			       $4.start_sequence, $4.payload_bytes,
 			       $5, $6, $7, &error);
-	free($3);
 	free($7);
 	if (inner == NULL) {
 		assert(error != NULL);
 		semantic_error(error);
 		free(error);
 	}
+	inner->train_bytes = $4.train_bytes;
+	inner->train_mss = $4.train_mss;
 
 	$$ = packet_encapsulate_and_free(outer, inner);
+	if (direction == DIRECTION_OUTBOUND)
+		$$->verify_plan = verify_plan_new($$);
 }
 ;
 
@@ -1040,6 +1272,8 @@ udp_packet_spec
 	}
 
 	$$ = packet_encapsulate_and_free(outer, inner);
+	if (direction == DIRECTION_OUTBOUND)
+		$$->verify_plan = verify_plan_new($$);
 }
 ;
 
@@ -1052,8 +1286,6 @@ icmp_packet_spec
 	inner = new_icmp_packet($7, in_config->wire_protocol, direction, $4, $5,
 				$2.protocol, $2.start_sequence,
 				$2.payload_bytes, $6, &error);
-	free($4);
-	free($5);
 	if (inner == NULL) {
 		semantic_error(error);
 		free(error);
@@ -1076,8 +1308,6 @@ packet_prefix
 	char *ip_dst = $5;
 	if (ipv4_header_append(packet, ip_src, ip_dst, &error))
 		semantic_error(error);
-	free(ip_src);
-	free(ip_dst);
 	$$ = packet;
 }
 | packet_prefix IPV6 IPV6_ADDR '>' IPV6_ADDR ':' {
@@ -1087,8 +1317,6 @@ packet_prefix
 	char *ip_dst = $5;
 	if (ipv6_header_append(packet, ip_src, ip_dst, &error))
 		semantic_error(error);
-	free(ip_src);
-	free(ip_dst);
 	$$ = packet;
 }
 | packet_prefix GRE ':' {
@@ -1143,7 +1371,6 @@ opt_mpls_stack_bottom
 | '[' WORD ']' ','	{
 	if (strcmp($2, "S") != 0)
 		semantic_error("expected [S] for MPLS label stack bottom");
-	free($2);
 	$$ = 1;
 }
 ;
@@ -1199,9 +1426,9 @@ ip_ecn
 
 flags
 : WORD         { $$ = $1; }
-| '.'          { $$ = strdup("."); }
-| WORD '.'     { asprintf(&($$), "%s.", $1); free($1); }
-| '-'          { $$ = strdup(""); }  /* no TCP flags set in segment */
+| '.'          { $$ = parse_strdup("."); }
+| WORD '.'     { $$ = arena_sprintf(out_script->arena, "%s.", $1); }
+| '-'          { $$ = parse_strdup(""); }  /* no TCP flags set in segment */
 ;
 
 seq
@@ -1222,6 +1449,31 @@ seq
 	$$.start_sequence = $1;
 	$$.payload_bytes = $5;
 	$$.protocol = IPPROTO_TCP;
+	$$.train_bytes = 0;
+	$$.train_mss = 0;
+}
+| INTEGER ':' INTEGER '(' INTEGER ')' MSS INTEGER {
+	if (!is_valid_u32($1)) {
+		semantic_error("TCP start sequence number out of range");
+	}
+	if (!is_valid_u32($3)) {
+		semantic_error("TCP end sequence number out of range");
+	}
+	if (!is_valid_u32($5)) {
+		semantic_error("TCP packet train size out of range");
+	}
+	if ((u32)$3 != (u32)($1 + $5)) {
+		semantic_error("inconsistent TCP sequence numbers and "
+			       "packet train size");
+	}
+	if (!is_valid_u16($8) || $8 == 0) {
+		semantic_error("packet train mss out of range");
+	}
+	$$.start_sequence = $1;
+	$$.payload_bytes = $5 < $8 ? $5 : $8;
+	$$.protocol = IPPROTO_TCP;
+	$$.train_bytes = $5;
+	$$.train_mss = $8;
 }
 ;
 
@@ -1267,13 +1519,13 @@ tcp_option_list
 ;
 
 opt_tcp_fast_open_cookie
-:			{ $$ = strdup(""); }
+:			{ $$ = parse_strdup(""); }
 | tcp_fast_open_cookie	{ $$ = $1; }
 ;
 
 tcp_fast_open_cookie
-: WORD    { $$ = strdup(yytext); }
-| INTEGER { $$ = strdup(yytext); }
+: WORD    { $$ = parse_strdup(yytext); }
+| INTEGER { $$ = parse_strdup(yytext); }
 ;
 
 add_to_var
@@ -1294,9 +1546,9 @@ dsn
 | DSN4 '=' TRUNC_R64_HMAC '('  WORD ')' add_to_var {
 	$$.type = 4;
 	$$.val = SCRIPT_DEFINED_TO_HASH_LSB; // to be added using the variable name
-	if(queue_enqueue(&mp_state.vars_queue, $5)==STATUS_ERR)
+	if(enqueue_mptcp_var($5)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
-	if(queue_enqueue_val(&mp_state.vals_queue, $7.additional_val ))
+	if(enqueue_mptcp_val($7.additional_val ))
 		semantic_error("Too many values are enqueued in script");
 }
 | DSN8 '=' INTEGER 	{	$$.type = 8;	$$.val = $3;}
@@ -1310,9 +1562,9 @@ dsn
 | DSN8 '=' TRUNC_R64_HMAC '('  WORD ')' add_to_var	{
 	$$.type = 8;
 	$$.val = SCRIPT_DEFINED_TO_HASH_LSB; // to be added using the variable name
-	if(queue_enqueue(&mp_state.vars_queue, $5)==STATUS_ERR)
+	if(enqueue_mptcp_var($5)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
-	if(queue_enqueue_val(&mp_state.vals_queue, $7.additional_val ))
+	if(enqueue_mptcp_val($7.additional_val ))
 		semantic_error("Too many values are enqueued in script");
 }
 ;
@@ -1348,9 +1600,9 @@ dack
 | DACK4 '=' TRUNC_R64_HMAC '('  WORD ')' add_to_var	{
 	$$.type = 4;
 	$$.dack = SCRIPT_DEFINED_TO_HASH_LSB; // to be added using the variable name
-	if(queue_enqueue(&mp_state.vars_queue, $5)==STATUS_ERR)
+	if(enqueue_mptcp_var($5)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
-	if(queue_enqueue_val(&mp_state.vals_queue, $7.additional_val ))
+	if(enqueue_mptcp_val($7.additional_val ))
 		semantic_error("Too many values are enqueued in script");
 }
 | DACK8 '=' INTEGER {	$$.type = 8;	$$.dack = $3;}
@@ -1365,9 +1617,9 @@ dack
 
 	$$.type = 8;
 	$$.dack = SCRIPT_DEFINED_TO_HASH_LSB; // to be added using the variable name
-	if(queue_enqueue(&mp_state.vars_queue, $5)==STATUS_ERR)
+	if(enqueue_mptcp_var($5)==STATUS_ERR)
 		semantic_error("Too many variables are used in script");
-	if(queue_enqueue_val(&mp_state.vals_queue, $7.additional_val ))
+	if(enqueue_mptcp_val($7.additional_val ))
 		semantic_error("Too many values are enqueued in script");
 }
 ;
@@ -1601,7 +1853,6 @@ tcp_option
 | FAST_OPEN opt_tcp_fast_open_cookie  {
 	char *error = NULL;
 	$$ = new_tcp_fast_open_option($2, &error);
-	free($2);
 	if ($$ == NULL) {
 		assert(error != NULL);
 		semantic_error(error);
@@ -1613,7 +1864,7 @@ tcp_option
 
 	unsigned mp_capable_length = TCPOLEN_MP_CAPABLE_SYN;
 
-	if(enqueue_var($2.name))
+	if(enqueue_mptcp_var_name($2.name))
 		semantic_error("MPTCP variables queue is full, increase queue size.");
 
 	if($2.script_assigned){
@@ -1626,7 +1877,7 @@ tcp_option
 	if($3.exist){
 		mp_capable_length = TCPOLEN_MP_CAPABLE;
 
-		if(enqueue_var($3.name))
+		if(enqueue_mptcp_var_name($3.name))
 			semantic_error("MPTCP variables queue is full, increase queue size.");
 
 		if($3.script_assigned){
@@ -1788,7 +2039,7 @@ tcp_option
 	$$ = tcp_option_new(TCPOPT_MPTCP, TCPOLEN_MP_FASTCLOSE);
 
 	if($2.exist){ //if there exists a variable
-		if(enqueue_var($2.name))
+		if(enqueue_mptcp_var_name($2.name))
 			semantic_error("MPTCP variables queue is full, increase queue size.");
 
 		if($2.script_assigned){
@@ -1798,11 +2049,11 @@ tcp_option
 			$$->data.mp_fastclose.receiver_key = SCRIPT_ASSIGNED; // <mp_fastclose b=123>
 		}else{
 			if($3.additional_val>0){
-				if(queue_enqueue_val(&mp_state.vals_queue, $3.additional_val ))
+				if(enqueue_mptcp_val($3.additional_val ))
 					semantic_error("Too many values are enqueued in script");
 				$$->data.mp_fastclose.receiver_key = KEY; // <mp_fastclose b + 123>
 			}else{
-				if(queue_enqueue(&mp_state.vars_queue, $2.name)==STATUS_ERR)
+				if(enqueue_mptcp_var_name($2.name)==STATUS_ERR)
 					semantic_error("Too many variables are used in script");
 				$$->data.mp_fastclose.receiver_key = SCRIPT_DEFINED; //<mp_fastclose b>
 			}
@@ -1852,7 +2103,7 @@ sack_block
 syscall_spec
 : opt_end_time function_name function_arguments '='
   expression opt_errno opt_note  {
-	$$ = calloc(1, sizeof(struct syscall_spec));
+	$$ = parse_alloc(sizeof(struct syscall_spec));
 	$$->end_usecs	= $1;
 	$$->name	= $2;
 	$$->arguments	= $3;
@@ -1922,9 +2173,33 @@ expression
 | pollfd            {
 	$$ = $1;
 }
+| epollev           {
+	$$ = $1;
+}
+| mmsghdr           {
+	$$ = $1;
+}
+| cmsghdr           {
+	$$ = $1;
+}
+| sock_extended_err {
+	$$ = $1;
+}
+| io_uring_sqe      {
+	$$ = $1;
+}
+| io_uring_cqe      {
+	$$ = $1;
+}
+| tcp_zerocopy_receive {
+	$$ = $1;
+}
 | linger            {
 	$$ = $1;
 }
+| field             {
+	$$ = $1;
+}
 ;
 
 decimal_integer
@@ -1943,8 +2218,8 @@ binary_expression
 : expression '|' expression {       /* bitwise OR */
 	$$ = new_expression(EXPR_BINARY);
 	struct binary_expression *binary =
-			  malloc(sizeof(struct binary_expression));
-	binary->op = strdup("|");
+			  parse_alloc(sizeof(struct binary_expression));
+	binary->op = parse_strdup("|");
 	binary->lhs = $1;
 	binary->rhs = $3;
 	$$->value.binary = binary;
@@ -1974,27 +2249,25 @@ sockaddr
 	SIN_PORT '=' _HTONS_ '(' INTEGER ')' ','
 	SIN_ADDR '=' INET_ADDR '(' STRING ')' '}' {
 	if (strcmp($4, "AF_INET") == 0) {
-		struct sockaddr_in *ipv4 = malloc(sizeof(struct sockaddr_in));
-		memset(ipv4, 0, sizeof(*ipv4));
+		struct sockaddr_in *ipv4 =
+			parse_alloc(sizeof(struct sockaddr_in));
 		ipv4->sin_family = AF_INET;
 		ipv4->sin_port = htons($10);
 		if (inet_pton(AF_INET, $17, &ipv4->sin_addr) == 1) {
 			$$ = new_expression(EXPR_SOCKET_ADDRESS_IPV4);
 			$$->value.socket_address_ipv4 = ipv4;
 		} else {
-			free(ipv4);
 			semantic_error("invalid IPv4 address");
 		}
 	} else if (strcmp($4, "AF_INET6") == 0) {
-		struct sockaddr_in6 *ipv6 = malloc(sizeof(struct sockaddr_in6));
-		memset(ipv6, 0, sizeof(*ipv6));
+		struct sockaddr_in6 *ipv6 =
+			parse_alloc(sizeof(struct sockaddr_in6));
 		ipv6->sin6_family = AF_INET6;
 		ipv6->sin6_port = htons($10);
 		if (inet_pton(AF_INET6, $17, &ipv6->sin6_addr) == 1) {
 			$$ = new_expression(EXPR_SOCKET_ADDRESS_IPV6);
 			$$->value.socket_address_ipv6 = ipv6;
 		} else {
-			free(ipv6);
 			semantic_error("invalid IPv6 ");
 		}
 	}
@@ -2004,22 +2277,66 @@ sockaddr
 msghdr
 : '{' MSG_NAME '(' ELLIPSIS ')' '=' ELLIPSIS ','
       MSG_IOV '(' decimal_integer ')' '=' array ','
-      MSG_FLAGS '=' expression '}' {
-	struct msghdr_expr *msg_expr = calloc(1, sizeof(struct msghdr_expr));
+      opt_msg_control MSG_FLAGS '=' expression '}' {
+	struct msghdr_expr *msg_expr = parse_alloc(sizeof(struct msghdr_expr));
 	$$ = new_expression(EXPR_MSGHDR);
 	$$->value.msghdr = msg_expr;
 	msg_expr->msg_name	= new_expression(EXPR_ELLIPSIS);
 	msg_expr->msg_namelen	= new_expression(EXPR_ELLIPSIS);
 	msg_expr->msg_iov	= $14;
 	msg_expr->msg_iovlen	= $11;
-	msg_expr->msg_flags	= $18;
-	/* TODO(ncardwell): msg_control, msg_controllen */
+	msg_expr->msg_control	= $16;
+	msg_expr->msg_flags	= $19;
+}
+;
+
+opt_msg_control
+:                                  { $$ = NULL; }
+| MSG_CONTROL '=' array ','        { $$ = $3; }
+;
+
+cmsghdr
+: '{' CMSG_LEVEL '=' expression ',' CMSG_TYPE '=' expression ','
+      CMSG_DATA '=' expression '}' {
+	struct cmsghdr_expr *cmsg_expr = parse_alloc(sizeof(struct cmsghdr_expr));
+	$$ = new_expression(EXPR_CMSGHDR);
+	$$->value.cmsghdr = cmsg_expr;
+	cmsg_expr->cmsg_level	= $4;
+	cmsg_expr->cmsg_type	= $8;
+	cmsg_expr->cmsg_data	= $12;
+}
+;
+
+sock_extended_err
+: '{' EE_ERRNO '=' expression ',' EE_ORIGIN '=' expression ','
+      EE_TYPE '=' expression ',' EE_CODE '=' expression ','
+      EE_INFO '=' expression ',' EE_DATA '=' expression '}' {
+	struct sock_extended_err_expr *ee_expr =
+		parse_alloc(sizeof(struct sock_extended_err_expr));
+	$$ = new_expression(EXPR_SOCK_EXTENDED_ERR);
+	$$->value.sock_extended_err = ee_expr;
+	ee_expr->ee_errno	= $4;
+	ee_expr->ee_origin	= $8;
+	ee_expr->ee_type	= $12;
+	ee_expr->ee_code	= $16;
+	ee_expr->ee_info	= $20;
+	ee_expr->ee_data	= $24;
+}
+;
+
+mmsghdr
+: '{' MSG_HDR '=' msghdr ',' MSG_LEN '=' expression '}' {
+	struct mmsghdr_expr *mmsg_expr = parse_alloc(sizeof(struct mmsghdr_expr));
+	$$ = new_expression(EXPR_MMSGHDR);
+	$$->value.mmsghdr = mmsg_expr;
+	mmsg_expr->msg_hdr	= $4;
+	mmsg_expr->msg_len	= $8;
 }
 ;
 
 iovec
 : '{' ELLIPSIS ',' decimal_integer '}' {
-	struct iovec_expr *iov_expr = calloc(1, sizeof(struct iovec_expr));
+	struct iovec_expr *iov_expr = parse_alloc(sizeof(struct iovec_expr));
 	$$ = new_expression(EXPR_IOVEC);
 	$$->value.iovec = iov_expr;
 	iov_expr->iov_base = new_expression(EXPR_ELLIPSIS);
@@ -2029,7 +2346,7 @@ iovec
 
 pollfd
 : '{' FD '=' expression ',' EVENTS '=' expression opt_revents '}' {
-	struct pollfd_expr *pollfd_expr = calloc(1, sizeof(struct pollfd_expr));
+	struct pollfd_expr *pollfd_expr = parse_alloc(sizeof(struct pollfd_expr));
 	$$ = new_expression(EXPR_POLLFD);
 	$$->value.pollfd = pollfd_expr;
 	pollfd_expr->fd = $4;
@@ -2043,6 +2360,56 @@ opt_revents
 | ',' REVENTS '=' expression     { $$ = $4; }
 ;
 
+epollev
+: '{' EVENTS '=' expression ',' FD '=' expression '}' {
+	struct epollev_expr *epollev_expr =
+		parse_alloc(sizeof(struct epollev_expr));
+	$$ = new_expression(EXPR_EPOLLEV);
+	$$->value.epollev = epollev_expr;
+	epollev_expr->events = $4;
+	epollev_expr->fd = $8;
+}
+;
+
+io_uring_sqe
+: '{' OPCODE '=' expression ',' FD '=' expression ',' LEN '=' expression ','
+      MSG_FLAGS '=' expression ',' USER_DATA '=' expression '}' {
+	struct io_uring_sqe_expr *sqe_expr =
+		parse_alloc(sizeof(struct io_uring_sqe_expr));
+	$$ = new_expression(EXPR_IO_URING_SQE);
+	$$->value.io_uring_sqe = sqe_expr;
+	sqe_expr->opcode	= $4;
+	sqe_expr->fd		= $8;
+	sqe_expr->len		= $12;
+	sqe_expr->msg_flags	= $16;
+	sqe_expr->user_data	= $20;
+}
+;
+
+io_uring_cqe
+: '{' USER_DATA '=' expression ',' RES '=' expression '}' {
+	struct io_uring_cqe_expr *cqe_expr =
+		parse_alloc(sizeof(struct io_uring_cqe_expr));
+	$$ = new_expression(EXPR_IO_URING_CQE);
+	$$->value.io_uring_cqe = cqe_expr;
+	cqe_expr->user_data	= $4;
+	cqe_expr->res		= $8;
+}
+;
+
+tcp_zerocopy_receive
+: '{' ADDRESS '=' ELLIPSIS ',' LENGTH '=' expression ','
+      RECV_SKIP_HINT '=' expression '}' {
+	struct tcp_zerocopy_receive_expr *zc_expr =
+		parse_alloc(sizeof(struct tcp_zerocopy_receive_expr));
+	$$ = new_expression(EXPR_TCP_ZEROCOPY_RECEIVE);
+	$$->value.tcp_zerocopy_receive = zc_expr;
+	zc_expr->address	= new_expression(EXPR_ELLIPSIS);
+	zc_expr->length		= $8;
+	zc_expr->recv_skip_hint	= $12;
+}
+;
+
 linger
 : '{' ONOFF '=' INTEGER ',' LINGER '=' INTEGER '}' {
 	$$ = new_expression(EXPR_LINGER);
@@ -2051,10 +2418,20 @@ linger
 }
 ;
 
+field
+: WORD '=' expression %prec FIELD_VALUE {
+	struct field_expr *field_expr = parse_alloc(sizeof(struct field_expr));
+	$$ = new_expression(EXPR_FIELD);
+	$$->value.field = field_expr;
+	field_expr->name	= $1;
+	field_expr->value	= $3;
+}
+;
+
 opt_errno
 :                   { $$ = NULL; }
 | WORD note         {
-	$$ = malloc(sizeof(struct errno_spec));
+	$$ = parse_alloc(sizeof(struct errno_spec));
 	$$->errno_macro = $1;
 	$$->strerror    = $2;
 }
@@ -2071,20 +2448,42 @@ note
 
 word_list
 : WORD              { $$ = $1; }
-| word_list WORD    { asprintf(&($$), "%s %s", $1, $2); free($1); free($2); }
+| word_list WORD    {
+	$$ = arena_sprintf(out_script->arena, "%s %s", $1, $2);
+}
 ;
 
 command_spec
 : BACK_QUOTED       {
-	$$ = malloc(sizeof(struct command_spec));
+	$$ = parse_alloc(sizeof(struct command_spec));
 	$$->command_line = $1;
 	current_script_line = yylineno;
 }
 ;
 
+pacing_spec
+: PACING GAP time TOLERANCE time {
+	$$ = parse_alloc(sizeof(struct pacing_spec));
+	$$->gap_usecs = $3;
+	$$->tolerance_usecs = $5;
+}
+| PACING RATE INTEGER TOLERANCE time {
+	if ($3 <= 0) {
+		semantic_error("pacing rate must be positive");
+	}
+	$$ = parse_alloc(sizeof(struct pacing_spec));
+	$$->gap_usecs = NO_PACING_GAP;
+	$$->rate = $3;
+	$$->tolerance_usecs = $5;
+}
+| PACING OFF        {
+	$$ = NULL;
+}
+;
+
 code_spec
 : CODE              {
-	$$ = calloc(1, sizeof(struct code_spec));
+	$$ = parse_alloc(sizeof(struct code_spec));
 	$$->text = $1;
 	current_script_line = yylineno;
  }
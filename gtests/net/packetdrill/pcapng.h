@@ -0,0 +1,82 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Definitions for the pcapng files we write with --pcap_out and read
+ * back with --replay (see draft-ietf-opsawg-pcapng).
+ *
+ * Besides packets, a trace holds what else a replay needs to reproduce
+ * the run without a kernel: the live start time of the script, the
+ * result of each system call, and the random numbers the harness drew.
+ * These are pcapng custom blocks under Google's Private Enterprise
+ * Number, each starting with a u32 record type. All values are in host
+ * byte order, like the rest of the file.
+ */
+
+#ifndef __PCAPNG_H__
+#define __PCAPNG_H__
+
+#include "types.h"
+
+/* pcapng block types. */
+#define PCAPNG_SECTION_HEADER		0x0A0D0D0A
+#define PCAPNG_INTERFACE_DESCRIPTION	0x00000001
+#define PCAPNG_ENHANCED_PACKET		0x00000006
+#define PCAPNG_CUSTOM			0x00000BAD
+
+/* pcapng option codes. */
+#define PCAPNG_OPT_END			0
+#define PCAPNG_OPT_COMMENT		1
+#define PCAPNG_EPB_FLAGS		2
+#define PCAPNG_SHB_USERAPPL		4
+#define PCAPNG_IF_TSRESOL		9
+
+/* epb_flags direction values. */
+#define PCAPNG_EPB_INBOUND		1
+#define PCAPNG_EPB_OUTBOUND		2
+#define PCAPNG_EPB_DIRECTION_MASK	3
+
+#define PCAPNG_BYTE_ORDER_MAGIC		0x1A2B3C4D
+
+/* Link type of packets that start with their IP header. */
+#define LINKTYPE_RAW			101
+
+/* Private Enterprise Number for our custom blocks. */
+#define PCAPNG_PEN			11129
+
+/* Types of our custom blocks. */
+enum pcapng_record_t {
+	PCAPNG_RECORD_START = 1,	/* s64 live start time of script */
+	PCAPNG_RECORD_SYSCALL,		/* struct pcapng_syscall */
+	PCAPNG_RECORD_RANDOM,		/* u64 random number we drew */
+};
+
+/* Longest system call name we record. */
+#define PCAPNG_SYSCALL_NAME_BYTES	32
+
+/* The outcome of a system call. */
+struct pcapng_syscall {
+	s64 end_usecs;			/* live time it returned */
+	s32 line;			/* script line of the call */
+	s32 result;			/* what it returned */
+	s32 err;			/* errno after it returned */
+	s32 check;			/* how the result was checked */
+	char name[PCAPNG_SYSCALL_NAME_BYTES];	/* NUL-terminated */
+};
+
+#endif /* __PCAPNG_H__ */
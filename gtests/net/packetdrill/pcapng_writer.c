@@ -0,0 +1,408 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for streaming packets to a pcapng file.
+ */
+
+#include "pcapng_writer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logging.h"
+#include "pcapng.h"
+
+/* Longest opt_comment we write. */
+#define PCAPNG_COMMENT_BYTES		32
+
+struct pcapng_writer {
+	FILE *file;			/* the file, owned by the thread */
+	char *path;			/* path of the file */
+	pthread_t thread;		/* the writer thread */
+
+	pthread_mutex_t mutex;		/* protects all of the fields below */
+	pthread_cond_t changed;		/* signaled after each change */
+
+	u8 *fill;			/* buffer we append packets to */
+	int fill_bytes;			/* bytes used in 'fill' */
+	u8 *full;			/* buffer for the writer thread */
+	int full_bytes;			/* bytes to write from 'full' */
+	bool is_writing;		/* is thread writing 'full'? */
+	bool is_closed;			/* should the thread exit? */
+};
+
+/* The open writer, whose buffers we write out if we exit early. */
+static struct pcapng_writer *open_writer;
+
+static void writer_lock(struct pcapng_writer *writer)
+{
+	if (pthread_mutex_lock(&writer->mutex) != 0)
+		die_perror("pthread_mutex_lock");
+}
+
+static void writer_unlock(struct pcapng_writer *writer)
+{
+	if (pthread_mutex_unlock(&writer->mutex) != 0)
+		die_perror("pthread_mutex_unlock");
+}
+
+static void writer_wait(struct pcapng_writer *writer)
+{
+	if (pthread_cond_wait(&writer->changed, &writer->mutex) != 0)
+		die_perror("pthread_cond_wait");
+}
+
+static void writer_signal(struct pcapng_writer *writer)
+{
+	if (pthread_cond_broadcast(&writer->changed) != 0)
+		die_perror("pthread_cond_broadcast");
+}
+
+/* Write the bytes to the file. Returns STATUS_OK or STATUS_ERR. */
+static int write_bytes(struct pcapng_writer *writer,
+		       const u8 *bytes, int num_bytes)
+{
+	if (num_bytes > 0 &&
+	    fwrite(bytes, 1, num_bytes, writer->file) != num_bytes)
+		return STATUS_ERR;
+	return STATUS_OK;
+}
+
+/* Write out the buffers the thread has not written yet, oldest first.
+ * Called with the lock held.
+ */
+static int write_pending(struct pcapng_writer *writer)
+{
+	while (writer->is_writing)
+		writer_wait(writer);
+	if (write_bytes(writer, writer->full, writer->full_bytes) ||
+	    write_bytes(writer, writer->fill, writer->fill_bytes))
+		return STATUS_ERR;
+	writer->full_bytes = 0;
+	writer->fill_bytes = 0;
+	return fflush(writer->file) == 0 ? STATUS_OK : STATUS_ERR;
+}
+
+/* If we exit without freeing the writer, e.g. in die(), save what we
+ * have captured so far, since that is the capture of a failing test.
+ */
+static void write_pending_at_exit(void)
+{
+	struct pcapng_writer *writer = open_writer;
+
+	if (writer == NULL)
+		return;
+	open_writer = NULL;
+	writer_lock(writer);
+	if (write_pending(writer))
+		fprintf(stderr, "--pcap_out: error writing %s: %s\n",
+			writer->path, strerror(errno));
+	writer_unlock(writer);
+}
+
+static void *writer_thread(void *arg)
+{
+	struct pcapng_writer *writer = arg;
+
+	writer_lock(writer);
+	while (1) {
+		while (writer->full_bytes == 0 && !writer->is_closed)
+			writer_wait(writer);
+		if (writer->full_bytes == 0)
+			break;
+
+		writer->is_writing = true;
+		writer_unlock(writer);
+		if (write_bytes(writer, writer->full, writer->full_bytes)) {
+			open_writer = NULL;
+			die_perror("--pcap_out: fwrite");
+		}
+		writer_lock(writer);
+		writer->is_writing = false;
+		writer->full_bytes = 0;
+		writer_signal(writer);
+	}
+	writer_unlock(writer);
+	return NULL;
+}
+
+/* Make room for the given number of bytes in the fill buffer, handing
+ * the buffer to the writer thread if it is too full. Called with the
+ * lock held. Returns where to put the bytes.
+ */
+static u8 *reserve(struct pcapng_writer *writer, int num_bytes)
+{
+	u8 *start;
+
+	assert(num_bytes <= PCAPNG_BUFFER_BYTES);
+	if (writer->fill_bytes + num_bytes > PCAPNG_BUFFER_BYTES) {
+		u8 *empty;
+
+		/* We only wait here if the disk falls a whole buffer
+		 * behind the test.
+		 */
+		while (writer->full_bytes > 0)
+			writer_wait(writer);
+		empty = writer->full;
+		writer->full = writer->fill;
+		writer->full_bytes = writer->fill_bytes;
+		writer->fill = empty;
+		writer->fill_bytes = 0;
+		writer_signal(writer);
+	}
+	start = writer->fill + writer->fill_bytes;
+	writer->fill_bytes += num_bytes;
+	return start;
+}
+
+/* Round up to the 32-bit alignment of pcapng blocks and options. */
+static int pad4(int num_bytes)
+{
+	return (num_bytes + 3) & ~3;
+}
+
+static u8 *put_u16(u8 *p, u16 value)
+{
+	memcpy(p, &value, sizeof(value));
+	return p + sizeof(value);
+}
+
+static u8 *put_u32(u8 *p, u32 value)
+{
+	memcpy(p, &value, sizeof(value));
+	return p + sizeof(value);
+}
+
+/* Put the bytes, padded with zeroes to a 32-bit boundary. */
+static u8 *put_padded(u8 *p, const void *bytes, int num_bytes)
+{
+	memcpy(p, bytes, num_bytes);
+	memset(p + num_bytes, 0, pad4(num_bytes) - num_bytes);
+	return p + pad4(num_bytes);
+}
+
+/* Put an option with the given code and value. */
+static u8 *put_option(u8 *p, u16 code, const void *value, int num_bytes)
+{
+	p = put_u16(p, code);
+	p = put_u16(p, num_bytes);
+	return put_padded(p, value, num_bytes);
+}
+
+/* Return the bytes an option with a value of the given size takes. */
+static int option_bytes(int num_bytes)
+{
+	return 4 + pad4(num_bytes);
+}
+
+/* Put the section header and interface description blocks. */
+static void put_headers(struct pcapng_writer *writer)
+{
+	const char *application = "packetdrill";
+	const u8 tsresol = 9;		/* timestamps in nanoseconds */
+	const int shb_bytes = 28 + option_bytes(strlen(application)) +
+			      option_bytes(0);
+	const int idb_bytes = 20 + option_bytes(sizeof(tsresol)) +
+			      option_bytes(0);
+	u8 *p = reserve(writer, shb_bytes + idb_bytes);
+
+	p = put_u32(p, PCAPNG_SECTION_HEADER);
+	p = put_u32(p, shb_bytes);
+	p = put_u32(p, PCAPNG_BYTE_ORDER_MAGIC);
+	p = put_u16(p, 1);		/* major version */
+	p = put_u16(p, 0);		/* minor version */
+	p = put_u32(p, 0xffffffff);	/* section length: unknown */
+	p = put_u32(p, 0xffffffff);
+	p = put_option(p, PCAPNG_SHB_USERAPPL, application,
+		       strlen(application));
+	p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+	p = put_u32(p, shb_bytes);
+
+	p = put_u32(p, PCAPNG_INTERFACE_DESCRIPTION);
+	p = put_u32(p, idb_bytes);
+	p = put_u16(p, LINKTYPE_RAW);
+	p = put_u16(p, 0);		/* reserved */
+	p = put_u32(p, 0);		/* snap length: unlimited */
+	p = put_option(p, PCAPNG_IF_TSRESOL, &tsresol, sizeof(tsresol));
+	p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+	p = put_u32(p, idb_bytes);
+}
+
+struct pcapng_writer *pcapng_writer_new(const char *path)
+{
+	struct pcapng_writer *writer = calloc(1, sizeof(struct pcapng_writer));
+	static bool registered_exit_handler;
+
+	writer->path = strdup(path);
+	writer->file = fopen(path, "w");
+	if (writer->file == NULL)
+		die_perror("--pcap_out: fopen");
+	writer->fill = malloc(PCAPNG_BUFFER_BYTES);
+	writer->full = malloc(PCAPNG_BUFFER_BYTES);
+	if (pthread_mutex_init(&writer->mutex, NULL) != 0)
+		die_perror("pthread_mutex_init");
+	if (pthread_cond_init(&writer->changed, NULL) != 0)
+		die_perror("pthread_cond_init");
+
+	put_headers(writer);
+
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+		die_perror("pthread_create");
+
+	if (!registered_exit_handler) {
+		atexit(write_pending_at_exit);
+		registered_exit_handler = true;
+	}
+	open_writer = writer;
+	return writer;
+}
+
+pthread_t pcapng_writer_thread(const struct pcapng_writer *writer)
+{
+	return writer->thread;
+}
+
+/* Return the current wall clock time in nanoseconds. */
+static u64 now_nsecs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_REALTIME, &ts) < 0)
+		die_perror("clock_gettime");
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void pcapng_writer_packet(struct pcapng_writer *writer,
+			  struct packet *packet,
+			  enum direction_t direction, int line)
+{
+	const u8 *start = packet_start(packet);
+	const int ip_bytes = packet->ip_bytes;
+	u64 nsecs = packet->time_usecs ? packet->time_usecs * 1000ULL :
+		    now_nsecs();
+	u32 flags = (direction == DIRECTION_INBOUND) ?
+		    PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+	char comment[PCAPNG_COMMENT_BYTES];
+	int comment_bytes = 0;
+	int block_bytes;
+	u8 *p;
+
+	if (line > 0)
+		comment_bytes = snprintf(comment, sizeof(comment),
+					 "script line %d", line);
+	block_bytes = 32 + pad4(ip_bytes) + option_bytes(sizeof(flags)) +
+		      option_bytes(0);
+	if (comment_bytes > 0)
+		block_bytes += option_bytes(comment_bytes);
+
+	writer_lock(writer);
+	p = reserve(writer, block_bytes);
+	p = put_u32(p, PCAPNG_ENHANCED_PACKET);
+	p = put_u32(p, block_bytes);
+	p = put_u32(p, 0);		/* interface ID */
+	p = put_u32(p, nsecs >> 32);
+	p = put_u32(p, nsecs & 0xffffffff);
+	p = put_u32(p, ip_bytes);	/* captured length */
+	p = put_u32(p, ip_bytes);	/* original length */
+	p = put_padded(p, start, ip_bytes);
+	if (comment_bytes > 0)
+		p = put_option(p, PCAPNG_OPT_COMMENT, comment, comment_bytes);
+	p = put_option(p, PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+	p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+	p = put_u32(p, block_bytes);
+	writer_unlock(writer);
+}
+
+/* Put a custom block with the given record. */
+static void put_record(struct pcapng_writer *writer, enum pcapng_record_t type,
+		       const void *record, int num_bytes)
+{
+	const int block_bytes = 20 + pad4(num_bytes);
+	u8 *p;
+
+	writer_lock(writer);
+	p = reserve(writer, block_bytes);
+	p = put_u32(p, PCAPNG_CUSTOM);
+	p = put_u32(p, block_bytes);
+	p = put_u32(p, PCAPNG_PEN);
+	p = put_u32(p, type);
+	p = put_padded(p, record, num_bytes);
+	p = put_u32(p, block_bytes);
+	writer_unlock(writer);
+}
+
+void pcapng_writer_start(struct pcapng_writer *writer, s64 live_start_usecs)
+{
+	put_record(writer, PCAPNG_RECORD_START,
+		   &live_start_usecs, sizeof(live_start_usecs));
+}
+
+void pcapng_writer_syscall(struct pcapng_writer *writer, int line,
+			   const char *name, int result, int err, int check,
+			   s64 end_usecs)
+{
+	struct pcapng_syscall syscall;
+
+	memset(&syscall, 0, sizeof(syscall));
+	syscall.end_usecs = end_usecs;
+	syscall.line = line;
+	syscall.result = result;
+	syscall.err = err;
+	syscall.check = check;
+	strncpy(syscall.name, name, sizeof(syscall.name) - 1);
+	put_record(writer, PCAPNG_RECORD_SYSCALL, &syscall, sizeof(syscall));
+}
+
+void pcapng_writer_random(u64 value)
+{
+	if (open_writer != NULL)
+		put_record(open_writer, PCAPNG_RECORD_RANDOM,
+			   &value, sizeof(value));
+}
+
+void pcapng_writer_free(struct pcapng_writer *writer)
+{
+	open_writer = NULL;
+
+	writer_lock(writer);
+	writer->is_closed = true;
+	writer_signal(writer);
+	writer_unlock(writer);
+
+	if (pthread_join(writer->thread, NULL) != 0)
+		die_perror("pthread_join");
+
+	/* The thread wrote any full buffer before exiting. */
+	writer_lock(writer);
+	if (write_pending(writer) || fclose(writer->file) != 0)
+		die_perror("--pcap_out: error writing capture");
+	writer_unlock(writer);
+
+	if (pthread_cond_destroy(&writer->changed) != 0)
+		die_perror("pthread_cond_destroy");
+	if (pthread_mutex_destroy(&writer->mutex) != 0)
+		die_perror("pthread_mutex_destroy");
+	free(writer->fill);
+	free(writer->full);
+	free(writer->path);
+	free(writer);
+}
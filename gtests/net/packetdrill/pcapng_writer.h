@@ -0,0 +1,90 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Streaming capture of the packets a test injects and sniffs, in
+ * pcapng format (see draft-ietf-opsawg-pcapng),
+ * for the --pcap_out option.
+ *
+ * Each packet is saved from its outermost IP header, with a
+ * nanosecond timestamp, its direction relative to the kernel under
+ * test in the epb_flags option, and the script line that injected or
+ * expected it in an opt_comment option.
+ *
+ * The capture also records what --replay needs to rerun the script
+ * without a kernel; see pcapng.h.
+ *
+ * Packets are appended to an in-memory buffer; a writer thread owns
+ * the file and writes out each buffer as it fills, so the timing of
+ * the test does not depend on the file system. If we die() before the
+ * writer is freed, what is buffered is written at exit.
+ */
+
+#ifndef __PCAPNG_WRITER_H__
+#define __PCAPNG_WRITER_H__
+
+#include "types.h"
+
+#include <pthread.h>
+#include "packet.h"
+
+/* Bytes in each of the two buffers we fill and write in turn. */
+#define PCAPNG_BUFFER_BYTES	(1024 * 1024)
+
+struct pcapng_writer;
+
+/* Create the file at the given path, write the pcapng headers, and
+ * start the writer thread. Dies on errors.
+ */
+extern struct pcapng_writer *pcapng_writer_new(const char *path);
+
+/* Return the writer thread. */
+extern pthread_t pcapng_writer_thread(const struct pcapng_writer *writer);
+
+/* Save the packet, which is traveling in the given direction for the
+ * script event at the given line (0 if none). Sniffed packets carry
+ * their own receive time; other packets are stamped with the current
+ * time.
+ */
+extern void pcapng_writer_packet(struct pcapng_writer *writer,
+				 struct packet *packet,
+				 enum direction_t direction, int line);
+
+/* Record the live start time of the script. */
+extern void pcapng_writer_start(struct pcapng_writer *writer,
+				s64 live_start_usecs);
+
+/* Record that the named system call of the given line returned the
+ * given result and errno at the given time. The check tells how the
+ * result was compared with the script's.
+ */
+extern void pcapng_writer_syscall(struct pcapng_writer *writer, int line,
+				  const char *name, int result, int err,
+				  int check, s64 end_usecs);
+
+/* Record a random number the harness drew, in the open capture if
+ * there is one, so a replay can draw the same.
+ */
+extern void pcapng_writer_random(u64 value);
+
+/* Write out everything buffered, stop the writer thread, and close
+ * the file.
+ */
+extern void pcapng_writer_free(struct pcapng_writer *writer);
+
+#endif /* __PCAPNG_WRITER_H__ */
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for kernel CPU cost accounting with perf counters.
+ */
+
+#include "perf_counters.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "logging.h"
+#include "packet.h"
+
+#ifdef linux
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *perf_counter_names[NUM_PERF_COUNTERS] = {
+	[PERF_CYCLES]		= "cycles",
+	[PERF_INSTRUCTIONS]	= "instructions",
+	[PERF_CONTEXT_SWITCHES]	= "ctx_switches",
+	[PERF_MIGRATIONS]	= "migrations",
+	[PERF_SOFTIRQS]		= "softirqs",
+};
+
+static const char *perf_phase_names[NUM_PERF_PHASES] = {
+	[PERF_PHASE_INBOUND]	= "inbound",
+	[PERF_PHASE_OUTBOUND]	= "outbound",
+	[PERF_PHASE_SYSCALL]	= "syscall",
+	[PERF_PHASE_COMMAND]	= "command",
+	[PERF_PHASE_CODE]	= "code",
+	[PERF_PHASE_PACING]	= "pacing",
+};
+
+#ifdef linux
+
+/* Where tracefs may be mounted. */
+static const char *tracefs_paths[] = {
+	"/sys/kernel/tracing",
+	"/sys/kernel/debug/tracing",
+};
+
+/* Return the perf id of the given tracepoint, or -1 if there is no
+ * tracefs we can read it from.
+ */
+static s64 tracepoint_id(const char *tracepoint)
+{
+	s64 id = -1;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(tracefs_paths) && id < 0; ++i) {
+		char *path = NULL;
+		FILE *f;
+
+		asprintf(&path, "%s/events/%s/id",
+			 tracefs_paths[i], tracepoint);
+		f = fopen(path, "r");
+		if (f != NULL) {
+			if (fscanf(f, "%lld", &id) != 1)
+				id = -1;
+			fclose(f);
+		}
+		free(path);
+	}
+	return id;
+}
+
+/* Open the given counter for the given thread, in counting mode.
+ * Returns the fd, or -1 if the kernel does not support the counter.
+ */
+static int open_counter(enum perf_counter_t counter, pid_t tid)
+{
+	struct perf_event_attr attr;
+	s64 id;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.exclude_hv = 1;
+	switch (counter) {
+	case PERF_CYCLES:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CPU_CYCLES;
+		attr.exclude_user = 1;
+		break;
+	case PERF_INSTRUCTIONS:
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		attr.exclude_user = 1;
+		break;
+	case PERF_CONTEXT_SWITCHES:
+		attr.type = PERF_TYPE_SOFTWARE;
+		attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+		break;
+	case PERF_MIGRATIONS:
+		attr.type = PERF_TYPE_SOFTWARE;
+		attr.config = PERF_COUNT_SW_CPU_MIGRATIONS;
+		break;
+	case PERF_SOFTIRQS:
+		id = tracepoint_id("irq/softirq_entry");
+		if (id < 0)
+			return -1;
+		attr.type = PERF_TYPE_TRACEPOINT;
+		attr.config = id;
+		break;
+	case NUM_PERF_COUNTERS:
+		assert(!"bad counter");
+		break;
+	}
+	return syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+		       PERF_FLAG_FD_CLOEXEC);
+}
+
+#else  /* !linux */
+
+static int open_counter(enum perf_counter_t counter, pid_t tid)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif  /* linux */
+
+/* Open all the counters we can for the given thread. Returns how many
+ * we opened.
+ */
+static int open_thread(struct perf_counters *perf, pid_t tid)
+{
+	int *fds = perf->fds[perf->num_threads++];
+	int i, num_open = 0;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; ++i) {
+		fds[i] = open_counter(i, tid);
+		if (fds[i] >= 0)
+			++num_open;
+		else
+			DEBUGP("perf counter %s: %s\n",
+			       perf_counter_names[i], strerror(errno));
+	}
+	return num_open;
+}
+
+/* Read the total counts over all our threads. */
+static void read_counters(const struct perf_counters *perf,
+			  u64 counts[NUM_PERF_COUNTERS])
+{
+	int i, t;
+
+	for (i = 0; i < NUM_PERF_COUNTERS; ++i) {
+		counts[i] = 0;
+		for (t = 0; t < perf->num_threads; ++t) {
+			u64 count = 0;
+
+			if (perf->fds[t][i] < 0)
+				continue;
+			if (read(perf->fds[t][i], &count, sizeof(count)) !=
+			    sizeof(count))
+				die_perror("read perf counter");
+			counts[i] += count;
+		}
+	}
+}
+
+struct perf_counters *perf_counters_new(void)
+{
+	struct perf_counters *perf = calloc(1, sizeof(struct perf_counters));
+
+	if (open_thread(perf, 0) == 0)
+		die("--perf_counters: cannot open any perf counters; "
+		    "check /proc/sys/kernel/perf_event_paranoid\n");
+	perf_counters_mark(perf);
+	return perf;
+}
+
+void perf_counters_add_thread(struct perf_counters *perf, pid_t tid)
+{
+	u64 counts[NUM_PERF_COUNTERS];
+
+	if (perf->num_threads == PERF_MAX_THREADS)
+		return;
+
+	/* Keep the counts so far, so that only what the new thread
+	 * does from now on is charged.
+	 */
+	read_counters(perf, counts);
+	open_thread(perf, tid);
+	memcpy(perf->last, counts, sizeof(counts));
+}
+
+void perf_counters_mark(struct perf_counters *perf)
+{
+	read_counters(perf, perf->last);
+}
+
+/* Return the phase to charge the given event to. */
+static enum perf_phase_t event_phase(const struct event *event)
+{
+	switch (event->type) {
+	case PACKET_EVENT:
+		if (packet_direction(event->event.packet) == DIRECTION_INBOUND)
+			return PERF_PHASE_INBOUND;
+		return PERF_PHASE_OUTBOUND;
+	case SYSCALL_EVENT:
+		return PERF_PHASE_SYSCALL;
+	case COMMAND_EVENT:
+		return PERF_PHASE_COMMAND;
+	case CODE_EVENT:
+		return PERF_PHASE_CODE;
+	case PACING_EVENT:
+		return PERF_PHASE_PACING;
+	case INVALID_EVENT:
+	case NUM_EVENT_TYPES:
+		break;
+	/* We omit default case so compiler catches missing values. */
+	}
+	assert(!"bogus type");
+	return PERF_PHASE_SYSCALL;
+}
+
+void perf_counters_charge(struct perf_counters *perf,
+			  const struct event *event)
+{
+	enum perf_phase_t phase = event_phase(event);
+	u64 counts[NUM_PERF_COUNTERS];
+	int i;
+
+	read_counters(perf, counts);
+	for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+		perf->totals[phase][i] += counts[i] - perf->last[i];
+	++perf->events[phase];
+	memcpy(perf->last, counts, sizeof(counts));
+}
+
+void perf_counters_print(const struct perf_counters *perf,
+			 const char *script_path, FILE *f)
+{
+	u64 totals[NUM_PERF_COUNTERS];
+	int events = 0;
+	int i, p;
+
+	memset(totals, 0, sizeof(totals));
+	fprintf(f, "perf counters for %s (kernel cycles and instructions):\n",
+		script_path);
+	fprintf(f, "%-10s %8s", "phase", "events");
+	for (i = 0; i < NUM_PERF_COUNTERS; ++i)
+		fprintf(f, " %14s", perf_counter_names[i]);
+	fprintf(f, "\n");
+
+	for (p = 0; p < NUM_PERF_PHASES; ++p) {
+		if (perf->events[p] == 0)
+			continue;
+		events += perf->events[p];
+		fprintf(f, "%-10s %8d", perf_phase_names[p], perf->events[p]);
+		for (i = 0; i < NUM_PERF_COUNTERS; ++i) {
+			totals[i] += perf->totals[p][i];
+			if (perf->fds[0][i] < 0)
+				fprintf(f, " %14s", "n/a");
+			else
+				fprintf(f, " %14llu", perf->totals[p][i]);
+		}
+		fprintf(f, "\n");
+	}
+
+	fprintf(f, "%-10s %8d", "total", events);
+	for (i = 0; i < NUM_PERF_COUNTERS; ++i) {
+		if (perf->fds[0][i] < 0)
+			fprintf(f, " %14s", "n/a");
+		else
+			fprintf(f, " %14llu", totals[i]);
+	}
+	fprintf(f, "\n");
+}
+
+void perf_counters_free(struct perf_counters *perf)
+{
+	int i, t;
+
+	for (t = 0; t < perf->num_threads; ++t) {
+		for (i = 0; i < NUM_PERF_COUNTERS; ++i) {
+			if (perf->fds[t][i] >= 0)
+				close(perf->fds[t][i]);
+		}
+	}
+	free(perf);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Kernel CPU cost accounting for test scripts, using perf_event_open()
+ * counters on our own threads.
+ *
+ * Packets we inject are processed by the kernel in our thread's
+ * context, and system calls run in our threads, so counting kernel
+ * cycles and instructions on our threads measures the kernel work each
+ * event costs. We charge each event with the counts from the end of
+ * its wait_for_event() to the end of the event, so time spent waiting
+ * for the event's time is not charged to anyone. Work the kernel does
+ * later in timers or in other threads, e.g. retransmits, is charged to
+ * whichever event is running, or to no one.
+ */
+
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include "types.h"
+
+#include <stdio.h>
+#include "script.h"
+
+/* The counters we keep. */
+enum perf_counter_t {
+	PERF_CYCLES,			/* CPU cycles in the kernel */
+	PERF_INSTRUCTIONS,		/* instructions in the kernel */
+	PERF_CONTEXT_SWITCHES,		/* times our threads were switched out */
+	PERF_MIGRATIONS,		/* times our threads changed CPUs */
+	PERF_SOFTIRQS,			/* softirqs run in our threads */
+	NUM_PERF_COUNTERS,
+};
+
+/* The phases of a script we charge events to. */
+enum perf_phase_t {
+	PERF_PHASE_INBOUND,		/* injecting packets */
+	PERF_PHASE_OUTBOUND,		/* sniffing and checking packets */
+	PERF_PHASE_SYSCALL,		/* system calls */
+	PERF_PHASE_COMMAND,		/* shell commands */
+	PERF_PHASE_CODE,		/* code snippets */
+	PERF_PHASE_PACING,		/* pacing assertions */
+	NUM_PERF_PHASES,
+};
+
+/* The most threads we count: the main thread and the syscall thread. */
+#define PERF_MAX_THREADS	2
+
+struct perf_counters {
+	int fds[PERF_MAX_THREADS][NUM_PERF_COUNTERS];	/* -1 if not open */
+	int num_threads;		/* threads we have counters for */
+	u64 last[NUM_PERF_COUNTERS];	/* counts at the last mark */
+	u64 totals[NUM_PERF_PHASES][NUM_PERF_COUNTERS];
+	int events[NUM_PERF_PHASES];	/* number of events per phase */
+};
+
+/* Open counters for the calling thread. Dies if the kernel lets us
+ * open none of them; counters the kernel does not support are left
+ * out of the results.
+ */
+extern struct perf_counters *perf_counters_new(void);
+
+/* Also count the given thread, if there is room for it. */
+extern void perf_counters_add_thread(struct perf_counters *perf, pid_t tid);
+
+/* Start charging to the next event from now on. */
+extern void perf_counters_mark(struct perf_counters *perf);
+
+/* Charge the counts since the last mark to the phase of the given
+ * event, and mark again.
+ */
+extern void perf_counters_charge(struct perf_counters *perf,
+				 const struct event *event);
+
+/* Print the totals for each phase of the script. */
+extern void perf_counters_print(const struct perf_counters *perf,
+				const char *script_path, FILE *f);
+
+/* Close the counters and free them. */
+extern void perf_counters_free(struct perf_counters *perf);
+
+#endif /* __PERF_COUNTERS_H__ */
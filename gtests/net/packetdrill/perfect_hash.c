@@ -0,0 +1,176 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for perfect hashing of a fixed set of strings.
+ */
+
+#include "perfect_hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "logging.h"
+
+/* The average number of keys per bucket. */
+#define KEYS_PER_BUCKET		4
+
+/* How many seeds we try for a bucket before giving up. With at least
+ * twice as many slots as keys, a handful of tries is typical.
+ */
+#define MAX_SEED		(1 << 20)
+
+struct perfect_hash {
+	const char **keys;	/* the keys, indexed by slots[] */
+	u32 bucket_mask;	/* number of buckets, minus one */
+	u32 slot_mask;		/* number of slots, minus one */
+	u32 *seeds;		/* per bucket: seed for the slot hash */
+	int *slots;		/* per slot: index of key, or -1 */
+};
+
+static u32 hash_string(const char *s, u32 seed)
+{
+	u32 hash = 0;
+
+	MurmurHash3_x86_32(s, strlen(s), seed, &hash);
+	return hash;
+}
+
+/* Return the smallest power of two that is at least n. */
+static u32 round_up_pow2(u32 n)
+{
+	u32 pow2 = 1;
+
+	while (pow2 < n)
+		pow2 <<= 1;
+	return pow2;
+}
+
+/* A bucket and the keys in it, while we build the hash. */
+struct bucket {
+	u32 bucket;		/* bucket number */
+	int num_keys;		/* number of keys in the bucket */
+	int *keys;		/* indices of the keys */
+};
+
+/* Sort buckets by decreasing size, since the biggest are the
+ * hardest to place and are best placed while most slots are free.
+ */
+static int compare_buckets(const void *a, const void *b)
+{
+	const struct bucket *bucket_a = a, *bucket_b = b;
+
+	return bucket_b->num_keys - bucket_a->num_keys;
+}
+
+/* Try to place all the keys of the bucket using the given seed. On
+ * success fill in their slots and return true.
+ */
+static bool place_bucket(struct perfect_hash *hash,
+			 const struct bucket *bucket, u32 seed, u32 *slots)
+{
+	int i, j;
+
+	for (i = 0; i < bucket->num_keys; ++i) {
+		slots[i] = hash_string(hash->keys[bucket->keys[i]], seed) &
+			   hash->slot_mask;
+		if (hash->slots[slots[i]] >= 0)
+			return false;
+		for (j = 0; j < i; ++j) {
+			if (slots[j] == slots[i])
+				return false;
+		}
+	}
+	for (i = 0; i < bucket->num_keys; ++i)
+		hash->slots[slots[i]] = bucket->keys[i];
+	return true;
+}
+
+struct perfect_hash *perfect_hash_new(const char **keys, int num_keys)
+{
+	struct perfect_hash *hash = calloc(1, sizeof(struct perfect_hash));
+	const u32 num_buckets =
+		round_up_pow2(num_keys / KEYS_PER_BUCKET + 1);
+	const u32 num_slots = round_up_pow2(2 * num_keys + 1);
+	struct bucket *buckets = calloc(num_buckets, sizeof(struct bucket));
+	int *bucket_keys = calloc(num_keys + 1, sizeof(int));
+	u32 *slots = calloc(num_keys + 1, sizeof(u32));
+	int i, next = 0;
+	u32 b;
+
+	hash->keys = keys;
+	hash->bucket_mask = num_buckets - 1;
+	hash->slot_mask = num_slots - 1;
+	hash->seeds = calloc(num_buckets, sizeof(u32));
+	hash->slots = malloc(num_slots * sizeof(int));
+	for (b = 0; b < num_slots; ++b)
+		hash->slots[b] = -1;
+
+	/* Sort the keys into buckets. */
+	for (i = 0; i < num_keys; ++i)
+		++buckets[hash_string(keys[i], 0) & hash->bucket_mask].num_keys;
+	for (b = 0; b < num_buckets; ++b) {
+		buckets[b].bucket = b;
+		buckets[b].keys = bucket_keys + next;
+		next += buckets[b].num_keys;
+		buckets[b].num_keys = 0;
+	}
+	for (i = 0; i < num_keys; ++i) {
+		struct bucket *bucket =
+			&buckets[hash_string(keys[i], 0) & hash->bucket_mask];
+
+		bucket->keys[bucket->num_keys++] = i;
+	}
+	qsort(buckets, num_buckets, sizeof(struct bucket), compare_buckets);
+
+	/* Find a seed that places each bucket in free slots. */
+	for (b = 0; b < num_buckets && buckets[b].num_keys > 0; ++b) {
+		u32 seed;
+
+		for (seed = 1; seed < MAX_SEED; ++seed) {
+			if (place_bucket(hash, &buckets[b], seed, slots))
+				break;
+		}
+		if (seed == MAX_SEED)
+			die("perfect_hash_new: no seed for bucket; "
+			    "are there duplicate keys?\n");
+		hash->seeds[buckets[b].bucket] = seed;
+	}
+
+	free(slots);
+	free(bucket_keys);
+	free(buckets);
+	return hash;
+}
+
+int perfect_hash_lookup(const struct perfect_hash *hash, const char *key)
+{
+	u32 seed = hash->seeds[hash_string(key, 0) & hash->bucket_mask];
+	int i = hash->slots[hash_string(key, seed) & hash->slot_mask];
+
+	if (i < 0 || strcmp(hash->keys[i], key) != 0)
+		return -1;
+	return i;
+}
+
+void perfect_hash_free(struct perfect_hash *hash)
+{
+	free(hash->seeds);
+	free(hash->slots);
+	free(hash);
+}
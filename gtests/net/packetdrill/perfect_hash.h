@@ -0,0 +1,49 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Perfect hashing for a fixed set of strings, using the "hash and
+ * displace" scheme. Keys are split into small buckets by one hash, and
+ * each bucket gets a seed for a second hash that sends each of its keys
+ * to a slot no other key uses. A lookup is then two hashes and a
+ * single string compare, however many keys there are.
+ */
+
+#ifndef __PERFECT_HASH_H__
+#define __PERFECT_HASH_H__
+
+#include "types.h"
+
+struct perfect_hash;
+
+/* Build a perfect hash for the given distinct keys. The keys are not
+ * copied, so they must outlive the hash.
+ */
+extern struct perfect_hash *perfect_hash_new(const char **keys,
+					     int num_keys);
+
+/* Return the index of the given key in the array of keys, or -1 if it
+ * is not one of them.
+ */
+extern int perfect_hash_lookup(const struct perfect_hash *hash,
+			       const char *key);
+
+/* Free the hash. */
+extern void perfect_hash_free(struct perfect_hash *hash);
+
+#endif /* __PERFECT_HASH_H__ */
@@ -36,6 +36,13 @@
 #define TUN_PATH                "/dev/net/tun"
 #define HAVE_TCP_INFO           1
 
+/* USDT probes need the systemtap-sdt-dev(el) header. */
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SDT                1
+#endif
+#endif
+
 #endif  /* linux */
 
 
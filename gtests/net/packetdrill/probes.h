@@ -0,0 +1,72 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Static USDT probes, for tracing the harness with bpftrace or perf
+ * alongside the kernel under test, e.g.:
+ *
+ *   bpftrace -e 'usdt:./packetdrill:packetdrill:event__start
+ *                { printf("%d line %d\n", nsecs, arg0); }'
+ *
+ * When built without <sys/sdt.h> the probes compile to nothing. When
+ * built with it, each probe is a single nop until a tracer attaches,
+ * and we only pass values we have at hand anyway, so the tracer's own
+ * clock supplies the wall-clock timestamps. Times in probe arguments
+ * are in microseconds. Line numbers are 0 when there is no current
+ * script event, e.g. for the resets we send while tearing down.
+ *
+ *   event__start(line, type, script_usecs)  run loop starts an event
+ *   event__done(line, type)                 run loop finished an event
+ *   wait__start(line, live_usecs)           waiting for event's time
+ *   wait__done(line, live_usecs)            done waiting
+ *   netdev__send(line, ip_bytes)            injecting a packet
+ *   netdev__receive(line, ip_bytes, live_usecs)  sniffed a packet
+ *   verify__outbound(line, result, live_usecs)   verified a packet
+ *   syscall__enqueue(line)                  main thread hands off call
+ *   syscall__begin(line)                    syscall thread blocks in it
+ *   syscall__end(line, live_usecs)          blocking call returned
+ *   mptcp__fields__start(direction, ip_bytes)    MPTCP option rewrite
+ *   mptcp__fields__done(direction, result)
+ *
+ * The MPTCP code does not know the script line; the surrounding event
+ * probes on the same thread give it.
+ */
+
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+#include "types.h"
+
+#if defined(HAVE_SDT)
+
+#include <sys/sdt.h>
+
+#define PROBE1(name, a)			DTRACE_PROBE1(packetdrill, name, a)
+#define PROBE2(name, a, b)		DTRACE_PROBE2(packetdrill, name, a, b)
+#define PROBE3(name, a, b, c)		DTRACE_PROBE3(packetdrill, name, \
+						      a, b, c)
+
+#else  /* !HAVE_SDT */
+
+#define PROBE1(name, a)			do {} while (0)
+#define PROBE2(name, a, b)		do {} while (0)
+#define PROBE3(name, a, b, c)		do {} while (0)
+
+#endif  /* HAVE_SDT */
+
+#endif /* __PROBES_H__ */
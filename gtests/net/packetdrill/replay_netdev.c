@@ -0,0 +1,432 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for replaying a recorded trace instead of a kernel.
+ */
+
+#include "replay_netdev.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "logging.h"
+#include "packet_parser.h"
+
+/* A packet from the trace. */
+struct replay_packet {
+	s64 time_usecs;			/* when it was injected or sniffed */
+	enum direction_t direction;	/* relative to the kernel under test */
+	int line;			/* script line, or 0 if none */
+	const u8 *bytes;		/* starting at the IP header */
+	u32 num_bytes;			/* captured length */
+};
+
+/* A system call outcome from the trace. */
+struct replay_syscall {
+	struct pcapng_syscall syscall;	/* the recorded outcome */
+	bool is_used;			/* returned to the script yet? */
+};
+
+struct replay_netdev {
+	struct netdev netdev;		/* "inherit" from netdev */
+
+	char *path;			/* path of the trace */
+	u8 *trace;			/* the whole trace file */
+	s64 start_usecs;		/* live start time of the script */
+
+	struct replay_packet *packets;	/* packets, in the recorded order */
+	int num_packets;
+	int next_inbound;		/* index after last injected packet */
+	int next_outbound;		/* index after last sniffed packet */
+
+	struct replay_syscall *syscalls;	/* system calls, by end time */
+	int num_syscalls;
+
+	u64 *randoms;			/* random numbers, in order drawn */
+	int num_randoms;
+	int next_random;		/* index of next one to draw */
+};
+
+struct netdev_ops replay_netdev_ops;
+
+/* The replay in progress, if any, and its clock. */
+static struct replay_netdev *replay;
+static s64 replay_clock;
+static pthread_cond_t replay_clock_changed = PTHREAD_COND_INITIALIZER;
+
+/* "Downcast" an abstract netdev to our replay flavor. */
+static inline struct replay_netdev *to_replay_netdev(struct netdev *netdev)
+{
+	return (struct replay_netdev *)netdev;
+}
+
+/* Read the whole file at the given path into memory. */
+static u8 *read_trace(const char *path, int *num_bytes)
+{
+	struct stat st;
+	FILE *f = fopen(path, "r");
+	u8 *trace;
+
+	if (f == NULL || fstat(fileno(f), &st) < 0)
+		die_perror("--replay: open");
+	trace = malloc(st.st_size + 1);
+	if (fread(trace, 1, st.st_size, f) != st.st_size)
+		die_perror("--replay: fread");
+	fclose(f);
+	*num_bytes = st.st_size;
+	return trace;
+}
+
+static u32 get_u32(const u8 *p)
+{
+	u32 value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static u16 get_u16(const u8 *p)
+{
+	u16 value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+/* Add the enhanced packet block with the given body to the replay. */
+static void add_packet(struct replay_netdev *netdev,
+		       const u8 *body, int body_bytes)
+{
+	struct replay_packet *packet;
+	u64 nsecs;
+	u32 flags = PCAPNG_EPB_INBOUND;
+	const u8 *option;
+	int num_bytes;
+
+	if (body_bytes < 20)
+		die("--replay: %s: truncated packet block\n", netdev->path);
+	nsecs = ((u64)get_u32(body + 4) << 32) | get_u32(body + 8);
+	num_bytes = get_u32(body + 12);
+	if (20 + ((num_bytes + 3) & ~3) > body_bytes)
+		die("--replay: %s: truncated packet\n", netdev->path);
+
+	netdev->packets = realloc(netdev->packets,
+				  (netdev->num_packets + 1) *
+				  sizeof(struct replay_packet));
+	packet = &netdev->packets[netdev->num_packets++];
+	memset(packet, 0, sizeof(*packet));
+	packet->time_usecs = nsecs / 1000;
+	packet->bytes = body + 20;
+	packet->num_bytes = num_bytes;
+
+	/* Look for the direction and the script line in the options. */
+	option = body + 20 + ((num_bytes + 3) & ~3);
+	while (option + 4 <= body + body_bytes) {
+		u16 code = get_u16(option);
+		u16 option_bytes = get_u16(option + 2);
+
+		if (code == PCAPNG_OPT_END ||
+		    option + 4 + option_bytes > body + body_bytes)
+			break;
+		if (code == PCAPNG_EPB_FLAGS && option_bytes == 4)
+			flags = get_u32(option + 4);
+		else if (code == PCAPNG_OPT_COMMENT &&
+			 option_bytes > strlen("script line ") &&
+			 memcmp(option + 4, "script line ",
+				strlen("script line ")) == 0)
+			packet->line = atoi((const char *)option + 4 +
+					    strlen("script line "));
+		option += 4 + ((option_bytes + 3) & ~3);
+	}
+	if ((flags & PCAPNG_EPB_DIRECTION_MASK) == PCAPNG_EPB_OUTBOUND)
+		packet->direction = DIRECTION_OUTBOUND;
+	else
+		packet->direction = DIRECTION_INBOUND;
+}
+
+/* Add the custom block with the given body to the replay. */
+static void add_record(struct replay_netdev *netdev,
+		       const u8 *body, int body_bytes)
+{
+	const u8 *record = body + 8;
+	int record_bytes = body_bytes - 8;
+
+	if (body_bytes < 8 || get_u32(body) != PCAPNG_PEN)
+		return;		/* someone else's block */
+
+	switch (get_u32(body + 4)) {
+	case PCAPNG_RECORD_START:
+		if (record_bytes < sizeof(s64))
+			break;
+		memcpy(&netdev->start_usecs, record, sizeof(s64));
+		return;
+	case PCAPNG_RECORD_SYSCALL:
+		if (record_bytes < sizeof(struct pcapng_syscall))
+			break;
+		netdev->syscalls = realloc(netdev->syscalls,
+					   (netdev->num_syscalls + 1) *
+					   sizeof(struct replay_syscall));
+		memcpy(&netdev->syscalls[netdev->num_syscalls].syscall,
+		       record, sizeof(struct pcapng_syscall));
+		netdev->syscalls[netdev->num_syscalls].syscall.name[
+			PCAPNG_SYSCALL_NAME_BYTES - 1] = '\0';
+		netdev->syscalls[netdev->num_syscalls].is_used = false;
+		++netdev->num_syscalls;
+		return;
+	case PCAPNG_RECORD_RANDOM:
+		if (record_bytes < sizeof(u64))
+			break;
+		netdev->randoms = realloc(netdev->randoms,
+					  (netdev->num_randoms + 1) *
+					  sizeof(u64));
+		memcpy(&netdev->randoms[netdev->num_randoms++], record,
+		       sizeof(u64));
+		return;
+	default:
+		return;		/* from a newer packetdrill; skip it */
+	}
+	die("--replay: %s: truncated record\n", netdev->path);
+}
+
+/* Parse the blocks of the trace. */
+static void parse_trace(struct replay_netdev *netdev, int trace_bytes)
+{
+	const u8 *p = netdev->trace;
+	const u8 *end = netdev->trace + trace_bytes;
+
+	while (p + 12 <= end) {
+		u32 type = get_u32(p);
+		u32 block_bytes = get_u32(p + 4);
+		const u8 *body = p + 8;
+		int body_bytes = block_bytes - 12;
+
+		if (block_bytes < 12 || (block_bytes & 3) ||
+		    block_bytes > end - p)
+			die("--replay: %s: bad block length\n", netdev->path);
+
+		switch (type) {
+		case PCAPNG_SECTION_HEADER:
+			if (body_bytes < 4 ||
+			    get_u32(body) != PCAPNG_BYTE_ORDER_MAGIC)
+				die("--replay: %s: not a pcapng file in our "
+				    "byte order\n", netdev->path);
+			break;
+		case PCAPNG_INTERFACE_DESCRIPTION:
+			if (body_bytes < 8 || get_u16(body) != LINKTYPE_RAW)
+				die("--replay: %s: not written by "
+				    "--pcap_out\n", netdev->path);
+			break;
+		case PCAPNG_ENHANCED_PACKET:
+			add_packet(netdev, body, body_bytes);
+			break;
+		case PCAPNG_CUSTOM:
+			add_record(netdev, body, body_bytes);
+			break;
+		}
+		p += block_bytes;
+	}
+	if (netdev->start_usecs == 0)
+		die("--replay: %s: no script start time; was it written "
+		    "by --pcap_out?\n", netdev->path);
+}
+
+struct netdev *replay_netdev_new(struct config *config)
+{
+	struct replay_netdev *netdev = calloc(1, sizeof(struct replay_netdev));
+	int trace_bytes = 0;
+
+	DEBUGP("replay_netdev_new\n");
+
+	if (replay != NULL)
+		die("--replay: only one replay at a time\n");
+
+	netdev->netdev.ops = &replay_netdev_ops;
+	netdev->path = strdup(config->replay_path);
+	netdev->trace = read_trace(netdev->path, &trace_bytes);
+	parse_trace(netdev, trace_bytes);
+
+	replay = netdev;
+	replay_clock = netdev->start_usecs;
+	return (struct netdev *)netdev;
+}
+
+static void replay_netdev_free(struct netdev *a_netdev)
+{
+	struct replay_netdev *netdev = to_replay_netdev(a_netdev);
+
+	DEBUGP("replay_netdev_free\n");
+
+	replay = NULL;
+	free(netdev->packets);
+	free(netdev->syscalls);
+	free(netdev->randoms);
+	free(netdev->trace);
+	free(netdev->path);
+	free(netdev);
+}
+
+/* Return the index of the next packet at or after the given index
+ * that travels in the given direction, or num_packets if none.
+ */
+static int next_packet(const struct replay_netdev *netdev, int i,
+		       enum direction_t direction)
+{
+	while (i < netdev->num_packets &&
+	       netdev->packets[i].direction != direction)
+		++i;
+	return i;
+}
+
+static int replay_netdev_send(struct netdev *a_netdev,
+			      struct packet *packet)
+{
+	struct replay_netdev *netdev = to_replay_netdev(a_netdev);
+	const struct replay_packet *recorded = NULL;
+	const u8 *bytes = packet_start(packet);
+	int i;
+
+	DEBUGP("replay_netdev_send\n");
+
+	i = next_packet(netdev, netdev->next_inbound, DIRECTION_INBOUND);
+	if (i == netdev->num_packets)
+		die("--replay: injecting more packets than the trace has\n");
+	recorded = &netdev->packets[i];
+	netdev->next_inbound = i + 1;
+
+	if (recorded->num_bytes != packet->ip_bytes)
+		die("--replay: injected packet has %u bytes but the one "
+		    "injected at line %d of the trace has %u\n",
+		    packet->ip_bytes, recorded->line, recorded->num_bytes);
+	for (i = 0; i < packet->ip_bytes; ++i) {
+		if (bytes[i] != recorded->bytes[i])
+			die("--replay: injected packet differs at byte %d "
+			    "from the one injected at line %d of the trace\n",
+			    i, recorded->line);
+	}
+	return STATUS_OK;
+}
+
+static int replay_netdev_receive(struct netdev *a_netdev,
+				 struct packet **packet, char **error)
+{
+	struct replay_netdev *netdev = to_replay_netdev(a_netdev);
+
+	DEBUGP("replay_netdev_receive\n");
+
+	assert(*packet == NULL);	/* should be no packet yet */
+
+	while (1) {
+		enum packet_parse_result_t result;
+		const struct replay_packet *recorded = NULL;
+		int i = next_packet(netdev, netdev->next_outbound,
+				    DIRECTION_OUTBOUND);
+
+		if (i == netdev->num_packets) {
+			asprintf(error, "replay: no more packets from the "
+				 "kernel in the trace");
+			return STATUS_ERR;
+		}
+		recorded = &netdev->packets[i];
+		netdev->next_outbound = i + 1;
+
+		*packet = packet_new(recorded->num_bytes);
+		memcpy((*packet)->buffer, recorded->bytes, recorded->num_bytes);
+		result = parse_packet(*packet, recorded->num_bytes,
+				      PACKET_LAYER_3_IP, error);
+		if (result == PACKET_OK) {
+			(*packet)->time_usecs = recorded->time_usecs;
+			return STATUS_OK;
+		}
+
+		packet_free(*packet);
+		*packet = NULL;
+
+		if (result == PACKET_BAD)
+			return STATUS_ERR;
+
+		DEBUGP("parse_result:%d; error parsing packet: %s\n",
+		       result, *error);
+	}
+
+	assert(!"should not be reached");
+	return STATUS_ERR;	/* not reached */
+}
+
+struct netdev_ops replay_netdev_ops = {
+	.free = replay_netdev_free,
+	.send = replay_netdev_send,
+	.receive = replay_netdev_receive,
+};
+
+bool replay_is_active(void)
+{
+	return replay != NULL;
+}
+
+s64 replay_start_usecs(void)
+{
+	return replay->start_usecs;
+}
+
+s64 replay_now_usecs(void)
+{
+	return replay_clock;
+}
+
+void replay_set_clock(s64 usecs)
+{
+	if (usecs <= replay_clock)
+		return;
+	replay_clock = usecs;
+	if (pthread_cond_broadcast(&replay_clock_changed) != 0)
+		die_perror("pthread_cond_broadcast");
+}
+
+void replay_wait_clock(pthread_mutex_t *mutex)
+{
+	if (pthread_cond_wait(&replay_clock_changed, mutex) != 0)
+		die_perror("pthread_cond_wait");
+}
+
+const struct pcapng_syscall *replay_syscall(int line)
+{
+	int i;
+
+	for (i = 0; i < replay->num_syscalls; ++i) {
+		struct replay_syscall *syscall = &replay->syscalls[i];
+
+		if (!syscall->is_used && syscall->syscall.line == line) {
+			syscall->is_used = true;
+			return &syscall->syscall;
+		}
+	}
+	return NULL;
+}
+
+bool replay_random(u64 *value)
+{
+	if (replay == NULL)
+		return false;
+	if (replay->next_random == replay->num_randoms)
+		die("--replay: drawing more random numbers than the trace "
+		    "has\n");
+	*value = replay->randoms[replay->next_random++];
+	return true;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Network device for --replay, which reruns a script against a trace
+ * recorded with --pcap_out instead of against a kernel.
+ *
+ * Sniffing returns the packets the kernel sent in the recorded run, in
+ * order and with their recorded times. Injecting a packet checks that
+ * it is the one the recorded run injected at that point. System calls
+ * are not made; run_system_call.c checks the recorded results against
+ * the script instead and keeps its socket bookkeeping as usual.
+ *
+ * Time is virtual: now_usecs() returns the replay clock, which jumps
+ * forward to each event's time and each sniffed packet's time, so a
+ * replay does no real-time waits. Random numbers the harness draws
+ * come from the trace too. Since replays need no root, tun device, or
+ * kernel, many can run in parallel as a quick check of harness logic.
+ *
+ * There is one replay per process, since the clock and the random
+ * numbers are global.
+ */
+
+#ifndef __REPLAY_NETDEV_H__
+#define __REPLAY_NETDEV_H__
+
+#include "types.h"
+
+#include <pthread.h>
+#include "config.h"
+#include "netdev.h"
+#include "pcapng.h"
+
+/* Load the trace at config->replay_path and return a netdev that
+ * replays it. Dies if the trace cannot be read.
+ */
+extern struct netdev *replay_netdev_new(struct config *config);
+
+/* Are we replaying a trace? */
+extern bool replay_is_active(void);
+
+/* Return the live start time of the recorded script. */
+extern s64 replay_start_usecs(void);
+
+/* Return the current time on the replay clock. */
+extern s64 replay_now_usecs(void);
+
+/* Move the replay clock forward to the given time, if it is later, and
+ * wake threads waiting for the clock. Callers hold the mutex that
+ * waiters pass to replay_wait_clock().
+ */
+extern void replay_set_clock(s64 usecs);
+
+/* Wait for the replay clock to move. Called with the given mutex
+ * held, which is released while we wait.
+ */
+extern void replay_wait_clock(pthread_mutex_t *mutex);
+
+/* Return the recorded outcome of the system call at the given script
+ * line, or NULL if the trace has none. Each outcome is returned once.
+ */
+extern const struct pcapng_syscall *replay_syscall(int line);
+
+/* If we are replaying, set *value to the next random number the
+ * recorded run drew and return true.
+ */
+extern bool replay_random(u64 *value);
+
+#endif /* __REPLAY_NETDEV_H__ */
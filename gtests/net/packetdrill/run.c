@@ -35,11 +35,20 @@
 #include <sys/socket.h>
 #include <sys/times.h>
 #include <unistd.h>
+#include "event_stream.h"
+#include "flight_recorder.h"
+#include "io_uring_ring.h"
 #include "ip.h"
 #include "logging.h"
 #include "netdev.h"
+#include "open_memstream.h"
 #include "wire_client_netdev.h"
+#include "xdp_netdev.h"
 #include "parse.h"
+#include "pcapng_writer.h"
+#include "perf_counters.h"
+#include "probes.h"
+#include "replay_netdev.h"
 #include "run_command.h"
 #include "run_packet.h"
 #include "run_system_call.h"
@@ -70,6 +79,7 @@ struct state *state_new(struct config *config,
 			struct netdev *netdev)
 {
 	struct state *state = calloc(1, sizeof(struct state));
+	int i;
 
 	if (pthread_mutex_init(&state->mutex, NULL) != 0)
 		die_perror("pthread_mutex_init");
@@ -83,6 +93,8 @@ struct state *state_new(struct config *config,
 	state->syscalls = syscalls_new(state);
 	state->code = code_new(config);
 	state->sockets = NULL;
+	for (i = 0; i < NUM_TOLERANCES; ++i)
+		state->tolerance_usecs[i] = config->tolerance_usecs;
 	return state;
 }
 
@@ -96,7 +108,8 @@ static void close_all_sockets(struct state *state)
 {
 	struct socket *socket = state->sockets;
 	while (socket != NULL) {
-		if (socket->live.fd >= 0 && !socket->is_closed) {
+		if (socket->live.fd >= 0 && !socket->is_closed &&
+		    !replay_is_active()) {
 			assert(socket->script.fd >= 0);
 			DEBUGP("closing struct state socket "
 			       "live.fd:%d script.fd:%d\n",
@@ -115,22 +128,64 @@ static void close_all_sockets(struct state *state)
 	}
 }
 
+/* The state of the running --fuzz case, for reset_fuzz_connections(). */
+static struct state *fuzz_state;
+
+/* Die hook for --fuzz cases: most mutated cases end when the kernel
+ * does not do what the script expects and we die, so reset their TCP
+ * connections then too, to keep them from disturbing later cases.
+ */
+static void reset_fuzz_connections(void)
+{
+	struct socket *socket;
+
+	for (socket = fuzz_state->sockets; socket != NULL;
+	     socket = socket->next) {
+		if (socket->protocol == IPPROTO_TCP)
+			reset_connection(fuzz_state, socket);
+	}
+}
+
+/* Close all non-socket fds the script left open and free their structs. */
+static void close_all_fds(struct state *state)
+{
+	struct fd_mapping *fd = state->fds;
+	while (fd != NULL) {
+		if (!fd->is_closed && !replay_is_active() &&
+		    close(fd->live_fd))
+			die_perror("close");
+#ifdef linux
+		io_uring_ring_free(fd->ring);
+#endif
+		struct fd_mapping *dead_fd = fd;
+		fd = fd->next;
+		free(dead_fd);
+	}
+	state->fds = NULL;
+}
+
 void state_free(struct state *state)
 {
 	/* We have to stop the system call thread first, since it's using
 	 * sockets that we want to close and reset.
 	 */
 	syscalls_free(state, state->syscalls);
+	if (state->perf != NULL)
+		perf_counters_free(state->perf);
 
 	/* Then we close the sockets and reset the connections, while
 	 * we still have a netdev for injecting reset packets to free
 	 * per-connection kernel state.
 	 */
 	close_all_sockets(state);
+	close_all_fds(state);
 
 	netdev_free(state->netdev);
+	if (state->pcapng != NULL)
+		pcapng_writer_free(state->pcapng);
 	packets_free(state->packets);
 	code_free(state->code);
+	free(state->cpu_affinity);
 
 	run_unlock(state);
 	if (pthread_mutex_destroy(&state->mutex) != 0)
@@ -143,6 +198,8 @@ void state_free(struct state *state)
 s64 now_usecs(void)
 {
 	struct timeval tv;
+	if (replay_is_active())
+		return replay_now_usecs();
 	if (gettimeofday(&tv, NULL) < 0)
 		die_perror("gettimeofday");
 	return timeval_to_usecs(&tv);
@@ -157,6 +214,7 @@ s64 now_usecs(void)
  * checking.
  */
 int verify_time(struct state *state, enum event_time_t time_type,
+		enum tolerance_t tolerance,
 		s64 script_usecs, s64 script_usecs_end,
 		s64 live_usecs, const char *description, char **error)
 {
@@ -164,7 +222,7 @@ int verify_time(struct state *state, enum event_time_t time_type,
 	s64 expected_usecs_end = script_usecs_end -
 		state->script_start_time_usecs;
 	s64 actual_usecs = live_usecs - state->live_start_time_usecs;
-	int tolerance_usecs = state->config->tolerance_usecs;
+	int tolerance_usecs = state->tolerance_usecs[tolerance];
 
 	DEBUGP("expected: %.3f actual: %.3f  (secs)\n",
 	       usecs_to_secs(script_usecs), usecs_to_secs(actual_usecs));
@@ -246,6 +304,8 @@ static const char *event_description(struct event *event)
 		return "command";
 	case CODE_EVENT:
 		return "data collection for code";
+	case PACING_EVENT:
+		return "pacing";
 	case INVALID_EVENT:
 	case NUM_EVENT_TYPES:
 		assert(!"bogus type");
@@ -261,6 +321,7 @@ void check_event_time(struct state *state, s64 live_usecs)
 	const char *description = event_description(state->event);
 	if (verify_time(state,
 			state->event->time_type,
+			TOLERANCE_EVENT,
 			state->event->time_usecs,
 			state->event->time_usecs_end, live_usecs,
 			description, &error)) {
@@ -298,15 +359,10 @@ void adjust_relative_event_times(struct state *state, struct event *event)
 	}
 }
 
-void wait_for_event(struct state *state)
+void sleep_until(struct state *state, s64 live_usecs)
 {
-	s64 event_usecs =
-		script_time_to_live_time_usecs(
-			state, state->event->time_usecs);
-	DEBUGP("waiting until %lld -- now is %lld\n",
-	       event_usecs, now_usecs());
 	while (1) {
-		const s64 wait_usecs = event_usecs - now_usecs();
+		const s64 wait_usecs = live_usecs - now_usecs();
 		if (wait_usecs <= 0)
 			break;
 
@@ -330,17 +386,59 @@ void wait_for_event(struct state *state)
 		 * two to wait, so we spin.
 		 */
 	}
+}
+
+void wait_for_event(struct state *state)
+{
+	s64 event_usecs =
+		script_time_to_live_time_usecs(
+			state, state->event->time_usecs);
+	DEBUGP("waiting until %lld -- now is %lld\n",
+	       event_usecs, now_usecs());
+	PROBE2(wait__start, state->event->line_number, event_usecs);
+	/* In a replay, time is virtual, so we move the clock instead. */
+	if (replay_is_active())
+		advance_replay_clock(state, event_usecs);
+	sleep_until(state, event_usecs);
+	PROBE2(wait__done, state->event->line_number, now_usecs());
+	if (state->perf != NULL)
+		perf_counters_mark(state->perf);
 
 	check_event_time(state, now_usecs());
 }
 
+/* Move state->event to the next event of the script, or the first
+ * one if state->event is NULL.
+ */
+static int advance_event(struct state *state, char **error)
+{
+	struct script *script = state->script;
+
+	if (script->stream != NULL) {
+		/* A blocking system call may still be using an older
+		 * event, so we only free events when none is running.
+		 */
+		return event_stream_next(script->stream,
+					 state->syscalls->state == SYSCALL_IDLE,
+					 &state->event, error);
+	}
+
+	if (state->event == NULL)
+		state->event = script->event_list;
+	else
+		state->event = state->event->next;
+	return STATUS_OK;
+}
+
 int get_next_event(struct state *state, char **error)
 {
 	DEBUGP("gettimeofday: %.6f\n", now_usecs()/1000000.0);
 
 	if (state->event == NULL) {
 		/* First event. */
-		state->event = state->script->event_list;
+		if (advance_event(state, error))
+			return STATUS_ERR;
+		assert(state->event != NULL);
 		state->script_start_time_usecs = state->event->time_usecs;
 		if (state->event->time_usecs != 0) {
 			asprintf(error,
@@ -353,7 +451,8 @@ int get_next_event(struct state *state, char **error)
 		/* Move to the next event. */
 		state->script_last_time_usecs = state->event->time_usecs;
 		state->last_event = state->event;
-		state->event = state->event->next;
+		if (advance_event(state, error))
+			return STATUS_ERR;
 	}
 
 	if (state->event == NULL)
@@ -430,6 +529,111 @@ void set_scheduling_priority(void)
 #endif  /* !defined(__OpenBSD__) */
 }
 
+/* Pin the given thread to the given CPU, unless the CPU is -1. A test
+ * whose threads the scheduler migrates between CPUs pays for cold
+ * caches and for waiting on busy CPUs, which shows up as timing
+ * errors. The option is the name of the option giving the CPU.
+ */
+static void pin_thread(pthread_t thread, int cpu, const char *option)
+{
+	if (cpu < 0)
+		return;
+#ifdef linux
+	cpu_set_t cpus;
+	int err;
+
+	if (cpu >= CPU_SETSIZE)
+		die("--%s: bad CPU: %d\n", option, cpu);
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	err = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+	if (err != 0)
+		die("--%s=%d: pthread_setaffinity_np: %s\n",
+		    option, cpu, strerror(err));
+#else
+	die("--%s is only supported on Linux\n", option);
+#endif
+}
+
+/* Print the CPUs the given thread may run on, e.g. "0-3,6". */
+static void print_thread_cpus(pthread_t thread, FILE *f)
+{
+#ifdef linux
+	cpu_set_t cpus;
+	int cpu, first = -1;
+	const char *separator = "";
+
+	if (pthread_getaffinity_np(thread, sizeof(cpus), &cpus) != 0) {
+		fprintf(f, "?");
+		return;
+	}
+	for (cpu = 0; cpu <= CPU_SETSIZE; ++cpu) {
+		bool is_set = cpu < CPU_SETSIZE && CPU_ISSET(cpu, &cpus);
+
+		if (is_set && first < 0) {
+			first = cpu;
+		} else if (!is_set && first >= 0) {
+			fprintf(f, "%s%d", separator, first);
+			if (cpu - 1 > first)
+				fprintf(f, "-%d", cpu - 1);
+			separator = ",";
+			first = -1;
+		}
+	}
+#else
+	fprintf(f, "any");
+#endif
+}
+
+/* Pin our threads to the CPUs the config asks for, and note where
+ * each of our threads may run. With --stream, the parser thread
+ * already runs before we get here, and we leave it to the scheduler:
+ * it only works ahead of the run loop, so it is not timing critical,
+ * and pinning it next to either of ours would take time from a thread
+ * that is. The same goes for the pcapng writer thread, which we start
+ * before we pin the main thread so it keeps the CPUs we started with.
+ */
+static void pin_threads(struct state *state)
+{
+	const struct config *config = state->config;
+	char *unpinned = NULL;
+	size_t bytes = 0;
+	FILE *f = NULL;
+
+	f = open_memstream(&unpinned, &bytes);
+	print_thread_cpus(pthread_self(), f);
+	fclose(f);
+
+	pin_thread(pthread_self(), config->main_cpu, "main_cpu");
+	pin_thread(state->syscalls->thread, config->syscall_cpu,
+		   "syscall_cpu");
+
+	f = open_memstream(&state->cpu_affinity, &bytes);
+	fprintf(f, "main ");
+	print_thread_cpus(pthread_self(), f);
+	fprintf(f, ", syscall ");
+	print_thread_cpus(state->syscalls->thread, f);
+	if (state->pcapng != NULL) {
+		fprintf(f, ", pcap writer ");
+		print_thread_cpus(pcapng_writer_thread(state->pcapng), f);
+	}
+	if (state->script->stream != NULL)
+		fprintf(f, ", parser %s", unpinned);
+	if (config->net_cpu >= 0)
+		fprintf(f, ", net %d", config->net_cpu);
+	else
+		fprintf(f, ", net any");
+	fclose(f);
+	free(unpinned);
+}
+
+/* Print where our threads and our packet processing may run. */
+static void print_cpu_affinity(struct state *state, FILE *f)
+{
+	fprintf(f, "cpu affinity for %s: %s\n",
+		state->config->script_path, state->cpu_affinity);
+}
+
 /* To ensure timing that's as consistent as possible, pull all our
  * pages to RAM and pin them there.
  */
@@ -481,18 +685,8 @@ static s64 schedule_start_time_usecs(void)
 #endif
 }
 
-void run_script(struct config *config, struct script *script)
+struct netdev *script_netdev_new(struct config *config)
 {
-	char *error = NULL;
-	struct state *state = NULL;
-	struct netdev *netdev = NULL;
-	struct event *event = NULL;
-
-	DEBUGP("run_script: running script\n");
-
-	set_scheduling_priority();
-	lock_memory();
-
 	/* This interpreter loop runs for local mode or wire client mode. */
 	assert(!config->is_wire_server);
 
@@ -500,18 +694,47 @@ void run_script(struct config *config, struct script *script)
 	 * each of the two cases....
 	 */
 	if (config->is_wire_client)
-		netdev = wire_client_netdev_new(config);
+		return wire_client_netdev_new(config);
+	else if (config->replay_path != NULL)
+		return replay_netdev_new(config);
+	else if (config->use_xdp)
+		return xdp_netdev_new(config);
 	else
-		netdev = local_netdev_new(config);
+		return local_netdev_new(config);
+}
+
+void run_script(struct config *config, struct script *script,
+		struct netdev *netdev)
+{
+	char *error = NULL;
+	struct state *state = NULL;
+	struct event *event = NULL;
+
+	DEBUGP("run_script: running script\n");
+
+	/* A replay has no real-time waits and needs no privileges. */
+	if (config->replay_path == NULL) {
+		set_scheduling_priority();
+		lock_memory();
+	}
 
 	state = state_new(config, script, netdev);
+	if (config->pcap_out_path != NULL)
+		state->pcapng = pcapng_writer_new(config->pcap_out_path);
+	pin_threads(state);
+	if (config->fuzz_cases > 0) {
+		fuzz_state = state;
+		set_die_hook(reset_fuzz_connections);
+	}
+	if (config->perf_counters)
+		state->perf = perf_counters_new();
 
 	if (config->is_wire_client) {
 		state->wire_client = wire_client_new();
 		wire_client_init(state->wire_client, config, script, state);
 	}
 
-	if (script->init_command != NULL) {
+	if (script->init_command != NULL && config->replay_path == NULL) {
 		if (safe_system(script->init_command->command_line,
 				&error)) {
 			die("%s: error executing init command: %s\n",
@@ -521,9 +744,19 @@ void run_script(struct config *config, struct script *script)
 
 	signal(SIGPIPE, SIG_IGN);	/* ignore EPIPE */
 
-	state->live_start_time_usecs = schedule_start_time_usecs();
+	if (config->calibrate)
+		calibrate_tolerances(state);
+
+	if (config->replay_path != NULL)
+		state->live_start_time_usecs = replay_start_usecs();
+	else
+		state->live_start_time_usecs = schedule_start_time_usecs();
 	DEBUGP("live_start_time_usecs is %lld\n",
 	       state->live_start_time_usecs);
+	if (state->pcapng != NULL)
+		pcapng_writer_start(state->pcapng,
+				    state->live_start_time_usecs);
+	flight_recorder_start(state->live_start_time_usecs);
 
 	if (state->wire_client != NULL)
 		wire_client_send_client_starting(state->wire_client);
@@ -544,6 +777,10 @@ void run_script(struct config *config, struct script *script)
 		 */
 		adjust_relative_event_times(state, event);
 
+		PROBE3(event__start, event->line_number, event->type,
+		       event->time_usecs);
+		flight_record_event(event->line_number, event->type,
+				    event->time_usecs);
 		switch (event->type) {
 		case PACKET_EVENT:
 			/* For wire clients, the server handles packets. */
@@ -564,12 +801,19 @@ void run_script(struct config *config, struct script *script)
 			run_code_event(state, event,
 				       event->event.code->text);
 			break;
+		case PACING_EVENT:
+			run_pacing_event(state, event,
+					 event->event.pacing);
+			break;
 		case INVALID_EVENT:
 		case NUM_EVENT_TYPES:
 			assert(!"bogus type");
 			break;
 		/* We omit default case so compiler catches missing values. */
 		}
+		PROBE2(event__done, event->line_number, event->type);
+		if (state->perf != NULL)
+			perf_counters_charge(state->perf, event);
 	}
 
 	/* Wait for any outstanding packet events we requested on the server. */
@@ -583,7 +827,14 @@ void run_script(struct config *config, struct script *script)
 	}
 	free_mp_state();
 
+	if (config->main_cpu >= 0 || config->syscall_cpu >= 0 ||
+	    config->net_cpu >= 0 || config->verbose)
+		print_cpu_affinity(state, stdout);
+	if (state->perf != NULL)
+		perf_counters_print(state->perf, config->script_path, stdout);
+	set_die_hook(NULL);	/* state_free() resets the connections */
 	state_free(state);
+	script_free(script);
 
 	DEBUGP("run_script: done running\n");
 }
@@ -60,6 +60,7 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <sys/socket.h>
+#include "calibrate.h"
 #include "code.h"
 #include "config.h"
 #include "netdev.h"
@@ -69,9 +70,15 @@
 #include "socket.h"
 #include "wire_client.h"
 
-/* Public top-level entry point for executing a test script */
+/* Create the network device to run scripts with the given config. */
+extern struct netdev *script_netdev_new(struct config *config);
+
+/* Public top-level entry point for executing a test script against
+ * the given network device, which it frees when done.
+ */
 extern void run_script(struct config *config,
-		       struct script *script);
+		       struct script *script,
+		       struct netdev *netdev);
 
 /* Public entry-point to parse a script and finalize config. If the
  * script_buffer is provided, parse that. Otherwise, read the file
@@ -85,6 +92,9 @@ extern int parse_script_and_set_config(int argc, char *argv[],
 
 /* Private implementation details follow below... */
 
+struct pcapng_writer;
+struct perf_counters;
+
 /* All the runtime state for a test. */
 struct state {
 	pthread_mutex_t mutex;		/* global lock for all global state */
@@ -93,6 +103,7 @@ struct state {
 	struct packets *packets;	/* for processing packets */
 	struct syscalls *syscalls;	/* for running system calls */
 	struct socket *sockets;		/* list of all live sockets */
+	struct fd_mapping *fds;		/* list of all other live fds */
 	struct socket *socket_under_test;	/* socket handling packets */
 	struct script *script;			/* script we're running */
 	struct event *event;			/* the current event */
@@ -102,6 +113,14 @@ struct state {
 	s64 script_start_time_usecs;	/* time of first event in script */
 	s64 script_last_time_usecs;	/* time of previous event in script */
 	s64 live_start_time_usecs;	/* time of first event in live test */
+	bool is_pacing;			/* is a pacing assertion active? */
+	struct pacing_spec pacing;	/* copy of current pacing assertion */
+	s64 pacing_last_usecs;		/* live time of last paced packet */
+	int pacing_last_bytes;		/* IP length of last paced packet */
+	struct perf_counters *perf;	/* kernel cost counters, or NULL */
+	struct pcapng_writer *pcapng;	/* capture for --pcap_out, or NULL */
+	char *cpu_affinity;		/* where our threads may run */
+	int tolerance_usecs[NUM_TOLERANCES];	/* per kind of time */
 };
 
 /* Allocate all run-time state for executing a test script. */
@@ -157,8 +176,10 @@ static inline s64 live_time_to_script_time_usecs(struct state *state,
  * for the common case: it looks at the current event and on failure
  * it prints the error message to stderr and exits with an error
  * status.  For time ranges the end time is specified in script_usecs_end.
+ * The tolerance says which of state->tolerance_usecs[] applies.
  */
 extern int verify_time(struct state *state, enum event_time_t time_type,
+		       enum tolerance_t tolerance,
 		       s64 script_usecs, s64 script_usecs_end,
 		       s64 live_usecs, const char *description, char **error);
 extern void check_event_time(struct state *state, s64 live_usecs);
@@ -169,6 +190,9 @@ extern void check_event_time(struct state *state, s64 live_usecs);
 extern void adjust_relative_event_times(struct state *state,
 					struct event *event);
 
+/* Sleep and/or spin until the given live time. */
+extern void sleep_until(struct state *state, s64 live_usecs);
+
 /*
  * Sleep and/or spin until the time at which we want the current event
  * to happen.
@@ -42,6 +42,10 @@ void run_command_event(
 	/* Wait for the right time before firing off this event. */
 	wait_for_event(state);
 
+	/* Commands act on the kernel, which a replay does not have. */
+	if (state->config->replay_path != NULL)
+		return;
+
 	char *error = NULL;
 	if (safe_system(command->command_line, &error))
 		goto error_out;
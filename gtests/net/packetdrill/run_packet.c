@@ -31,18 +31,23 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include "checksum.h"
+#include "flight_recorder.h"
 #include "gre.h"
 #include "logging.h"
 #include "netdev.h"
 #include "packet.h"
 #include "packet_checksum.h"
 #include "packet_to_string.h"
+#include "pcapng_writer.h"
+#include "probes.h"
+#include "replay_netdev.h"
 #include "run.h"
 #include "script.h"
 #include "tcp_options_iterator.h"
 #include "tcp_options_to_string.h"
 #include "tcp_packet.h"
 #include "utils.h"
+#include "verify_plan.h"
 #include "mptcp.h"
 
 /* To avoid issues with TIME_WAIT, FIN_WAIT1, and FIN_WAIT2 we use
@@ -278,6 +283,40 @@ static struct socket *find_socket_for_live_packet(
 	return NULL;
 }
 
+static bool is_listening_socket(struct socket *socket,
+		const struct packet *packet)
+{
+	return socket->state == SOCKET_PASSIVE_LISTENING;
+}
+
+/* Find a listening socket that could take the given inbound SYN. */
+static struct socket *find_listening_socket(struct state *state,
+		const struct packet *packet)
+{
+	return find_socket_matching_packet(state, packet, is_listening_socket);
+}
+
+/* Return true if the script packet is an inbound SYN that names, with
+ * sock(fd), a socket the script does not have yet. That is the fd a
+ * later accept() call will return for the connection it opens.
+ */
+static bool is_syn_naming_new_socket(struct state *state,
+		const struct packet *packet, enum direction_t direction)
+{
+	struct socket *socket = NULL;
+
+	if (direction != DIRECTION_INBOUND || state->config->is_wire_server ||
+	    !packet->tcp->syn || packet->tcp->ack ||
+	    packet->socket_script_fd == SOCKET_FD_NOT_DEFINED)
+		return false;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if (socket->script.fd == packet->socket_script_fd)
+			return false;
+	}
+	return true;
+}
+
 /* See if the socket under test is listening and is willing to receive
  * this incoming SYN packet. If so, create a new child socket, anoint
  * it as the new socket under test, and return a pointer to
@@ -294,11 +333,24 @@ static struct socket *handle_listen_for_script_packet(
 	 * see if the address tuples in the packet and socket match.)
 	 */
 	struct config *config = state->config;
-	//Search for a socket establishing a tcp connection
-	struct socket *socket = find_connecting_socket(state);
+	struct socket *socket = NULL;
+	int child_script_fd = -1;
 
-	if(!socket)
-		socket = find_socket_matching_packet_script_fd(state, packet);
+	if (is_syn_naming_new_socket(state, packet, direction)) {
+		/* The SYN names the fd that accept() will return for
+		 * it, so later packets of this connection find it by
+		 * fd even while other handshakes are in progress.
+		 */
+		socket = find_listening_socket(state, packet);
+		child_script_fd = packet->socket_script_fd;
+	} else {
+		//Search for a socket establishing a tcp connection
+		socket = find_connecting_socket(state);
+
+		if(!socket)
+			socket = find_socket_matching_packet_script_fd(state,
+								       packet);
+	}
 
 	bool match = (direction == DIRECTION_INBOUND);
 	if (!match)
@@ -335,7 +387,7 @@ static struct socket *handle_listen_for_script_packet(
 	socket->script.remote		= tuple.src;
 	socket->script.local		= tuple.dst;
 	socket->script.remote_isn	= ntohl(packet->tcp->seq);
-	socket->script.fd		= -1;
+	socket->script.fd		= child_script_fd;
 
 	/* Set up the live info for this socket based
 	 * on the script packet and our overall config.
@@ -895,9 +947,10 @@ static int verify_tcp(
 	    check_field("tcp_rst",
 			script_tcp->rst,
 			actual_tcp->rst, error) ||
-	    check_field("tcp_psh",
-			script_tcp->psh,
-			actual_tcp->psh, error) ||
+	    (script_packet->flags & FLAG_PSH_NOCHECK ? STATUS_OK :
+		check_field("tcp_psh",
+			    script_tcp->psh,
+			    actual_tcp->psh, error)) ||
 	    check_field("tcp_ack",
 			script_tcp->ack,
 			actual_tcp->ack, error) ||
@@ -1107,7 +1160,7 @@ bool same_mptcp_opt(struct tcp_option *opt_a, struct tcp_option *opt_b, struct p
 	return true;
 }
 /* Check if tcp options are identical (memcmp) */
-static bool same_tcp_options(struct packet *packet_a,
+bool same_tcp_options(struct packet *packet_a,
 		struct packet *packet_b)
 {
 
@@ -1116,32 +1169,29 @@ static bool same_tcp_options(struct packet *packet_a,
 		return false;
 	}
 
-	struct tcp_options_iterator iter_a, iter_b;
+	/* Look up options in packet_b by kind, and for MPTCP by subtype,
+	 * from its plan's index if it has one.
+	 */
+	struct tcp_options_index local_index;
+	const struct tcp_options_index *index = &local_index;
+	if (packet_b->verify_plan != NULL)
+		index = &packet_b->verify_plan->options;
+	else
+		tcp_options_index_build(packet_b, &local_index);
+
+	struct tcp_options_iterator iter_a;
 	struct tcp_option *opt_a = tcp_options_begin(packet_a, &iter_a);
-	struct tcp_option *opt_b = tcp_options_begin(packet_b, &iter_b);
+	struct tcp_option *opt_b = NULL;
 
 	//No assumption about options order
 	while(opt_a != NULL){
 
-		while(opt_b != NULL && opt_a->kind != opt_b->kind){
-			opt_b = tcp_options_next(&iter_b, NULL);
-		}
+		opt_b = tcp_options_index_find(packet_b, index, opt_a);
 		//opt_a not found in packet_b
 		if(opt_b == NULL){
 			return false;
 		}
 
-		// loop on subtypes of mptcp, to compare the right option
-		if(opt_a->kind == TCPOPT_MPTCP){
-
-			while(opt_b != NULL && opt_a->data.mp_capable.subtype!=opt_b->data.mp_capable.subtype)
-				opt_b = tcp_options_next(&iter_b, NULL);
-
-			//sub-option opt_a not found in packet_b
-			if(opt_b == NULL)
-				return false;
-		}
-
 		//NOP option only contains a kind field (not length)
 		if(opt_a->kind != TCPOPT_NOP){
 			if(opt_a->kind != TCPOPT_MPTCP){
@@ -1153,7 +1203,6 @@ static bool same_tcp_options(struct packet *packet_a,
 
 			}
 		}
-		opt_b = tcp_options_begin(packet_b, &iter_b);
 		opt_a = tcp_options_next(&iter_a, NULL);
 	}
 	return true;
@@ -1265,6 +1314,12 @@ static int verify_outbound_live_headers(
 		return STATUS_ERR;
 	}
 
+	/* Fast path: one masked compare of all the header bytes. */
+	if (script_packet->verify_plan != NULL &&
+	    verify_plan_match_headers(script_packet->verify_plan,
+				      script_packet, actual_packet))
+		return STATUS_OK;
+
 	/* Compare actual vs script headers, layer by layer. */
 	for (i = 0; i < ARRAY_SIZE(script_packet->headers); ++i) {
 		if (script_packet->headers[i].type == HEADER_NONE)
@@ -1344,6 +1399,45 @@ static int verify_outbound_live_payload(
 	return STATUS_OK;
 }
 
+/* If a pacing assertion is active, verify that the live packet left
+ * the expected gap after the previous outbound packet, and remember
+ * this packet as the start of the next gap.
+ */
+static int verify_pacing(struct state *state, struct packet *live_packet,
+			 char **error)
+{
+	const struct pacing_spec *pacing = &state->pacing;
+	s64 last_usecs = state->pacing_last_usecs;
+	int last_bytes = state->pacing_last_bytes;
+	s64 expected_usecs, actual_usecs;
+
+	if (!state->is_pacing)
+		return STATUS_OK;
+
+	state->pacing_last_usecs = live_packet->time_usecs;
+	state->pacing_last_bytes = live_packet->ip_bytes;
+
+	/* The first packet of a train only starts the clock. */
+	if (last_usecs < 0)
+		return STATUS_OK;
+
+	if (pacing->gap_usecs != NO_PACING_GAP)
+		expected_usecs = pacing->gap_usecs;
+	else
+		expected_usecs = (s64)last_bytes * 1000000 / pacing->rate;
+	actual_usecs = live_packet->time_usecs - last_usecs;
+
+	if (llabs(actual_usecs - expected_usecs) > pacing->tolerance_usecs) {
+		asprintf(error, "pacing error: expected %.6f sec gap "
+			 "(+/- %.6f) after previous packet but got %.6f sec",
+			 usecs_to_secs(expected_usecs),
+			 usecs_to_secs(pacing->tolerance_usecs),
+			 usecs_to_secs(actual_usecs));
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
 /* Verify that the outbound packet correctly matches the expected
  * outbound packet from the script.
  * Return STATUS_OK upon success.  If non_fatal_packet is unset in the
@@ -1403,13 +1497,20 @@ static int verify_outbound_live_packet(
 
 	/* Verify that kernel sent packet at the time the script expected. */
 	DEBUGP("packet time_usecs: %lld\n", live_packet->time_usecs);
-	if (verify_time(state, time_type, script_usecs,
+	if (!(script_packet->flags & FLAG_TIME_NOCHECK) &&
+	    verify_time(state, time_type, TOLERANCE_KERNEL, script_usecs,
 				script_usecs_end, live_packet->time_usecs,
 				"outbound packet", error)) {
 		non_fatal = true;
 		goto out;
 	}
 
+	/* Verify the gap since the previous packet of a paced train. */
+	if (verify_pacing(state, live_packet, error)) {
+		non_fatal = true;
+		goto out;
+	}
+
 	result = STATUS_OK;
 
 out:
@@ -1425,9 +1526,47 @@ out:
 	    state->config->non_fatal_packet) {
 		result = STATUS_WARN;
 	}
+	PROBE3(verify__outbound, state->event->line_number, result,
+	       live_packet->time_usecs);
 	return result;
 }
 
+void run_pacing_event(struct state *state, struct event *event,
+		      struct pacing_spec *pacing)
+{
+	DEBUGP("%d: pacing %s\n", event->line_number,
+	       pacing ? "on" : "off");
+
+	/* Keep a copy, since with --stream the event is freed while
+	 * the assertion is still in force.
+	 */
+	state->is_pacing = (pacing != NULL);
+	if (pacing != NULL)
+		state->pacing = *pacing;
+	state->pacing_last_usecs = -1;
+	state->pacing_last_bytes = 0;
+}
+
+/* Return true if the live outbound packet is one of the kernel's
+ * unscripted ACKs of the last inbound packet train on the socket.
+ * Any other packet ends the run of such ACKs.
+ */
+static bool skip_train_ack(struct socket *socket, struct packet *packet)
+{
+	const struct tcp *tcp = packet->tcp;
+
+	if (!socket->train_acks_pending || tcp == NULL)
+		return false;
+
+	if (tcp->ack && !tcp->syn && !tcp->fin && !tcp->rst &&
+	    packet_payload_len(packet) == 0 &&
+	    (s32)(ntohl(tcp->ack_seq) - socket->train_ack_end) < 0)
+		return true;
+
+	socket->train_acks_pending = false;
+	return false;
+}
+
 /* Sniff the next outbound live packet and return it. */
 static int sniff_outbound_live_packet(
 	struct state *state, struct socket *expected_socket,
@@ -1441,11 +1580,31 @@ static int sniff_outbound_live_packet(
 	while (1) {
 		if (netdev_receive(state->netdev, packet, error))
 			return STATUS_ERR;
+		/* In a replay, the packet arrives at its recorded time. */
+		if (replay_is_active())
+			advance_replay_clock(state, (*packet)->time_usecs);
+		PROBE3(netdev__receive,
+		       state->event ? state->event->line_number : 0,
+		       (*packet)->ip_bytes, (*packet)->time_usecs);
+		flight_record_packet(FLIGHT_SNIFF,
+				     state->event ? state->event->line_number : 0,
+				     *packet);
+		if (state->pcapng != NULL)
+			pcapng_writer_packet(state->pcapng, *packet,
+					     DIRECTION_OUTBOUND,
+					     state->event ?
+					     state->event->line_number : 0);
 		/* See if the packet matches an existing, known socket. */
 		socket = find_socket_for_live_packet(state, *packet,
 						     &direction);
-		if ((socket != NULL) && (direction == DIRECTION_OUTBOUND))
-			break;
+		if ((socket != NULL) && (direction == DIRECTION_OUTBOUND)) {
+			if (!skip_train_ack(socket, *packet))
+				break;
+			DEBUGP("skipping ACK of inbound packet train\n");
+			packet_free(*packet);
+			*packet = NULL;
+			continue;
+		}
 		/* See if the packet matches a recent connect() call. */
 		socket = find_connect_for_live_packet(state, *packet,
 						      &direction);
@@ -1481,6 +1640,62 @@ static bool is_script_packet_match_for_socket(
 	return false;
 }
 
+/* The most sockets for which we sniff only their own flows. */
+#define MAX_FILTER_SOCKETS	256
+
+void update_live_packet_filter(struct state *state)
+{
+	struct packet_socket_flow *flows = NULL;
+	struct socket *socket = NULL;
+	int num_flows = 0, num_sockets = 0, i;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next)
+		++num_sockets;
+	flows = calloc(num_sockets + 2, sizeof(*flows));
+
+	/* With many sockets, a filter with a check per flow would be
+	 * too long for the kernel and too slow to rebuild for each
+	 * packet, so we sniff every port and match sockets ourselves.
+	 */
+	if (num_sockets > MAX_FILTER_SOCKETS) {
+		flows[num_flows++].protocol = IPPROTO_TCP;
+		flows[num_flows++].protocol = IPPROTO_UDP;
+		goto out;
+	}
+
+	/* Any outbound packet we accept in sniff_outbound_live_packet()
+	 * goes to the live remote port of one of our sockets, and comes
+	 * from its live local port unless the socket is still learning
+	 * that port from its first SYN.
+	 */
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		struct packet_socket_flow flow;
+
+		if (socket->live.remote.port == 0 ||
+		    (socket->protocol != IPPROTO_TCP &&
+		     socket->protocol != IPPROTO_UDP))
+			continue;
+
+		memset(&flow, 0, sizeof(flow));
+		flow.protocol = socket->protocol;
+		flow.dst_port = socket->live.remote.port;
+		if (socket->state != SOCKET_ACTIVE_CONNECTING &&
+		    socket->state != SOCKET_ACTIVE_SYN_SENT)
+			flow.src_port = socket->live.local.port;
+
+		for (i = 0; i < num_flows; ++i) {
+			if (memcmp(&flows[i], &flow, sizeof(flow)) == 0)
+				break;
+		}
+		if (i == num_flows)
+			flows[num_flows++] = flow;
+	}
+
+out:
+	netdev_set_flow_filter(state->netdev, flows, num_flows);
+	free(flows);
+}
+
 /* Find or create a socket object matching the given packet. */
 static int find_or_create_socket_for_script_packet(
 	struct state *state, struct packet *packet,
@@ -1535,6 +1750,38 @@ static int find_or_create_socket_for_script_packet(
 	return STATUS_ERR;
 }
 
+/* Update the socket for an outbound packet sniffed for the given
+ * script packet, and verify the packet against it. Returns the
+ * result of verify_outbound_live_packet().
+ */
+static int handle_outbound_live_packet(
+	struct state *state, struct packet *packet,
+	struct socket *socket, struct packet *live_packet, char **error)
+{
+	if ((socket->state == SOCKET_PASSIVE_PACKET_RECEIVED) &&
+	    packet->tcp && packet->tcp->syn && packet->tcp->ack) {
+		socket->state = SOCKET_PASSIVE_SYNACK_SENT;
+		socket->live.local_isn = ntohl(live_packet->tcp->seq);
+		DEBUGP("SYNACK live.local_isn: %u\n",
+		       socket->live.local_isn);
+	}
+
+        if (packet->tcp->rst)
+                socket->state = SOCKET_RESET_RECEIVED;
+
+	verbose_packet_dump(state, "outbound sniffed", live_packet,
+			    live_time_to_script_time_usecs(
+				    state, live_packet->time_usecs));
+
+	/* Save the TCP header so we can reset the connection at the end. */
+	if (live_packet->tcp)
+		socket->last_outbound_tcp_header = *(live_packet->tcp);
+
+	/* Verify the bits the kernel sent were what the script expected. */
+	return verify_outbound_live_packet(
+			state, socket, packet, live_packet, error);
+}
+
 /* Perform the action implied by an outbound packet in a script
  * Return STATUS_OK upon success.  Without --use_expect, return STATUS_ERR
  * upon all failures.  With --use_expect, return STATUS_WARN upon non-fatal
@@ -1565,28 +1812,8 @@ static int do_outbound_script_packet(
 	if (sniff_outbound_live_packet(state, socket, &live_packet, error))
 		goto out;
 
-	if ((socket->state == SOCKET_PASSIVE_PACKET_RECEIVED) &&
-	    packet->tcp && packet->tcp->syn && packet->tcp->ack) {
-		socket->state = SOCKET_PASSIVE_SYNACK_SENT;
-		socket->live.local_isn = ntohl(live_packet->tcp->seq);
-		DEBUGP("SYNACK live.local_isn: %u\n",
-		       socket->live.local_isn);
-	}
-
-        if (packet->tcp->rst)
-                socket->state = SOCKET_RESET_RECEIVED;
-
-	verbose_packet_dump(state, "outbound sniffed", live_packet,
-			    live_time_to_script_time_usecs(
-				    state, live_packet->time_usecs));
-
-	/* Save the TCP header so we can reset the connection at the end. */
-	if (live_packet->tcp)
-		socket->last_outbound_tcp_header = *(live_packet->tcp);
-
-	/* Verify the bits the kernel sent were what the script expected. */
-	result = verify_outbound_live_packet(
-			state, socket, packet, live_packet, error);
+	result = handle_outbound_live_packet(state, packet, socket,
+					     live_packet, error);
 
 out:
 	if (live_packet != NULL)
@@ -1595,7 +1822,7 @@ out:
 }
 
 /* Checksum the packet and inject it into the kernel under test. */
-static int send_live_ip_packet(struct netdev *netdev,
+static int send_live_ip_packet(struct state *state,
 			       struct packet *packet)
 {
 	assert(packet->ip_bytes > 0);
@@ -1607,7 +1834,16 @@ static int send_live_ip_packet(struct netdev *netdev,
 	/* Fill in layer 3 and layer 4 checksums */
 	checksum_packet(packet);
 
-	return netdev_send(netdev, packet);
+	PROBE2(netdev__send, state->event ? state->event->line_number : 0,
+	       packet->ip_bytes);
+	flight_record_packet(FLIGHT_INJECT,
+			     state->event ? state->event->line_number : 0,
+			     packet);
+	if (state->pcapng != NULL)
+		pcapng_writer_packet(state->pcapng, packet, DIRECTION_INBOUND,
+				     state->event ?
+				     state->event->line_number : 0);
+	return netdev_send(state->netdev, packet);
 }
 
 /* Perform the action implied by an inbound packet in a script */
@@ -1648,13 +1884,169 @@ static int do_inbound_script_packet(
 	}
 
 	/* Inject live packet into kernel. */
-	result = send_live_ip_packet(state->netdev, live_packet);
+	result = send_live_ip_packet(state, live_packet);
 
 out:
 	packet_free(live_packet);
 	return result;
 }
 
+/* Return a copy of the given packet train's segment that starts
+ * offset bytes into the train and carries len bytes of payload.
+ */
+static struct packet *packet_train_segment(struct packet *train,
+					   u32 offset, u16 len)
+{
+	struct packet *segment = packet_copy(train);
+
+	segment->train_bytes = 0;
+	segment->train_mss = 0;
+	segment->tcp->seq = htonl(ntohl(train->tcp->seq) + offset);
+	packet_trim_payload(segment, packet_payload_len(segment) - len);
+	return segment;
+}
+
+/* Inject the peer's ACK of an outbound train up to the given script
+ * sequence number, so the kernel can keep the train going.
+ */
+static int ack_outbound_train(struct state *state, struct packet *train,
+			      struct socket *socket, u32 ack_sequence,
+			      char **error)
+{
+	struct packet *packet = NULL;
+	int result = STATUS_ERR;
+
+	packet = new_tcp_packet(train->socket_script_fd,
+				train->ipv4 ? AF_INET : AF_INET6,
+				DIRECTION_INBOUND, ECN_NONE, ".",
+				ntohl(train->tcp->ack_seq), 0, ack_sequence,
+				ntohs(socket->last_injected_tcp_header.window),
+				NULL, error);
+	if (packet == NULL)
+		return STATUS_ERR;
+
+	result = do_inbound_script_packet(state, packet, socket, error);
+	packet_free(packet);
+	return result;
+}
+
+/* Sniff the next outbound segment of a train that has sent offset
+ * of its bytes, and verify it as a piece of the train. With TSO the
+ * kernel sends a train as GSO packets of whatever size cwnd allows,
+ * so any segment that starts at offset and ends inside the train
+ * will do. On success sets *len to the segment's payload length.
+ */
+static int do_outbound_train_segment(
+	struct state *state, struct packet *packet,
+	struct socket *socket, u32 offset, u32 *len, char **error)
+{
+	struct packet *live_packet = NULL;
+	struct packet *segment = NULL;
+	int result = STATUS_ERR;
+	u32 seq;
+
+	if (sniff_outbound_live_packet(state, socket, &live_packet, error))
+		return STATUS_ERR;
+
+	seq = ntohl(live_packet->tcp->seq) +
+	      local_seq_live_to_script_offset(socket, false);
+	*len = packet_payload_len(live_packet);
+	if (seq != ntohl(packet->tcp->seq) + offset ||
+	    *len == 0 || *len > packet->train_bytes - offset) {
+		asprintf(error, "outbound segment %u:%u(%u) is not the "
+			 "next piece of train %u:%u(%u)",
+			 seq, seq + *len, *len,
+			 ntohl(packet->tcp->seq),
+			 ntohl(packet->tcp->seq) + packet->train_bytes,
+			 packet->train_bytes);
+		goto out;
+	}
+
+	segment = packet_train_segment(packet, offset, *len);
+	segment->flags |= FLAG_PSH_NOCHECK;
+	if (offset > 0)
+		segment->flags |= FLAG_TIME_NOCHECK;
+	verify_plan_free(segment->verify_plan);
+	segment->verify_plan = verify_plan_new(segment);
+	result = handle_outbound_live_packet(state, segment, socket,
+					     live_packet, error);
+	packet_free(segment);
+
+out:
+	packet_free(live_packet);
+	return result;
+}
+
+/* Run a script packet that stands for a whole train of segments.
+ * Outbound segments are sniffed, verified, and ACKed as they go;
+ * their PSH bits are not checked, and only the first one is held
+ * to the event time. Inbound segments are injected back to back,
+ * one MSS-sized segment at a time, and the kernel's ACKs of all but
+ * the end of the train are skipped when sniffing. A non-fatal
+ * failure does not stop the train; the first one is reported once
+ * the whole train has run.
+ */
+static int do_script_packet_train(
+	struct state *state, struct packet *packet,
+	struct socket *socket, char **error)
+{
+	enum direction_t direction = packet_direction(packet);
+	u32 start = ntohl(packet->tcp->seq);
+	u32 offset = 0;
+	char *warning = NULL;
+	int result = STATUS_OK;
+
+	while (offset < packet->train_bytes) {
+		char *err = NULL;
+		u32 len;
+
+		if (direction == DIRECTION_OUTBOUND) {
+			result = do_outbound_train_segment(state, packet,
+							   socket, offset,
+							   &len, &err);
+			if (result != STATUS_ERR &&
+			    ack_outbound_train(state, packet, socket,
+					       start + offset + len,
+					       error)) {
+				free(err);
+				free(warning);
+				return STATUS_ERR;
+			}
+		} else {
+			struct packet *segment;
+
+			len = min(packet->train_mss,
+				  packet->train_bytes - offset);
+			segment = packet_train_segment(packet, offset, len);
+			result = do_inbound_script_packet(state, segment,
+							  socket, &err);
+			packet_free(segment);
+		}
+		if (result == STATUS_ERR) {
+			free(warning);
+			*error = err;
+			return STATUS_ERR;
+		}
+		if (result == STATUS_WARN && warning == NULL)
+			warning = err;
+		else
+			free(err);
+		offset += len;
+	}
+
+	if (direction == DIRECTION_INBOUND) {
+		socket->train_acks_pending = true;
+		socket->train_ack_end =
+			ntohl(socket->last_injected_tcp_header.seq) +
+			socket->last_injected_tcp_payload_len;
+	}
+	if (warning != NULL) {
+		*error = warning;
+		return STATUS_WARN;
+	}
+	return STATUS_OK;
+}
+
 int run_packet_event(
 	struct state *state, struct event *event, struct packet *packet,
 	char **error)
@@ -1674,19 +2066,33 @@ int run_packet_event(
 
 	assert(socket != NULL);
 
+	/* Pick up any new ports before the kernel can answer. */
+	update_live_packet_filter(state);
+
 	if (direction == DIRECTION_OUTBOUND) {
 		/* We don't wait for outbound event packets because we
 		 * want to start sniffing ASAP in order to see if
 		 * packets go out earlier than the script specifies.
 		 */
-		result = do_outbound_script_packet(state, packet, socket, &err);
+		if (packet->train_bytes > 0)
+			result = do_script_packet_train(state, packet, socket,
+							&err);
+		else
+			result = do_outbound_script_packet(state, packet,
+							   socket, &err);
 		if (result == STATUS_WARN)
 			goto out;
 		else if (result == STATUS_ERR)
 			goto out;
 	} else if (direction == DIRECTION_INBOUND) {
 		wait_for_event(state);
-		if (do_inbound_script_packet(state, packet, socket, &err))
+		if (packet->train_bytes > 0)
+			result = do_script_packet_train(state, packet, socket,
+							&err);
+		else
+			result = do_inbound_script_packet(state, packet,
+							  socket, &err);
+		if (result != STATUS_OK)
 			goto out;
 	} else {
 		assert(!"bad direction");  /* internal bug */
@@ -1758,7 +2164,7 @@ int reset_connection(struct state *state, struct socket *socket)
 	set_packet_tuple(packet, &live_inbound);
 
 	/* Inject live packet into kernel. */
-	result = send_live_ip_packet(state->netdev, packet);
+	result = send_live_ip_packet(state, packet);
 
 	packet_free(packet);
 
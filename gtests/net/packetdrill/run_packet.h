@@ -54,6 +54,25 @@ extern int run_packet_event(struct state *state,
 			    struct packet *packet,
 			    char **error);
 
+/* Start checking the departure gaps of the outbound packets that
+ * follow against the given pacing assertion, or stop checking if
+ * pacing is NULL.
+ */
+extern void run_pacing_event(struct state *state,
+			     struct event *event,
+			     struct pacing_spec *pacing);
+
+/* Narrow the packets the netdev sniffs to the live flows of our
+ * sockets. Call this whenever a socket learns a new live port.
+ */
+extern void update_live_packet_filter(struct state *state);
+
+/* Return true iff the two packets have the same TCP options, in any
+ * order. MPTCP options are compared field by field.
+ */
+extern bool same_tcp_options(struct packet *packet_a,
+			     struct packet *packet_b);
+
 /* Inject a TCP RST packet to clear the connection state out of the kernel. */
 extern int reset_connection(struct state *state,
 			    struct socket *socket);
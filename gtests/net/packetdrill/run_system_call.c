@@ -35,15 +35,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#ifdef linux
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#endif
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include "flight_recorder.h"
+#include "io_uring_ring.h"
 #include "logging.h"
+#include "perf_counters.h"
+#include "pcapng_writer.h"
+#include "probes.h"
+#include "replay_netdev.h"
 #include "run.h"
 #include "script.h"
+#include "sock_diag_query.h"
+
+/* The largest cmsg_data we expect the kernel to return to a script:
+ * a sock_extended_err followed by the offending sockaddr.
+ */
+#define MAX_CMSG_DATA_LEN	64
 
 static int to_live_fd(struct state *state, int script_fd, int *live_fd,
 		      char **error);
@@ -232,6 +250,30 @@ static int s32_bracketed_arg(struct expression_list *args,
 	return get_s32(list->expression, value, error);
 }
 
+/* Get an optional file offset argument: either ... for a NULL offset
+ * pointer, or [<integer>] for a pointer to the given offset. Returns
+ * STATUS_OK on success; on failure returns STATUS_ERR and sets error
+ * message.
+ */
+static int offset_arg(struct expression_list *args, int index,
+		      off_t *offset, off_t **offset_ptr, char **error)
+{
+	struct expression *expression = get_arg(args, index, error);
+	s32 value;
+
+	if (expression == NULL)
+		return STATUS_ERR;
+	if (expression->type == EXPR_ELLIPSIS) {
+		*offset_ptr = NULL;
+		return STATUS_OK;
+	}
+	if (s32_bracketed_arg(args, index, &value, error))
+		return STATUS_ERR;
+	*offset = value;
+	*offset_ptr = offset;
+	return STATUS_OK;
+}
+
 /* Return STATUS_OK iff the argument with the given index is an
  * ellipsis (...).
  */
@@ -371,7 +413,19 @@ static int msghdr_new(struct expression *expression,
 		msg->msg_flags = s32_val;
 	}
 
-	/* TODO(ncardwell): msg_control, msg_controllen */
+	/* The script lists the control messages it expects to receive,
+	 * so we only need a buffer big enough to hold that many.
+	 */
+	if (msg_expr->msg_control != NULL) {
+		int num_cmsgs;
+
+		if (check_type(msg_expr->msg_control, EXPR_LIST, error))
+			goto error_out;
+		num_cmsgs =
+			expression_list_length(msg_expr->msg_control->value.list);
+		msg->msg_controllen = num_cmsgs * CMSG_SPACE(MAX_CMSG_DATA_LEN);
+		msg->msg_control = calloc(1, msg->msg_controllen);
+	}
 
 	status = STATUS_OK;
 
@@ -380,6 +434,243 @@ error_out:
 	return status;
 }
 
+/* Check that an integer field of a struct the kernel filled in has
+ * the value the script expected; a ... in the script matches any
+ * value. Returns STATUS_OK on success; on failure returns STATUS_ERR
+ * and sets error message.
+ */
+static int check_int_field(struct expression *expression, s64 actual,
+			   const char *name, int index, char **error)
+{
+	if (expression->type == EXPR_ELLIPSIS)
+		return STATUS_OK;
+	if (check_type(expression, EXPR_INTEGER, error))
+		return STATUS_ERR;
+	if (expression->value.num != actual) {
+		asprintf(error, "Expected %s %lld but got %lld for cmsg %d",
+			 name, (long long)expression->value.num,
+			 (long long)actual, index);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* Check the payload of a received control message against the
+ * cmsg_data the script expected.
+ */
+static int cmsg_data_check(struct expression *expression,
+			   struct cmsghdr *cmsg, int index, char **error)
+{
+	size_t data_len = cmsg->cmsg_len - CMSG_LEN(0);
+
+	switch (expression->type) {
+	case EXPR_ELLIPSIS:
+		return STATUS_OK;
+	case EXPR_INTEGER: {
+		int value;
+
+		if (data_len < sizeof(value)) {
+			asprintf(error, "cmsg %d data too short for an integer",
+				 index);
+			return STATUS_ERR;
+		}
+		memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+		return check_int_field(expression, value, "cmsg_data",
+				       index, error);
+	}
+#ifdef linux
+	case EXPR_SOCK_EXTENDED_ERR: {
+		struct sock_extended_err_expr *ee_expr =
+			expression->value.sock_extended_err;
+		struct sock_extended_err ee;
+
+		if (data_len < sizeof(ee)) {
+			asprintf(error,
+				 "cmsg %d data too short for sock_extended_err",
+				 index);
+			return STATUS_ERR;
+		}
+		memcpy(&ee, CMSG_DATA(cmsg), sizeof(ee));
+		if (check_int_field(ee_expr->ee_errno, ee.ee_errno,
+				    "ee_errno", index, error) ||
+		    check_int_field(ee_expr->ee_origin, ee.ee_origin,
+				    "ee_origin", index, error) ||
+		    check_int_field(ee_expr->ee_type, ee.ee_type,
+				    "ee_type", index, error) ||
+		    check_int_field(ee_expr->ee_code, ee.ee_code,
+				    "ee_code", index, error) ||
+		    check_int_field(ee_expr->ee_info, ee.ee_info,
+				    "ee_info", index, error) ||
+		    check_int_field(ee_expr->ee_data, ee.ee_data,
+				    "ee_data", index, error))
+			return STATUS_ERR;
+		return STATUS_OK;
+	}
+#endif  /* linux */
+	default:
+		asprintf(error, "Bad type for cmsg_data; "
+			 "expected integer or sock_extended_err but got %s",
+			 expression_type_to_string(expression->type));
+		return STATUS_ERR;
+	}
+}
+
+/* Check the control messages returned by recvmsg() against the
+ * msg_control list the script expected, in order. Returns STATUS_OK
+ * on success; on failure returns STATUS_ERR and sets error message.
+ */
+static int cmsgs_check(struct expression *expression, struct msghdr *msg,
+		       char **error)
+{
+	struct expression_list *list = expression->value.list;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+	int i = 0;
+
+	for (; list != NULL; list = list->next, ++i) {
+		struct cmsghdr_expr *cmsg_expr;
+
+		if (cmsg == NULL) {
+			asprintf(error, "Expected %d cmsgs but got %d",
+				 expression_list_length(expression->value.list),
+				 i);
+			return STATUS_ERR;
+		}
+		if (check_type(list->expression, EXPR_CMSGHDR, error))
+			return STATUS_ERR;
+		cmsg_expr = list->expression->value.cmsghdr;
+
+		if (check_int_field(cmsg_expr->cmsg_level, cmsg->cmsg_level,
+				    "cmsg_level", i, error) ||
+		    check_int_field(cmsg_expr->cmsg_type, cmsg->cmsg_type,
+				    "cmsg_type", i, error) ||
+		    cmsg_data_check(cmsg_expr->cmsg_data, cmsg, i, error))
+			return STATUS_ERR;
+
+		cmsg = CMSG_NXTHDR(msg, cmsg);
+	}
+	if (cmsg != NULL) {
+		asprintf(error, "Got more than the %d expected cmsgs", i);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+#ifdef linux
+/* Free all the space used by the given mmsghdr array. */
+static void mmsghdrs_free(struct mmsghdr *mmsg, size_t *iov_lens,
+			  size_t mmsg_len)
+{
+	int i;
+
+	if (mmsg == NULL)
+		return;
+
+	for (i = 0; i < mmsg_len; ++i)
+		msghdr_free(&mmsg[i].msg_hdr, iov_lens[i]);
+	free(mmsg);
+	free(iov_lens);
+}
+
+/* Allocate and fill in an mmsghdr array described by the given
+ * expression. Return STATUS_OK if the expression is a valid list of
+ * mmsghdr structs. Otherwise fill in the error with a human-readable
+ * error message and return STATUS_ERR.
+ */
+static int mmsghdrs_new(struct expression *expression,
+			struct mmsghdr **mmsg_ptr, size_t **iov_lens_ptr,
+			size_t *mmsg_len_ptr, char **error)
+{
+	int status = STATUS_ERR;
+	int i;
+	struct expression_list *list;	/* input expression from script */
+	size_t mmsg_len = 0;
+	struct mmsghdr *mmsg = NULL;	/* live output */
+	size_t *iov_lens = NULL;
+
+	if (check_type(expression, EXPR_LIST, error))
+		goto error_out;
+
+	list = expression->value.list;
+
+	mmsg_len = expression_list_length(list);
+	mmsg = calloc(mmsg_len, sizeof(struct mmsghdr));
+	iov_lens = calloc(mmsg_len, sizeof(size_t));
+
+	for (i = 0; i < mmsg_len; ++i, list = list->next) {
+		struct mmsghdr_expr *mmsg_expr;
+		struct msghdr *msg = NULL;
+		int result;
+
+		if (check_type(list->expression, EXPR_MMSGHDR, error))
+			goto error_out;
+
+		mmsg_expr = list->expression->value.mmsghdr;
+		result = msghdr_new(mmsg_expr->msg_hdr, &msg, &iov_lens[i],
+				    error);
+		if (msg != NULL) {
+			mmsg[i].msg_hdr = *msg;
+			free(msg);
+		}
+		if (result)
+			goto error_out;
+	}
+
+	status = STATUS_OK;
+
+error_out:
+	*mmsg_ptr = mmsg;
+	*iov_lens_ptr = iov_lens;
+	*mmsg_len_ptr = mmsg_len;
+	return status;
+}
+
+/* Check the msg_len and msg_flags of the first num_msgs entries of an
+ * mmsghdr array after sendmmsg()/recvmmsg(). Returns STATUS_OK on
+ * success; on failure returns STATUS_ERR and sets error message.
+ */
+static int mmsghdrs_check(struct expression *expression,
+			  struct mmsghdr *mmsg, int num_msgs,
+			  bool check_flags, char **error)
+{
+	struct expression_list *list = expression->value.list;
+	int i;
+
+	for (i = 0; i < num_msgs; ++i, list = list->next) {
+		struct mmsghdr_expr *mmsg_expr = list->expression->value.mmsghdr;
+		struct msghdr_expr *msg_expr = mmsg_expr->msg_hdr->value.msghdr;
+		s32 expected_flags = 0;
+
+		if (mmsg_expr->msg_len->type != EXPR_ELLIPSIS) {
+			if (check_type(mmsg_expr->msg_len, EXPR_INTEGER, error))
+				return STATUS_ERR;
+			if (mmsg_expr->msg_len->value.num != mmsg[i].msg_len) {
+				asprintf(error,
+					 "Expected msg_len %lld but got %u "
+					 "for mmsghdr %d",
+					 (long long)mmsg_expr->msg_len->value.num,
+					 mmsg[i].msg_len, i);
+				return STATUS_ERR;
+			}
+		}
+		if (!check_flags)
+			continue;
+		if (get_s32(msg_expr->msg_flags, &expected_flags, error))
+			return STATUS_ERR;
+		if (mmsg[i].msg_hdr.msg_flags != expected_flags) {
+			asprintf(error, "Expected msg_flags 0x%08X but got 0x%08X "
+				 "for mmsghdr %d",
+				 expected_flags, mmsg[i].msg_hdr.msg_flags, i);
+			return STATUS_ERR;
+		}
+		if (msg_expr->msg_control != NULL &&
+		    cmsgs_check(msg_expr->msg_control, &mmsg[i].msg_hdr,
+				error))
+			return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+#endif  /* linux */
+
 /* Allocate and fill in a pollfds array described by the given
  * fds_expression. Return STATUS_OK if the expression is a valid
  * pollfd struct array. Otherwise fill in the error with a
@@ -484,6 +775,16 @@ static int pollfds_check(struct expression *fds_expression,
 	return STATUS_OK;
 }
 
+/* Return the script line of the given system call, which the syscall
+ * thread runs for blocking calls and the main thread for the others.
+ */
+static int syscall_line(struct state *state, struct syscall_spec *syscall)
+{
+	if (is_blocking_syscall(syscall))
+		return state->syscalls->event->line_number;
+	return state->event->line_number;
+}
+
 /* For blocking system calls, give up the global lock and wake the
  * main thread so it can continue test execution. Callers should call
  * this function immediately before calling a system call in order to
@@ -492,9 +793,12 @@ static int pollfds_check(struct expression *fds_expression,
  */
 static void begin_syscall(struct state *state, struct syscall_spec *syscall)
 {
+	flight_record_syscall_begin(syscall_line(state, syscall),
+				    syscall->name);
 	if (is_blocking_syscall(syscall)) {
 		assert(state->syscalls->state == SYSCALL_ENQUEUED);
 		state->syscalls->state = SYSCALL_RUNNING;
+		PROBE1(syscall__begin, state->syscalls->event->line_number);
 		run_unlock(state);
 		DEBUGP("syscall thread: begin_syscall signals dequeued\n");
 		if (pthread_cond_signal(&state->syscalls->dequeued) != 0)
@@ -527,6 +831,15 @@ static int end_syscall(struct state *state, struct syscall_spec *syscall,
 		assert(state->syscalls->state == SYSCALL_RUNNING);
 		state->syscalls->state = SYSCALL_DONE;
 	}
+	flight_record_syscall_end(syscall_line(state, syscall), syscall->name,
+				  actual, actual_errno);
+	if (state->pcapng != NULL)
+		pcapng_writer_syscall(state->pcapng,
+				      syscall_line(state, syscall),
+				      syscall->name, actual, actual_errno, mode,
+				      is_blocking_syscall(syscall) ?
+				      state->syscalls->live_end_usecs :
+				      now_usecs());
 
 	/* Compare actual vs expected return value */
 	if (get_s32(syscall->result, &expected, error))
@@ -600,6 +913,28 @@ static struct socket *find_socket_by_live_fd(
 	return NULL;
 }
 
+/* Return a pointer to the non-socket fd with the given script fd, or NULL. */
+static struct fd_mapping *find_fd_by_script_fd(
+	struct state *state, int script_fd)
+{
+	struct fd_mapping *fd = NULL;
+	for (fd = state->fds; fd != NULL; fd = fd->next)
+		if (!fd->is_closed && (fd->script_fd == script_fd))
+			return fd;
+	return NULL;
+}
+
+/* Return a pointer to the non-socket fd with the given live fd, or NULL. */
+static struct fd_mapping *find_fd_by_live_fd(
+	struct state *state, int live_fd)
+{
+	struct fd_mapping *fd = NULL;
+	for (fd = state->fds; fd != NULL; fd = fd->next)
+		if (!fd->is_closed && (fd->live_fd == live_fd))
+			return fd;
+	return NULL;
+}
+
 /* Find the live fd corresponding to the fd in a script. Returns
  * STATUS_OK on success; on failure returns STATUS_ERR and sets
  * error message.
@@ -608,9 +943,15 @@ static int to_live_fd(struct state *state, int script_fd, int *live_fd,
 		      char **error)
 {
 	struct socket *socket = find_socket_by_script_fd(state, script_fd);
+	struct fd_mapping *fd = NULL;
 	if (socket != NULL) {
 		*live_fd = socket->live.fd;
 		return STATUS_OK;
+	}
+	fd = find_fd_by_script_fd(state, script_fd);
+	if (fd != NULL) {
+		*live_fd = fd->live_fd;
+		return STATUS_OK;
 	} else {
 		*live_fd = -1;
 		asprintf(error, "unable to find socket with script fd %d",
@@ -619,6 +960,30 @@ static int to_live_fd(struct state *state, int script_fd, int *live_fd,
 	}
 }
 
+/* Find the script fd corresponding to a live fd. Returns STATUS_OK on
+ * success; on failure returns STATUS_ERR and sets error message.
+ */
+static int to_script_fd(struct state *state, int live_fd, int *script_fd,
+			char **error)
+{
+	struct socket *socket = find_socket_by_live_fd(state, live_fd);
+	struct fd_mapping *fd = NULL;
+	if (socket != NULL) {
+		*script_fd = socket->script.fd;
+		return STATUS_OK;
+	}
+	fd = find_fd_by_live_fd(state, live_fd);
+	if (fd != NULL) {
+		*script_fd = fd->script_fd;
+		return STATUS_OK;
+	} else {
+		*script_fd = -1;
+		asprintf(error, "unable to find script fd for live fd %d",
+			 live_fd);
+		return STATUS_ERR;
+	}
+}
+
 /****************************************************************************
  * Here we have the "backend" post-processing and pre-processing that
  * we perform after and/or before each of the system calls that
@@ -646,7 +1011,8 @@ static int run_syscall_socket(struct state *state, int address_family,
 
 	/* Look for sockets with conflicting fds. Should not happen if
 	   the script is valid and this program is bug-free. */
-	if (find_socket_by_script_fd(state, script_fd)) {
+	if (find_socket_by_script_fd(state, script_fd) ||
+	    find_fd_by_script_fd(state, script_fd)) {
 		asprintf(error, "duplicate socket fd %d in script",
 			 script_fd);
 		return STATUS_ERR;
@@ -672,7 +1038,38 @@ static int run_syscall_socket(struct state *state, int address_family,
 	return STATUS_OK;
 }
 
-/* Handle a close() call for the given socket.
+/* The app created a non-socket fd in the script and we did a live
+ * reenactment of that call. Create a struct fd_mapping to track it.
+ * Returns STATUS_OK on success; on failure returns STATUS_ERR and
+ * sets error message.
+ */
+static int run_syscall_new_fd(struct state *state, int script_fd,
+			      int live_fd, char **error)
+{
+	struct fd_mapping *fd = NULL;
+
+	if (script_fd < 0) {
+		asprintf(error, "invalid fd %d in script", script_fd);
+		return STATUS_ERR;
+	}
+	if (find_socket_by_script_fd(state, script_fd) ||
+	    find_fd_by_script_fd(state, script_fd)) {
+		asprintf(error, "duplicate fd %d in script", script_fd);
+		return STATUS_ERR;
+	}
+
+	fd = calloc(1, sizeof(struct fd_mapping));
+	fd->script_fd	= script_fd;
+	fd->live_fd	= live_fd;
+	fd->next	= state->fds;	/* add fd to the linked list */
+	state->fds	= fd;
+
+	DEBUGP("creating new fd: script_fd: %d live_fd: %d\n",
+	       fd->script_fd, fd->live_fd);
+	return STATUS_OK;
+}
+
+/* Handle a close() call for the given socket or other fd.
  * Returns STATUS_OK on success; on failure returns STATUS_ERR and
  * sets error message.
  */
@@ -680,7 +1077,15 @@ static int run_syscall_close(struct state *state, int script_fd,
 			     int live_fd, char **error)
 {
 	struct socket *socket = find_socket_by_script_fd(state, script_fd);
-	if ((socket == NULL) || (socket->live.fd != live_fd))
+	struct fd_mapping *fd = NULL;
+	if (socket == NULL) {
+		fd = find_fd_by_script_fd(state, script_fd);
+		if ((fd == NULL) || (fd->live_fd != live_fd))
+			goto error_out;
+		fd->is_closed = true;
+		return STATUS_OK;
+	}
+	if (socket->live.fd != live_fd)
 		goto error_out;
 
 	socket->is_closed = true;
@@ -779,15 +1184,34 @@ static int run_syscall_accept(struct state *state,
 			       socket->script.remote.port);
 		}
 
-		if ((socket->state == SOCKET_PASSIVE_SYNACK_SENT) ||  /* TFO */
-		    (socket->state == SOCKET_PASSIVE_SYNACK_ACKED)) {
+		if ((socket->state != SOCKET_PASSIVE_SYNACK_SENT) &&  /* TFO */
+		    (socket->state != SOCKET_PASSIVE_SYNACK_ACKED))
+			continue;
+
+		/* Skip children we already accepted. A child whose SYN
+		 * named its fd may only be returned by this accept().
+		 */
+		if (socket->live.fd >= 0)
+			continue;
+		if (socket->script.fd >= 0) {
+			if (socket->script.fd != script_accepted_fd)
+				continue;
+			if (!is_equal_ip(&socket->live.remote.ip, &ip) ||
+			    !is_equal_port(socket->live.remote.port,
+					   htons(port))) {
+				asprintf(error, "accept() returned a "
+					 "connection other than the one "
+					 "opened for fd %d", script_accepted_fd);
+				return STATUS_ERR;
+			}
+		} else {
 			assert(is_equal_ip(&socket->live.remote.ip, &ip));
 			assert(is_equal_port(socket->live.remote.port,
 					     htons(port)));
-			socket->script.fd	= script_accepted_fd;
-			socket->live.fd		= live_accepted_fd;
-			return STATUS_OK;
 		}
+		socket->script.fd	= script_accepted_fd;
+		socket->live.fd		= live_accepted_fd;
+		return STATUS_OK;
 	}
 
 	if (!state->config->is_wire_client) {
@@ -846,9 +1270,13 @@ static int run_syscall_connect(struct state *state,
 		       state->config->default_live_connect_port,
 		       live_addr, live_addrlen);
 
+	/* Other fds have no connection to track. We still make the call,
+	 * so the script can check that the kernel fails it with ENOTSOCK.
+	 */
 	socket = find_socket_by_script_fd(state, script_fd);
+	if (socket == NULL)
+		return STATUS_OK;
 
-	assert(socket != NULL);
 	if (socket->state != SOCKET_NEW) {
 		if (must_be_new_socket) {
 			asprintf(error, "socket is not new");
@@ -865,6 +1293,7 @@ static int run_syscall_connect(struct state *state,
 	socket->script.local.port		= 0;
 	socket->live.remote.ip   = state->config->live_remote_ip;
  	socket->live.remote.port = htons(state->config->default_live_connect_port);
+	update_live_packet_filter(state);
 	DEBUGP("success: setting socket to state %d\n", socket->state);
 	return STATUS_OK;
 }
@@ -1309,6 +1738,11 @@ static int syscall_recvmsg(struct state *state, struct syscall_spec *syscall,
 		goto error_out;
 	}
 
+	if (msg_expression->value.msghdr->msg_control != NULL &&
+	    cmsgs_check(msg_expression->value.msghdr->msg_control, msg,
+			error))
+		goto error_out;
+
 	status = STATUS_OK;
 
 error_out:
@@ -1494,6 +1928,10 @@ static int syscall_sendmsg(struct state *state, struct syscall_spec *syscall,
 		asprintf(error, "sendmsg ignores msg_flags field in msghdr");
 		goto error_out;
 	}
+	if (msg->msg_control != NULL) {
+		asprintf(error, "sendmsg does not support msg_control");
+		goto error_out;
+	}
 
 	begin_syscall(state, syscall);
 
@@ -1506,72 +1944,201 @@ error_out:
 	return status;
 }
 
-static int syscall_fcntl(struct state *state, struct syscall_spec *syscall,
-			 struct expression_list *args, char **error)
+#ifdef linux
+static int syscall_sendmmsg(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
 {
-	int live_fd, script_fd, command, result;
-
-	/* fcntl is an odd system call - it can take either 2 or 3 args. */
-	int actual_arg_count = get_arg_count(args);
-	if ((actual_arg_count != 2) && (actual_arg_count != 3)) {
-		asprintf(error, "fcntl expected 2-3 args but got %d",
-			 actual_arg_count);
-		return STATUS_ERR;
-	}
+	int live_fd, script_fd, vlen, flags, result;
+	struct expression *mmsg_expression = NULL;
+	struct mmsghdr *mmsg = NULL;
+	size_t *iov_lens = NULL;
+	size_t mmsg_len = 0;
+	int i;
+	int status = STATUS_ERR;
 
+	if (check_arg_count(args, 4, error))
+		goto error_out;
 	if (s32_arg(args, 0, &script_fd, error))
-		return STATUS_ERR;
+		goto error_out;
 	if (to_live_fd(state, script_fd, &live_fd, error))
-		return STATUS_ERR;
-	if (s32_arg(args, 1, &command, error))
-		return STATUS_ERR;
-
-	if (actual_arg_count == 2) {
-		begin_syscall(state, syscall);
+		goto error_out;
 
-		result = fcntl(live_fd, command);
-	} else if (actual_arg_count == 3) {
-		s32 arg;
-		if (s32_arg(args, 2, &arg, error))
-			return STATUS_ERR;
-		begin_syscall(state, syscall);
+	mmsg_expression = get_arg(args, 1, error);
+	if (mmsg_expression == NULL)
+		goto error_out;
+	if (mmsghdrs_new(mmsg_expression, &mmsg, &iov_lens, &mmsg_len, error))
+		goto error_out;
 
-		result = fcntl(live_fd, command, arg);
-	} else {
-		assert(0);	/* not reached */
+	if (s32_arg(args, 2, &vlen, error))
+		goto error_out;
+	if (vlen != mmsg_len) {
+		asprintf(error,
+			 "vlen %d does not match %d-element mmsghdr array",
+			 vlen, (int)mmsg_len);
+		goto error_out;
 	}
+	if (s32_arg(args, 3, &flags, error))
+		goto error_out;
 
-	return end_syscall(state, syscall, CHECK_EXACT, result, error);
-}
-
-static int syscall_ioctl(struct state *state, struct syscall_spec *syscall,
-			 struct expression_list *args, char **error)
-{
-	int live_fd, script_fd, command, result;
+	for (i = 0; i < mmsg_len; ++i) {
+		struct msghdr *msg = &mmsg[i].msg_hdr;
 
-	/* ioctl is an odd system call - it can take either 2 or 3 args. */
-	int actual_arg_count = get_arg_count(args);
-	if ((actual_arg_count != 2) && (actual_arg_count != 3)) {
-		asprintf(error, "ioctl expected 2-3 args but got %d",
-			 actual_arg_count);
-		return STATUS_ERR;
+		if ((msg->msg_name != NULL) &&
+		    run_syscall_connect(state, script_fd, false,
+					msg->msg_name, &msg->msg_namelen,
+					error))
+			goto error_out;
+		if (msg->msg_flags != 0) {
+			asprintf(error,
+				 "sendmmsg ignores msg_flags field in msghdr");
+			goto error_out;
+		}
+		if (msg->msg_control != NULL) {
+			asprintf(error, "sendmmsg does not support msg_control");
+			goto error_out;
+		}
 	}
 
-	if (s32_arg(args, 0, &script_fd, error))
-		return STATUS_ERR;
-	if (to_live_fd(state, script_fd, &live_fd, error))
-		return STATUS_ERR;
-	if (s32_arg(args, 1, &command, error))
-		return STATUS_ERR;
+	begin_syscall(state, syscall);
 
-	if (actual_arg_count == 2) {
-		begin_syscall(state, syscall);
+	result = sendmmsg(live_fd, mmsg, vlen, flags);
 
-		result = ioctl(live_fd, command);
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
 
-		return end_syscall(state, syscall, CHECK_EXACT, result, error);
+	if (result > 0 &&
+	    mmsghdrs_check(mmsg_expression, mmsg, result, false, error))
+		goto error_out;
 
-	} else if (actual_arg_count == 3) {
+	status = STATUS_OK;
+
+error_out:
+	mmsghdrs_free(mmsg, iov_lens, mmsg_len);
+	return status;
+}
+
+static int syscall_recvmmsg(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, vlen, flags, result;
+	struct expression *mmsg_expression = NULL;
+	struct mmsghdr *mmsg = NULL;
+	size_t *iov_lens = NULL;
+	size_t mmsg_len = 0;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 5, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_fd, error))
+		goto error_out;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		goto error_out;
+
+	mmsg_expression = get_arg(args, 1, error);
+	if (mmsg_expression == NULL)
+		goto error_out;
+	if (mmsghdrs_new(mmsg_expression, &mmsg, &iov_lens, &mmsg_len, error))
+		goto error_out;
+
+	if (s32_arg(args, 2, &vlen, error))
+		goto error_out;
+	if (vlen != mmsg_len) {
+		asprintf(error,
+			 "vlen %d does not match %d-element mmsghdr array",
+			 vlen, (int)mmsg_len);
+		goto error_out;
+	}
+	if (s32_arg(args, 3, &flags, error))
+		goto error_out;
+	/* We only support a NULL timeout, which the script writes as ... */
+	if (ellipsis_arg(args, 4, error))
+		goto error_out;
+
+	begin_syscall(state, syscall);
+
+	result = recvmmsg(live_fd, mmsg, vlen, flags, NULL);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	if (result > 0 &&
+	    mmsghdrs_check(mmsg_expression, mmsg, result, true, error))
+		goto error_out;
+
+	status = STATUS_OK;
+
+error_out:
+	mmsghdrs_free(mmsg, iov_lens, mmsg_len);
+	return status;
+}
+#endif  /* linux */
+
+static int syscall_fcntl(struct state *state, struct syscall_spec *syscall,
+			 struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, command, result;
+
+	/* fcntl is an odd system call - it can take either 2 or 3 args. */
+	int actual_arg_count = get_arg_count(args);
+	if ((actual_arg_count != 2) && (actual_arg_count != 3)) {
+		asprintf(error, "fcntl expected 2-3 args but got %d",
+			 actual_arg_count);
+		return STATUS_ERR;
+	}
+
+	if (s32_arg(args, 0, &script_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &command, error))
+		return STATUS_ERR;
+
+	if (actual_arg_count == 2) {
+		begin_syscall(state, syscall);
+
+		result = fcntl(live_fd, command);
+	} else if (actual_arg_count == 3) {
+		s32 arg;
+		if (s32_arg(args, 2, &arg, error))
+			return STATUS_ERR;
+		begin_syscall(state, syscall);
+
+		result = fcntl(live_fd, command, arg);
+	} else {
+		assert(0);	/* not reached */
+	}
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+static int syscall_ioctl(struct state *state, struct syscall_spec *syscall,
+			 struct expression_list *args, char **error)
+{
+	int live_fd, script_fd, command, result;
+
+	/* ioctl is an odd system call - it can take either 2 or 3 args. */
+	int actual_arg_count = get_arg_count(args);
+	if ((actual_arg_count != 2) && (actual_arg_count != 3)) {
+		asprintf(error, "ioctl expected 2-3 args but got %d",
+			 actual_arg_count);
+		return STATUS_ERR;
+	}
+
+	if (s32_arg(args, 0, &script_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &command, error))
+		return STATUS_ERR;
+
+	if (actual_arg_count == 2) {
+		begin_syscall(state, syscall);
+
+		result = ioctl(live_fd, command);
+
+		return end_syscall(state, syscall, CHECK_EXACT, result, error);
+
+	} else if (actual_arg_count == 3) {
 		s32 script_optval, live_optval;
 
 		if (s32_bracketed_arg(args, 2, &script_optval, error))
@@ -1645,12 +2212,80 @@ static int syscall_shutdown(struct state *state, struct syscall_spec *syscall,
 	return STATUS_OK;
 }
 
+#ifdef linux
+/* getsockopt(TCP_ZEROCOPY_RECEIVE) maps received data into the area
+ * the script mmap()-ed on the socket earlier. Check how much the
+ * kernel mapped and how much it says we should read() instead.
+ */
+static int getsockopt_tcp_zerocopy_receive(struct state *state,
+					   struct syscall_spec *syscall,
+					   struct expression_list *args,
+					   int script_fd, int live_fd,
+					   int level, int optname,
+					   char **error)
+{
+	struct tcp_zerocopy_receive_expr *zc_expr;
+	struct _tcp_zerocopy_receive zc;
+	struct socket *socket = find_socket_by_script_fd(state, script_fd);
+	socklen_t live_optlen = sizeof(zc);
+	s32 script_optlen, expected;
+	int result;
+
+	zc_expr = get_arg(args, 3, error)->value.tcp_zerocopy_receive;
+	if (s32_bracketed_arg(args, 4, &script_optlen, error))
+		return STATUS_ERR;
+	if (script_optlen != sizeof(zc)) {
+		asprintf(error, "Unsupported getsockopt optlen: %d",
+			 (int)script_optlen);
+		return STATUS_ERR;
+	}
+	if (socket == NULL || socket->mmap_addr == NULL) {
+		asprintf(error, "TCP_ZEROCOPY_RECEIVE needs an mmap() "
+			 "of socket fd %d first", script_fd);
+		return STATUS_ERR;
+	}
+	memset(&zc, 0, sizeof(zc));
+	zc.address = (unsigned long)socket->mmap_addr;
+	zc.length = socket->mmap_len;
+
+	begin_syscall(state, syscall);
+
+	result = getsockopt(live_fd, level, optname, &zc, &live_optlen);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		return STATUS_ERR;
+	if (result < 0)
+		return STATUS_OK;
+
+	if (get_s32(zc_expr->length, &expected, error))
+		return STATUS_ERR;
+	if (zc.length != expected) {
+		asprintf(error,
+			 "Bad TCP_ZEROCOPY_RECEIVE length: "
+			 "expected: %d actual: %u",
+			 (int)expected, zc.length);
+		return STATUS_ERR;
+	}
+	if (get_s32(zc_expr->recv_skip_hint, &expected, error))
+		return STATUS_ERR;
+	if (zc.recv_skip_hint != expected) {
+		asprintf(error,
+			 "Bad TCP_ZEROCOPY_RECEIVE recv_skip_hint: "
+			 "expected: %d actual: %u",
+			 (int)expected, zc.recv_skip_hint);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+#endif  /* linux */
+
 static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 			      struct expression_list *args, char **error)
 {
 	int script_fd, live_fd, level, optname, result;
 	s32 script_optval, live_optval, script_optlen;
 	socklen_t live_optlen = sizeof(live_optval);
+	struct expression *val_expression;
 	if (check_arg_count(args, 5, error))
 		return STATUS_ERR;
 	if (s32_arg(args, 0, &script_fd, error))
@@ -1661,6 +2296,15 @@ static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 		return STATUS_ERR;
 	if (s32_arg(args, 2, &optname, error))
 		return STATUS_ERR;
+	val_expression = get_arg(args, 3, error);
+	if (val_expression == NULL)
+		return STATUS_ERR;
+#ifdef linux
+	if (val_expression->type == EXPR_TCP_ZEROCOPY_RECEIVE)
+		return getsockopt_tcp_zerocopy_receive(state, syscall, args,
+						       script_fd, live_fd,
+						       level, optname, error);
+#endif
 	if (s32_bracketed_arg(args, 3, &script_optval, error))
 		return STATUS_ERR;
 	if (s32_bracketed_arg(args, 4, &script_optlen, error))
@@ -1787,72 +2431,1080 @@ error_out:
 	return status;
 }
 
-/* A dispatch table with all the system calls that we support... */
-struct system_call_entry {
-	const char *name;
-	int (*function) (struct state *state,
-			 struct syscall_spec *syscall,
-			 struct expression_list *args,
-			 char **error);
-};
-struct system_call_entry system_call_table[] = {
-	{"socket",     syscall_socket},
-	{"bind",       syscall_bind},
-	{"listen",     syscall_listen},
-	{"accept",     syscall_accept},
-	{"connect",    syscall_connect},
-	{"read",       syscall_read},
-	{"readv",      syscall_readv},
-	{"recv",       syscall_recv},
-	{"recvfrom",   syscall_recvfrom},
-	{"recvmsg",    syscall_recvmsg},
-	{"write",      syscall_write},
-	{"writev",     syscall_writev},
-	{"send",       syscall_send},
-	{"sendto",     syscall_sendto},
-	{"sendmsg",    syscall_sendmsg},
-	{"fcntl",      syscall_fcntl},
-	{"ioctl",      syscall_ioctl},
-	{"close",      syscall_close},
-	{"shutdown",   syscall_shutdown},
-	{"getsockopt", syscall_getsockopt},
-	{"setsockopt", syscall_setsockopt},
-	{"poll",       syscall_poll},
-	{"mp_join_accept",	mp_join_accept}
-};
+#ifdef linux
+static int syscall_pipe(struct state *state, struct syscall_spec *syscall,
+			struct expression_list *args, char **error)
+{
+	struct expression *fds_expression = NULL;
+	struct expression_list *list = NULL;
+	int live_fds[2], script_fds[2], result, i;
 
-/* Evaluate the system call arguments and invoke the system call. */
-static void invoke_system_call(
-	struct state *state, struct event *event, struct syscall_spec *syscall)
+	if (check_arg_count(args, 1, error))
+		return STATUS_ERR;
+	fds_expression = get_arg(args, 0, error);
+	if (fds_expression == NULL)
+		return STATUS_ERR;
+	if (check_type(fds_expression, EXPR_LIST, error))
+		return STATUS_ERR;
+	list = fds_expression->value.list;
+	if (expression_list_length(list) != 2) {
+		asprintf(error, "Expected [<read fd>, <write fd>] for pipe");
+		return STATUS_ERR;
+	}
+	for (i = 0; i < 2; ++i, list = list->next) {
+		if (get_s32(list->expression, &script_fds[i], error))
+			return STATUS_ERR;
+	}
+
+	begin_syscall(state, syscall);
+
+	result = pipe(live_fds);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		return STATUS_ERR;
+
+	if (result == 0) {
+		for (i = 0; i < 2; ++i) {
+			if (run_syscall_new_fd(state, script_fds[i],
+					       live_fds[i], error))
+				return STATUS_ERR;
+		}
+	}
+
+	return STATUS_OK;
+}
+
+/* memfd_create() gives scripts an anonymous page-cache-backed file
+ * that they can fill with write() and transmit with sendfile() or
+ * splice(). It is closed along with the other fds after the test.
+ */
+static int syscall_memfd_create(struct state *state,
+				struct syscall_spec *syscall,
+				struct expression_list *args, char **error)
 {
-	DEBUGP("%d: invoke call: %s\n", event->line_number, syscall->name);
+	struct expression *name_expression = NULL;
+	const char *name = "packetdrill";
+	int flags, live_fd, script_fd, result;
 
-	char *error = NULL;
-	const char *name = syscall->name;
-	struct expression_list *args = NULL;
-	int i = 0;
-	int result = 0;
+	if (check_arg_count(args, 2, error))
+		return STATUS_ERR;
+	name_expression = get_arg(args, 0, error);
+	if (name_expression == NULL)
+		return STATUS_ERR;
+	if (name_expression->type != EXPR_ELLIPSIS) {
+		if (check_type(name_expression, EXPR_STRING, error))
+			return STATUS_ERR;
+		name = name_expression->value.string;
+	}
+	if (s32_arg(args, 1, &flags, error))
+		return STATUS_ERR;
 
-	/* Wait for the right time before firing off this event. */
-	wait_for_event(state);
+	begin_syscall(state, syscall);
 
-	/* Find and invoke the handler for this system call. */
-	for (i = 0; i < ARRAY_SIZE(system_call_table); ++i)
-		if (strcmp(name, system_call_table[i].name) == 0)
-			break;
-	if (i == ARRAY_SIZE(system_call_table)) {
-		asprintf(&error, "Unknown system call: '%s'", name);
-		goto error_out;
+	result = memfd_create(name, flags);
+
+	if (end_syscall(state, syscall, CHECK_NON_NEGATIVE, result, error))
+		return STATUS_ERR;
+
+	if (result >= 0) {
+		live_fd = result;
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		if (run_syscall_new_fd(state, script_fd, live_fd, error))
+			return STATUS_ERR;
 	}
 
-	/* Evaluate script symbolic expressions to get live numeric args for
-	 * system calls.
-	 */
-	if (evaluate_expression_list(syscall->arguments, &args, &error))
-		goto error_out;
+	return STATUS_OK;
+}
+
+static int syscall_sendfile(struct state *state, struct syscall_spec *syscall,
+			    struct expression_list *args, char **error)
+{
+	int live_out_fd, script_out_fd, live_in_fd, script_in_fd, count;
+	int result;
+	off_t offset, *offset_ptr = NULL;
 
-	/* Run the system call. */
-	result = system_call_table[i].function(state, syscall, args, &error);
+	if (check_arg_count(args, 4, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_out_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_out_fd, &live_out_fd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &script_in_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_in_fd, &live_in_fd, error))
+		return STATUS_ERR;
+	if (offset_arg(args, 2, &offset, &offset_ptr, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 3, &count, error))
+		return STATUS_ERR;
+
+	begin_syscall(state, syscall);
+
+	result = sendfile(live_out_fd, live_in_fd, offset_ptr, count);
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+static int syscall_splice(struct state *state, struct syscall_spec *syscall,
+			  struct expression_list *args, char **error)
+{
+	int live_in_fd, script_in_fd, live_out_fd, script_out_fd;
+	int len, flags, result;
+	off_t in_offset, *in_offset_ptr = NULL;
+	off_t out_offset, *out_offset_ptr = NULL;
+
+	if (check_arg_count(args, 6, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_in_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_in_fd, &live_in_fd, error))
+		return STATUS_ERR;
+	if (offset_arg(args, 1, &in_offset, &in_offset_ptr, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &script_out_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_out_fd, &live_out_fd, error))
+		return STATUS_ERR;
+	if (offset_arg(args, 3, &out_offset, &out_offset_ptr, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 4, &len, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 5, &flags, error))
+		return STATUS_ERR;
+
+	begin_syscall(state, syscall);
+
+	result = splice(live_in_fd, in_offset_ptr, live_out_fd, out_offset_ptr,
+			len, flags);
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+/* mmap(..., <len>, <prot>, <flags>, <socket fd>, <offset>) maps a
+ * receive area of the given socket for TCP_ZEROCOPY_RECEIVE. Since
+ * the address is unpredictable, the call returns 0 on success.
+ */
+static int syscall_mmap(struct state *state, struct syscall_spec *syscall,
+			struct expression_list *args, char **error)
+{
+	struct socket *socket = NULL;
+	int len, prot, flags, script_fd, live_fd, offset, result;
+	void *addr;
+
+	if (check_arg_count(args, 6, error))
+		return STATUS_ERR;
+	if (ellipsis_arg(args, 0, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &len, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &prot, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 3, &flags, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 4, &script_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 5, &offset, error))
+		return STATUS_ERR;
+	socket = find_socket_by_script_fd(state, script_fd);
+	if (socket == NULL) {
+		asprintf(error, "mmap of fd %d that is not a socket",
+			 script_fd);
+		return STATUS_ERR;
+	}
+
+	begin_syscall(state, syscall);
+
+	addr = mmap(NULL, len, prot, flags, live_fd, offset);
+	result = (addr == MAP_FAILED) ? -1 : 0;
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
+		if (addr != MAP_FAILED)
+			munmap(addr, len);
+		return STATUS_ERR;
+	}
+
+	if (addr != MAP_FAILED) {
+		if (socket->mmap_addr != NULL)
+			munmap(socket->mmap_addr, socket->mmap_len);
+		socket->mmap_addr = addr;
+		socket->mmap_len = len;
+	}
+
+	return STATUS_OK;
+}
+
+/* glibc has no wrappers for the io_uring system calls. */
+static int sys_io_uring_setup(u32 entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete,
+			      u32 flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int syscall_io_uring_setup(struct state *state,
+				  struct syscall_spec *syscall,
+				  struct expression_list *args, char **error)
+{
+	struct io_uring_params params;
+	struct io_uring_ring *ring = NULL;
+	struct fd_mapping *fd = NULL;
+	int entries, live_fd, script_fd, result;
+
+	if (check_arg_count(args, 2, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &entries, error))
+		return STATUS_ERR;
+	/* We always use the default setup params, written as ... */
+	if (ellipsis_arg(args, 1, error))
+		return STATUS_ERR;
+	memset(&params, 0, sizeof(params));
+
+	begin_syscall(state, syscall);
+
+	result = sys_io_uring_setup(entries, &params);
+
+	if (end_syscall(state, syscall, CHECK_NON_NEGATIVE, result, error))
+		return STATUS_ERR;
+
+	if (result >= 0) {
+		live_fd = result;
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		if (run_syscall_new_fd(state, script_fd, live_fd, error))
+			return STATUS_ERR;
+		if (io_uring_ring_new(live_fd, &params, &ring, error))
+			return STATUS_ERR;
+		fd = find_fd_by_script_fd(state, script_fd);
+		fd->ring = ring;
+	}
+
+	return STATUS_OK;
+}
+
+/* Find the rings of the io_uring with the given script fd. Returns
+ * STATUS_OK on success; on failure returns STATUS_ERR and sets error
+ * message.
+ */
+static int to_io_uring_ring(struct state *state, int script_fd,
+			    struct io_uring_ring **ring, char **error)
+{
+	struct fd_mapping *fd = find_fd_by_script_fd(state, script_fd);
+
+	if (fd == NULL || fd->ring == NULL) {
+		asprintf(error, "fd %d is not an io_uring", script_fd);
+		return STATUS_ERR;
+	}
+	*ring = fd->ring;
+	return STATUS_OK;
+}
+
+/* Fill in a live SQE, and the op slot that owns its buffers, from the
+ * given script SQE expression. Returns STATUS_OK on success; on
+ * failure returns STATUS_ERR and sets error message.
+ */
+static int io_uring_sqe_new(struct state *state, struct expression *expression,
+			    struct io_uring_sqe *sqe, struct ring_op *op,
+			    char **error)
+{
+	struct io_uring_sqe_expr *sqe_expr;
+	s32 opcode, len, msg_flags, live_fd = -1;
+
+	if (check_type(expression, EXPR_IO_URING_SQE, error))
+		return STATUS_ERR;
+	sqe_expr = expression->value.io_uring_sqe;
+	if (get_s32(sqe_expr->opcode, &opcode, error))
+		return STATUS_ERR;
+	if (get_s32(sqe_expr->fd, &op->script_fd, error))
+		return STATUS_ERR;
+	if (get_s32(sqe_expr->len, &len, error))
+		return STATUS_ERR;
+	if (get_s32(sqe_expr->msg_flags, &msg_flags, error))
+		return STATUS_ERR;
+	if (check_type(sqe_expr->user_data, EXPR_INTEGER, error))
+		return STATUS_ERR;
+	op->script_user_data = sqe_expr->user_data->value.num;
+	op->opcode = opcode;
+
+	if (opcode != IORING_OP_NOP &&
+	    to_live_fd(state, op->script_fd, &live_fd, error))
+		return STATUS_ERR;
+
+	sqe->opcode = opcode;
+	sqe->fd = live_fd;
+
+	switch (opcode) {
+	case IORING_OP_NOP:
+		break;
+	case IORING_OP_SEND:
+	case IORING_OP_RECV:
+		op->buf = calloc(len > 0 ? len : 1, 1);
+		sqe->addr = (unsigned long)op->buf;
+		sqe->len = len;
+		sqe->msg_flags = msg_flags;
+		break;
+	case IORING_OP_ACCEPT:
+		op->addrlen = sizeof(op->addr);
+		sqe->addr = (unsigned long)&op->addr;
+		sqe->addr2 = (unsigned long)&op->addrlen;
+		break;
+	case IORING_OP_CONNECT:
+		if (run_syscall_connect(state, op->script_fd, false,
+					(struct sockaddr *)&op->addr,
+					&op->addrlen, error))
+			return STATUS_ERR;
+		sqe->addr = (unsigned long)&op->addr;
+		sqe->off = op->addrlen;
+		break;
+	default:
+		asprintf(error, "unsupported io_uring opcode %d", opcode);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* io_uring_submit(<ring fd>, [<sqe>, ...]) queues the given SQEs and
+ * submits them all with one io_uring_enter(), whose result it returns.
+ */
+static int syscall_io_uring_submit(struct state *state,
+				   struct syscall_spec *syscall,
+				   struct expression_list *args, char **error)
+{
+	struct expression *sqes_expression = NULL;
+	struct expression_list *list = NULL;
+	struct io_uring_ring *ring = NULL;
+	struct ring_op **ops = NULL;
+	int script_fd, num_sqes, to_submit, result, i = 0;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 2, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_fd, error))
+		return STATUS_ERR;
+	if (to_io_uring_ring(state, script_fd, &ring, error))
+		return STATUS_ERR;
+	sqes_expression = get_arg(args, 1, error);
+	if (sqes_expression == NULL)
+		return STATUS_ERR;
+	if (check_type(sqes_expression, EXPR_LIST, error))
+		return STATUS_ERR;
+	list = sqes_expression->value.list;
+	num_sqes = expression_list_length(list);
+	ops = calloc(num_sqes > 0 ? num_sqes : 1, sizeof(struct ring_op *));
+
+	for (i = 0; i < num_sqes; ++i, list = list->next) {
+		struct io_uring_sqe *sqe =
+			io_uring_ring_get_sqe(ring, &ops[i]);
+		if (sqe == NULL) {
+			asprintf(error, "io_uring %d has no room for %d SQEs",
+				 script_fd, num_sqes);
+			goto error_out;
+		}
+		if (io_uring_sqe_new(state, list->expression, sqe, ops[i],
+				     error)) {
+			++i;
+			goto error_out;
+		}
+	}
+	to_submit = io_uring_ring_publish(ring);
+
+	begin_syscall(state, syscall);
+
+	result = sys_io_uring_enter(ring->fd, to_submit, 0, 0);
+
+	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
+	free(ops);
+	return status;
+
+error_out:
+	io_uring_ring_discard(ring);
+	while (i-- > 0) {
+		if (ops[i] != NULL)
+			ring_op_free(ops[i]);
+	}
+	free(ops);
+	return STATUS_ERR;
+}
+
+/* Check a reaped CQE against the one the script expected. For an
+ * accept, the script gives the fd it expects the new socket to have.
+ */
+static int io_uring_cqe_check(struct state *state,
+			      struct expression *expression,
+			      const struct io_uring_cqe *cqe,
+			      struct ring_op *op, int index, char **error)
+{
+	struct io_uring_cqe_expr *cqe_expr;
+	s32 expected_res;
+
+	if (check_type(expression, EXPR_IO_URING_CQE, error))
+		return STATUS_ERR;
+	cqe_expr = expression->value.io_uring_cqe;
+	if (check_type(cqe_expr->user_data, EXPR_INTEGER, error))
+		return STATUS_ERR;
+	if (get_s32(cqe_expr->res, &expected_res, error))
+		return STATUS_ERR;
+
+	if (op == NULL) {
+		asprintf(error, "CQE %d has unknown user_data %llu", index,
+			 (unsigned long long)cqe->user_data);
+		return STATUS_ERR;
+	}
+	if (op->script_user_data != cqe_expr->user_data->value.num) {
+		asprintf(error, "Expected user_data %lld but got %llu "
+			 "for CQE %d",
+			 (long long)cqe_expr->user_data->value.num,
+			 (unsigned long long)op->script_user_data, index);
+		return STATUS_ERR;
+	}
+	if (op->opcode == IORING_OP_ACCEPT && cqe->res >= 0 &&
+	    expected_res >= 0)
+		return run_syscall_accept(state, expected_res, cqe->res,
+					  (struct sockaddr *)&op->addr,
+					  op->addrlen, error);
+	if (cqe->res != expected_res) {
+		asprintf(error, "Expected res %d but got %d for CQE %d",
+			 expected_res, cqe->res, index);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* io_uring_wait(<ring fd>, [<cqe>, ...], <min_complete>) waits until
+ * at least min_complete CQEs are ready, then reaps all ready CQEs and
+ * returns how many there were. A ... CQE list accepts any CQEs.
+ */
+static int syscall_io_uring_wait(struct state *state,
+				 struct syscall_spec *syscall,
+				 struct expression_list *args, char **error)
+{
+	struct expression *cqes_expression = NULL;
+	struct expression_list *list = NULL;
+	struct io_uring_ring *ring = NULL;
+	struct io_uring_cqe *cqes = NULL;
+	struct ring_op **ops = NULL;
+	int script_fd, min_complete, result, num_cqes = 0, i;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 3, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_fd, error))
+		return STATUS_ERR;
+	if (to_io_uring_ring(state, script_fd, &ring, error))
+		return STATUS_ERR;
+	cqes_expression = get_arg(args, 1, error);
+	if (cqes_expression == NULL)
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &min_complete, error))
+		return STATUS_ERR;
+
+	cqes = calloc(ring->cq_entries, sizeof(struct io_uring_cqe));
+	ops = calloc(ring->cq_entries, sizeof(struct ring_op *));
+
+	begin_syscall(state, syscall);
+
+	result = 0;
+	if (min_complete > 0)
+		result = sys_io_uring_enter(ring->fd, 0, min_complete,
+					    IORING_ENTER_GETEVENTS);
+	if (result >= 0) {
+		while (num_cqes < ring->cq_entries &&
+		       io_uring_ring_pop_cqe(ring, &cqes[num_cqes],
+					     &ops[num_cqes]))
+			++num_cqes;
+		result = num_cqes;
+	}
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	if (cqes_expression->type != EXPR_ELLIPSIS) {
+		if (check_type(cqes_expression, EXPR_LIST, error))
+			goto error_out;
+		list = cqes_expression->value.list;
+		if (expression_list_length(list) != num_cqes) {
+			asprintf(error, "Expected %d CQEs but got %d",
+				 expression_list_length(list), num_cqes);
+			goto error_out;
+		}
+		for (i = 0; i < num_cqes; ++i, list = list->next) {
+			if (io_uring_cqe_check(state, list->expression,
+					       &cqes[i], ops[i], i, error))
+				goto error_out;
+		}
+	}
+
+	status = STATUS_OK;
+
+error_out:
+	for (i = 0; i < num_cqes; ++i) {
+		if (ops[i] != NULL && !(cqes[i].flags & IORING_CQE_F_MORE))
+			ring_op_free(ops[i]);
+	}
+	free(ops);
+	free(cqes);
+	return status;
+}
+
+static int syscall_epoll_create1(struct state *state,
+				 struct syscall_spec *syscall,
+				 struct expression_list *args, char **error)
+{
+	int flags, live_fd, script_fd, result;
+	if (check_arg_count(args, 1, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &flags, error))
+		return STATUS_ERR;
+
+	begin_syscall(state, syscall);
+
+	result = epoll_create1(flags);
+
+	if (end_syscall(state, syscall, CHECK_NON_NEGATIVE, result, error))
+		return STATUS_ERR;
+
+	if (result >= 0) {
+		live_fd = result;
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		if (run_syscall_new_fd(state, script_fd, live_fd, error))
+			return STATUS_ERR;
+	}
+
+	return STATUS_OK;
+}
+
+/* Fill in a live epoll_event from the given script epoll_event
+ * expression. Returns STATUS_OK on success; on failure returns
+ * STATUS_ERR and sets error message.
+ */
+static int epoll_event_new(struct state *state,
+			   struct expression *expression,
+			   struct epoll_event *event, char **error)
+{
+	struct epollev_expr *ev_expr;
+	int live_fd;
+
+	if (check_type(expression, EXPR_EPOLLEV, error))
+		return STATUS_ERR;
+	ev_expr = expression->value.epollev;
+	if (check_type(ev_expr->events, EXPR_INTEGER, error))
+		return STATUS_ERR;
+	if (check_type(ev_expr->fd, EXPR_INTEGER, error))
+		return STATUS_ERR;
+
+	memset(event, 0, sizeof(*event));
+	event->events = ev_expr->events->value.num;
+	if (to_live_fd(state, ev_expr->fd->value.num, &live_fd, error))
+		return STATUS_ERR;
+	event->data.fd = live_fd;
+	return STATUS_OK;
+}
+
+/* Check the results of an epoll_wait() system call: check that the
+ * ready events match the epoll_event array the script expected, in
+ * order. Returns STATUS_OK on success; on failure returns STATUS_ERR
+ * and sets error message.
+ */
+static int epoll_events_check(struct state *state,
+			      struct expression *events_expression,
+			      const struct epoll_event *events, int num_events,
+			      char **error)
+{
+	struct expression_list single = { events_expression, NULL };
+	struct expression_list *list = &single;
+	int i;
+
+	if (events_expression->type == EXPR_LIST)
+		list = events_expression->value.list;
+
+	if (expression_list_length(list) != num_events) {
+		asprintf(error, "Expected %d epoll events but got %d",
+			 expression_list_length(list), num_events);
+		return STATUS_ERR;
+	}
+
+	for (i = 0; i < num_events; ++i, list = list->next) {
+		struct epollev_expr *ev_expr;
+		int expected_fd, actual_fd;
+		u32 expected_events, actual_events;
+
+		if (check_type(list->expression, EXPR_EPOLLEV, error))
+			return STATUS_ERR;
+		ev_expr = list->expression->value.epollev;
+		if (check_type(ev_expr->events, EXPR_INTEGER, error))
+			return STATUS_ERR;
+		if (check_type(ev_expr->fd, EXPR_INTEGER, error))
+			return STATUS_ERR;
+
+		expected_fd = ev_expr->fd->value.num;
+		if (to_script_fd(state, events[i].data.fd, &actual_fd, error))
+			return STATUS_ERR;
+		if (actual_fd != expected_fd) {
+			asprintf(error,
+				 "Expected fd %d but got %d for epoll event %d",
+				 expected_fd, actual_fd, i);
+			return STATUS_ERR;
+		}
+
+		expected_events = ev_expr->events->value.num;
+		actual_events = events[i].events;
+		if (actual_events != expected_events) {
+			char *expected_events_string =
+				flags_to_string(epoll_flags, expected_events);
+			char *actual_events_string =
+				flags_to_string(epoll_flags, actual_events);
+			asprintf(error,
+				 "Expected events of %s but got %s "
+				 "for epoll event %d",
+				 expected_events_string,
+				 actual_events_string,
+				 i);
+			free(expected_events_string);
+			free(actual_events_string);
+			return STATUS_ERR;
+		}
+	}
+	return STATUS_OK;
+}
+
+static int syscall_epoll_ctl(struct state *state, struct syscall_spec *syscall,
+			     struct expression_list *args, char **error)
+{
+	int live_epfd, script_epfd, op, live_fd, script_fd, result;
+	struct epoll_event event, *event_ptr = NULL;
+	struct expression *event_expression = NULL;
+
+	if (check_arg_count(args, 4, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 0, &script_epfd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_epfd, &live_epfd, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 1, &op, error))
+		return STATUS_ERR;
+	if (s32_arg(args, 2, &script_fd, error))
+		return STATUS_ERR;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		return STATUS_ERR;
+	event_expression = get_arg(args, 3, error);
+	if (event_expression == NULL)
+		return STATUS_ERR;
+	/* EPOLL_CTL_DEL takes no event, which the script writes as ... */
+	if (event_expression->type != EXPR_ELLIPSIS) {
+		if (epoll_event_new(state, event_expression, &event, error))
+			return STATUS_ERR;
+		event_ptr = &event;
+	}
+
+	begin_syscall(state, syscall);
+
+	result = epoll_ctl(live_epfd, op, live_fd, event_ptr);
+
+	return end_syscall(state, syscall, CHECK_EXACT, result, error);
+}
+
+static int syscall_epoll_wait(struct state *state, struct syscall_spec *syscall,
+			      struct expression_list *args, char **error)
+{
+	int live_epfd, script_epfd, maxevents, timeout, result;
+	struct expression *events_expression = NULL;
+	struct epoll_event *events = NULL;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 4, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_epfd, error))
+		goto error_out;
+	if (to_live_fd(state, script_epfd, &live_epfd, error))
+		goto error_out;
+	events_expression = get_arg(args, 1, error);
+	if (events_expression == NULL)
+		goto error_out;
+	if (s32_arg(args, 2, &maxevents, error))
+		goto error_out;
+	if (s32_arg(args, 3, &timeout, error))
+		goto error_out;
+
+	events = calloc(maxevents > 0 ? maxevents : 1,
+			sizeof(struct epoll_event));
+
+	begin_syscall(state, syscall);
+
+	result = epoll_wait(live_epfd, events, maxevents, timeout);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	/* A ... events array means the script does not care which. */
+	if (result >= 0 && events_expression->type != EXPR_ELLIPSIS &&
+	    epoll_events_check(state, events_expression, events, result,
+			       error))
+		goto error_out;
+
+	status = STATUS_OK;
+
+error_out:
+	free(events);
+	return status;
+}
+
+/* Check each field in the list against each socket that sock_diag
+ * reported. Returns STATUS_OK on success; on failure returns
+ * STATUS_ERR and sets error message.
+ */
+static int sock_diag_check(struct expression_list *fields,
+			   const struct sock_diag_socket *sockets,
+			   int num_sockets, char **error)
+{
+	struct expression_list *list;
+	int i;
+
+	for (i = 0; i < num_sockets; ++i) {
+		for (list = fields; list != NULL; list = list->next) {
+			struct field_expr *field = list->expression->value.field;
+			s64 expected = field->value->value.num, actual = 0;
+
+			if (sock_diag_field_value(&sockets[i],
+						  sock_diag_field_lookup(
+							  field->name),
+						  &actual, error))
+				return STATUS_ERR;
+			if (actual != expected) {
+				asprintf(error,
+					 "Bad sock_diag %s for socket %d of %d: "
+					 "expected: %lld actual: %lld",
+					 field->name, i + 1, num_sockets,
+					 expected, actual);
+				return STATUS_ERR;
+			}
+		}
+	}
+	return STATUS_OK;
+}
+
+/* sock_diag(fd, [name=value, ...]) is not a real system call. It asks
+ * the kernel over NETLINK_SOCK_DIAG about the sockets on the local port
+ * of fd (and on its remote port and address, if it is connected), and
+ * returns how many there are. A state=<TCP state> field picks only the
+ * sockets in that state, e.g. the pending connections of a listener.
+ * Every field must match for every socket reported.
+ */
+static int syscall_sock_diag(struct state *state, struct syscall_spec *syscall,
+			     struct expression_list *args, char **error)
+{
+	struct expression *fields_expression;
+	struct expression_list *list;
+	struct sock_diag_socket *sockets = NULL;
+	int script_fd, live_fd, result = 0;
+	u32 states = SOCK_DIAG_ALL_STATES;
+	bool has_state = false;
+	int status = STATUS_ERR;
+
+	if (check_arg_count(args, 2, error))
+		goto error_out;
+	if (s32_arg(args, 0, &script_fd, error))
+		goto error_out;
+	if (to_live_fd(state, script_fd, &live_fd, error))
+		goto error_out;
+	fields_expression = get_arg(args, 1, error);
+	if (fields_expression == NULL)
+		goto error_out;
+	if (check_type(fields_expression, EXPR_LIST, error))
+		goto error_out;
+
+	/* Check the fields before we ask the kernel anything. */
+	for (list = fields_expression->value.list; list != NULL;
+	     list = list->next) {
+		struct field_expr *field;
+
+		if (check_type(list->expression, EXPR_FIELD, error))
+			goto error_out;
+		field = list->expression->value.field;
+		if (check_type(field->value, EXPR_INTEGER, error))
+			goto error_out;
+		if (sock_diag_field_lookup(field->name) == NULL) {
+			asprintf(error, "unknown sock_diag field: %s",
+				 field->name);
+			goto error_out;
+		}
+		if (strcmp(field->name, "state") == 0) {
+			if (has_state) {
+				asprintf(error, "duplicate sock_diag field: "
+					 "state");
+				goto error_out;
+			}
+			has_state = true;
+			if (field->value->value.num < 0 ||
+			    field->value->value.num > 31) {
+				asprintf(error, "bad TCP state: %lld",
+					 field->value->value.num);
+				goto error_out;
+			}
+			states = 1U << field->value->value.num;
+		}
+	}
+
+	begin_syscall(state, syscall);
+
+	result = sock_diag_query(live_fd, states, &sockets);
+
+	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
+		goto error_out;
+
+	if (sock_diag_check(fields_expression->value.list,
+			    sockets, result, error))
+		goto error_out;
+
+	status = STATUS_OK;
+
+error_out:
+	if (sockets != NULL)
+		sock_diag_sockets_free(sockets, result);
+	return status;
+}
+#endif  /* linux */
+
+/* A dispatch table with all the system calls that we support... */
+struct system_call_entry {
+	const char *name;
+	int (*function) (struct state *state,
+			 struct syscall_spec *syscall,
+			 struct expression_list *args,
+			 char **error);
+};
+struct system_call_entry system_call_table[] = {
+	{"socket",     syscall_socket},
+	{"bind",       syscall_bind},
+	{"listen",     syscall_listen},
+	{"accept",     syscall_accept},
+	{"connect",    syscall_connect},
+	{"read",       syscall_read},
+	{"readv",      syscall_readv},
+	{"recv",       syscall_recv},
+	{"recvfrom",   syscall_recvfrom},
+	{"recvmsg",    syscall_recvmsg},
+#ifdef linux
+	{"recvmmsg",   syscall_recvmmsg},
+#endif  /* linux */
+	{"write",      syscall_write},
+	{"writev",     syscall_writev},
+	{"send",       syscall_send},
+	{"sendto",     syscall_sendto},
+	{"sendmsg",    syscall_sendmsg},
+#ifdef linux
+	{"sendmmsg",   syscall_sendmmsg},
+#endif  /* linux */
+	{"fcntl",      syscall_fcntl},
+	{"ioctl",      syscall_ioctl},
+	{"close",      syscall_close},
+	{"shutdown",   syscall_shutdown},
+	{"getsockopt", syscall_getsockopt},
+	{"setsockopt", syscall_setsockopt},
+	{"poll",       syscall_poll},
+#ifdef linux
+	{"pipe",       syscall_pipe},
+	{"memfd_create", syscall_memfd_create},
+	{"sendfile",   syscall_sendfile},
+	{"splice",     syscall_splice},
+	{"mmap",       syscall_mmap},
+	{"io_uring_setup", syscall_io_uring_setup},
+	{"io_uring_submit", syscall_io_uring_submit},
+	{"io_uring_wait", syscall_io_uring_wait},
+	{"epoll_create1", syscall_epoll_create1},
+	{"epoll_ctl",  syscall_epoll_ctl},
+	{"epoll_wait", syscall_epoll_wait},
+	{"sock_diag",  syscall_sock_diag},
+#endif  /* linux */
+	{"mp_join_accept",	mp_join_accept}
+};
+
+/* Return the socket a replayed accept() returns: the first passive
+ * connection not yet accepted, or the one whose SYN named the fd.
+ */
+static struct socket *find_replay_accept_socket(struct state *state,
+						int script_accepted_fd)
+{
+	struct socket *socket = NULL;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if ((socket->state == SOCKET_PASSIVE_SYNACK_SENT ||
+		     socket->state == SOCKET_PASSIVE_SYNACK_ACKED) &&
+		    socket->live.fd < 0 &&
+		    (socket->script.fd < 0 ||
+		     socket->script.fd == script_accepted_fd))
+			return socket;
+	}
+	return NULL;
+}
+
+/* In a replay, instead of making the system call, check the outcome
+ * the trace recorded for it against the script, and update our socket
+ * state the way the handler would have. Other calls' side effects are
+ * not replayed; later calls on their fds only check recorded outcomes.
+ * A blocking call returns once the replay clock reaches the time it
+ * returned in the recorded run.
+ */
+static int replay_system_call(struct state *state,
+			      struct syscall_spec *syscall,
+			      struct expression_list *args, char **error)
+{
+	const char *name = syscall->name;
+	const int line = syscall_line(state, syscall);
+	const struct pcapng_syscall *recorded = replay_syscall(line);
+	struct sockaddr_storage live_addr;
+	socklen_t live_addrlen = sizeof(live_addr);
+	struct socket *socket = NULL;
+	int script_fd = -1, live_fd = -1, protocol = 0;
+
+	if (recorded == NULL) {
+		asprintf(error, "no outcome in the --replay trace for line %d",
+			 line);
+		return STATUS_ERR;
+	}
+	if (strcmp(recorded->name, name) != 0) {
+		asprintf(error, "the --replay trace has a %s call at line %d",
+			 recorded->name, line);
+		return STATUS_ERR;
+	}
+
+	/* Socket state the handlers set up before the call. */
+	if (strcmp(name, "socket") == 0) {
+		if (s32_arg(args, 2, &protocol, error))
+			return STATUS_ERR;
+	} else if (strcmp(name, "bind") == 0) {
+		if (s32_arg(args, 0, &script_fd, error) ||
+		    set_bind_sockaddr_config(state, get_arg(args, 1, NULL),
+					     script_fd))
+			return STATUS_ERR;
+	} else if (strcmp(name, "connect") == 0 ||
+		   strcmp(name, "sendto") == 0) {
+		if (s32_arg(args, 0, &script_fd, error) ||
+		    run_syscall_connect(state, script_fd,
+					strcmp(name, "connect") == 0,
+					(struct sockaddr *)&live_addr,
+					&live_addrlen, error))
+			return STATUS_ERR;
+	} else if (strcmp(name, "listen") == 0 ||
+		   strcmp(name, "close") == 0) {
+		if (s32_arg(args, 0, &script_fd, error))
+			return STATUS_ERR;
+	}
+
+	state->syscalls->replay_end_usecs = recorded->end_usecs;
+	begin_syscall(state, syscall);
+	if (is_blocking_syscall(syscall)) {
+		run_lock(state);
+		while (now_usecs() < recorded->end_usecs)
+			replay_wait_clock(&state->mutex);
+		run_unlock(state);
+	}
+	errno = recorded->err;
+	if (end_syscall(state, syscall, recorded->check, recorded->result,
+			error))
+		return STATUS_ERR;
+	if (is_blocking_syscall(syscall))
+		state->syscalls->live_end_usecs = recorded->end_usecs;
+	if (recorded->result < 0)
+		return STATUS_OK;
+
+	/* Socket state the handlers set up after the call. */
+	if (strcmp(name, "socket") == 0) {
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		return run_syscall_socket(state, state->config->socket_domain,
+					  protocol, script_fd,
+					  recorded->result, error);
+	} else if (strcmp(name, "listen") == 0) {
+		if (to_live_fd(state, script_fd, &live_fd, error))
+			return STATUS_ERR;
+		return run_syscall_listen(state, script_fd, live_fd, error);
+	} else if (strcmp(name, "accept") == 0) {
+		if (get_s32(syscall->result, &script_fd, error))
+			return STATUS_ERR;
+		socket = find_replay_accept_socket(state, script_fd);
+		if (socket == NULL) {
+			asprintf(error, "unable to find socket matching "
+				 "accept() call");
+			return STATUS_ERR;
+		}
+		ip_to_sockaddr(&socket->live.remote.ip,
+			       ntohs(socket->live.remote.port),
+			       (struct sockaddr *)&live_addr, &live_addrlen);
+		return run_syscall_accept(state, script_fd, recorded->result,
+					  (struct sockaddr *)&live_addr,
+					  live_addrlen, error);
+	} else if (strcmp(name, "close") == 0) {
+		socket = find_socket_by_script_fd(state, script_fd);
+		if (socket != NULL)
+			return run_syscall_close(state, script_fd,
+						 socket->live.fd, error);
+	}
+	return STATUS_OK;
+}
+
+void advance_replay_clock(struct state *state, s64 live_usecs)
+{
+	struct syscalls *syscalls = state->syscalls;
+
+	while (syscalls->state == SYSCALL_RUNNING &&
+	       syscalls->replay_end_usecs <= live_usecs) {
+		replay_set_clock(syscalls->replay_end_usecs);
+		while (syscalls->state != SYSCALL_IDLE) {
+			if (pthread_cond_wait(&syscalls->idle,
+					      &state->mutex) != 0)
+				die_perror("pthread_cond_wait");
+		}
+	}
+	replay_set_clock(live_usecs);
+}
+
+/* Evaluate the system call arguments and invoke the system call. */
+static void invoke_system_call(
+	struct state *state, struct event *event, struct syscall_spec *syscall)
+{
+	DEBUGP("%d: invoke call: %s\n", event->line_number, syscall->name);
+
+	char *error = NULL;
+	const char *name = syscall->name;
+	struct expression_list *args = NULL;
+	int i = 0;
+	int result = 0;
+
+	/* Wait for the right time before firing off this event. */
+	wait_for_event(state);
+
+	/* Find and invoke the handler for this system call. */
+	for (i = 0; i < ARRAY_SIZE(system_call_table); ++i)
+		if (strcmp(name, system_call_table[i].name) == 0)
+			break;
+	if (i == ARRAY_SIZE(system_call_table)) {
+		asprintf(&error, "Unknown system call: '%s'", name);
+		goto error_out;
+	}
+
+	/* Evaluate script symbolic expressions to get live numeric args for
+	 * system calls.
+	 */
+	if (evaluate_expression_list(syscall->arguments, &args, &error))
+		goto error_out;
+
+	/* Run the system call, or in a replay, check its recorded outcome.
+	 * Pseudo calls that only update our own state run as usual.
+	 */
+	if (replay_is_active() &&
+	    system_call_table[i].function != mp_join_accept)
+		result = replay_system_call(state, syscall, args, &error);
+	else
+		result = system_call_table[i].function(state, syscall, args,
+						       &error);
 
 	free_expression_list(args);
 
@@ -1922,6 +3574,7 @@ static void enqueue_system_call(
 
 	/* Enqueue the system call info and wake up the syscall thread. */
 	DEBUGP("main thread: signal enqueued\n");
+	PROBE1(syscall__enqueue, state->event->line_number);
 	state->syscalls->state = SYSCALL_ENQUEUED;
 	if (pthread_cond_signal(&state->syscalls->enqueued) != 0)
 		die_perror("pthread_cond_signal");
@@ -1995,6 +3648,9 @@ static void *system_call_thread(void *arg)
 	state->syscalls->thread_id = gettid();
 	if (state->syscalls->thread_id < 0)
 		die_perror("gettid");
+	if (state->perf != NULL)
+		perf_counters_add_thread(state->perf,
+					 state->syscalls->thread_id);
 
 	while (!done) {
 		DEBUGP("syscall thread: in state %d\n",
@@ -2036,8 +3692,11 @@ static void *system_call_thread(void *arg)
 
 			/* Check end time for the blocking system call. */
 			assert(state->syscalls->live_end_usecs >= 0);
+			PROBE2(syscall__end, event->line_number,
+			       state->syscalls->live_end_usecs);
 			if (verify_time(state,
 						event->time_type,
+						TOLERANCE_KERNEL,
 						syscall->end_usecs, 0,
 						state->syscalls->live_end_usecs,
 						"system call return", &error)) {
@@ -30,8 +30,20 @@
 #include <pthread.h>
 #include "script.h"
 
+struct io_uring_ring;
 struct state;
 
+/* A file descriptor that the script created and that is not a socket,
+ * e.g. an epoll instance. Sockets are tracked by struct socket.
+ */
+struct fd_mapping {
+	int script_fd;			/* fd number used in the script */
+	int live_fd;			/* fd number from the live system */
+	bool is_closed;			/* has app called close(2) ? */
+	struct io_uring_ring *ring;	/* rings if an io_uring, or NULL */
+	struct fd_mapping *next;	/* next in linked list of fds */
+};
+
 /* States in which the system call thread can be. */
 enum syscall_state_t {
 	SYSCALL_IDLE,		/* system call thread is idle */
@@ -48,6 +60,7 @@ struct syscalls {
 	enum syscall_state_t state;	/* current state of syscall thread */
 	struct event *event;		/* current system call it's running */
 	s64 live_end_usecs;		/* time of last system call return */
+	s64 replay_end_usecs;		/* --replay: recorded return time */
 
 	/* Handles for the syscall thread, for blocking system calls. */
 	pthread_t thread;		/* pthread thread handle */
@@ -95,4 +108,10 @@ void run_system_call_event(struct state *state,
 			   struct event *event,
 			   struct syscall_spec *syscall);
 
+/* In a replay, move the replay clock forward to the given live time.
+ * If a blocking system call returned by then in the recorded run, we
+ * first let it finish at its recorded time.
+ */
+extern void advance_replay_clock(struct state *state, s64 live_usecs);
+
 #endif /* __RUN_SYSTEM_CALL_H__ */
@@ -26,8 +26,15 @@
 
 #include <assert.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stdlib.h>
+#ifdef linux
+#include <sys/epoll.h>
+#endif
 
+#include "event_stream.h"
+#include "logging.h"
+#include "perfect_hash.h"
 #include "symbols.h"
 
 /* Fill in a value representing the given expression in
@@ -44,6 +51,26 @@ void init_script(struct script *script)
 	script->option_list = NULL;
 	script->init_command = NULL;
 	script->event_list = NULL;
+	script->arena = arena_new();
+}
+
+void script_free(struct script *script)
+{
+	struct event *event = NULL;
+
+	/* Packets are not in the arena, since we copy and free them with
+	 * the packet routines we use for live packets.
+	 */
+	for (event = script->event_list; event != NULL; event = event->next) {
+		if (event->type == PACKET_EVENT)
+			packet_free(event->event.packet);
+	}
+	if (script->stream != NULL)
+		event_stream_free(script->stream);
+
+	free(script->buffer);
+	arena_free(script->arena);
+	memset(script, 0, sizeof(*script));  /* paranoia to help catch bugs */
 }
 
 /* This table maps expression types to human-readable strings */
@@ -65,6 +92,14 @@ struct expression_type_entry expression_type_table[] = {
 	{ EXPR_IOVEC,                "iovec" },
 	{ EXPR_MSGHDR,               "msghdr" },
 	{ EXPR_POLLFD,               "pollfd" },
+	{ EXPR_EPOLLEV,              "epoll_event" },
+	{ EXPR_MMSGHDR,              "mmsghdr" },
+	{ EXPR_CMSGHDR,              "cmsghdr" },
+	{ EXPR_SOCK_EXTENDED_ERR,    "sock_extended_err" },
+	{ EXPR_IO_URING_SQE,         "io_uring_sqe" },
+	{ EXPR_IO_URING_CQE,         "io_uring_cqe" },
+	{ EXPR_TCP_ZEROCOPY_RECEIVE, "tcp_zerocopy_receive" },
+	{ EXPR_FIELD,                "field" },
 	{ NUM_EXPR_TYPES,            NULL}
 };
 
@@ -105,30 +140,96 @@ struct int_symbol cross_platform_symbols[] = {
 	{ 0, NULL },
 };
 
-/* Do a symbol->int lookup, and return true iff we found the symbol. */
-static bool lookup_int_symbol(const char *input_symbol, s64 *output_integer,
-			      struct int_symbol *symbols)
+/* All the symbols we know, with a perfect hash of their names. If a
+ * name is in the tables more than once, we keep its first entry, as a
+ * scan of the cross-platform table and then the platform table would.
+ * We build this once, on the first lookup, since the symbols in the
+ * platform table depend on the headers we are built against.
+ */
+static struct int_symbol *all_symbols;
+static const char **all_symbol_names;
+static struct perfect_hash *symbol_hash;
+static pthread_once_t symbol_hash_once = PTHREAD_ONCE_INIT;
+
+/* A symbol table entry, and its position in the order we scan them. */
+struct ordered_symbol {
+	const struct int_symbol *symbol;
+	int order;
+};
+
+/* Order entries by name, then by scan order. */
+static int compare_symbols(const void *a, const void *b)
+{
+	const struct ordered_symbol *symbol_a = a, *symbol_b = b;
+	int result = strcmp(symbol_a->symbol->name, symbol_b->symbol->name);
+
+	if (result != 0)
+		return result;
+	return symbol_a->order - symbol_b->order;
+}
+
+/* Append the entries of the table to the array, and return the new
+ * number of entries in the array.
+ */
+static int append_symbols(struct ordered_symbol *array, int n,
+			  const struct int_symbol *table)
 {
 	int i;
-	for (i = 0; symbols[i].name != NULL ; ++i) {
-		if (strcmp(input_symbol, symbols[i].name) == 0) {
-			*output_integer = symbols[i].value;
-			return true;
+
+	for (i = 0; table[i].name != NULL; ++i, ++n) {
+		if (array != NULL) {
+			array[n].symbol = &table[i];
+			array[n].order = n;
 		}
 	}
-	return false;
+	return n;
+}
+
+static void build_symbol_hash(void)
+{
+	const struct int_symbol *platform = platform_symbols();
+	struct ordered_symbol *sorted = NULL;
+	int num_symbols = 0, num_unique = 0;
+	int i;
+
+	num_symbols = append_symbols(NULL, 0, cross_platform_symbols);
+	num_symbols = append_symbols(NULL, num_symbols, platform);
+
+	sorted = calloc(num_symbols, sizeof(struct ordered_symbol));
+	i = append_symbols(sorted, 0, cross_platform_symbols);
+	append_symbols(sorted, i, platform);
+	qsort(sorted, num_symbols, sizeof(struct ordered_symbol),
+	      compare_symbols);
+
+	all_symbols = calloc(num_symbols, sizeof(struct int_symbol));
+	all_symbol_names = calloc(num_symbols, sizeof(char *));
+	for (i = 0; i < num_symbols; ++i) {
+		if (num_unique > 0 &&
+		    strcmp(all_symbol_names[num_unique - 1],
+			   sorted[i].symbol->name) == 0)
+			continue;	/* a later entry for the same name */
+		all_symbols[num_unique] = *sorted[i].symbol;
+		all_symbol_names[num_unique] = sorted[i].symbol->name;
+		++num_unique;
+	}
+	free(sorted);
+
+	symbol_hash = perfect_hash_new(all_symbol_names, num_unique);
 }
 
 int symbol_to_int(const char *input_symbol, s64 *output_integer,
 		  char **error)
 {
-	if (lookup_int_symbol(input_symbol, output_integer,
-			      cross_platform_symbols))
-		return STATUS_OK;
+	int i;
+
+	if (pthread_once(&symbol_hash_once, build_symbol_hash) != 0)
+		die_perror("pthread_once");
 
-	if (lookup_int_symbol(input_symbol, output_integer,
-			      platform_symbols()))
+	i = perfect_hash_lookup(symbol_hash, input_symbol);
+	if (i >= 0) {
+		*output_integer = all_symbols[i].value;
 		return STATUS_OK;
+	}
 
 	asprintf(error, "unknown symbol: '%s'", input_symbol);
 	return STATUS_ERR;
@@ -175,6 +276,34 @@ struct flag_name poll_flags[] = {
 	{ 0, "" },
 };
 
+/* Names for the events bit mask flags for epoll system calls */
+struct flag_name epoll_flags[] = {
+
+#ifdef linux
+	{ EPOLLIN,	"EPOLLIN" },
+	{ EPOLLPRI,	"EPOLLPRI" },
+	{ EPOLLOUT,	"EPOLLOUT" },
+	{ EPOLLRDNORM,	"EPOLLRDNORM" },
+	{ EPOLLRDBAND,	"EPOLLRDBAND" },
+	{ EPOLLWRNORM,	"EPOLLWRNORM" },
+	{ EPOLLWRBAND,	"EPOLLWRBAND" },
+	{ EPOLLMSG,	"EPOLLMSG" },
+	{ EPOLLERR,	"EPOLLERR" },
+	{ EPOLLHUP,	"EPOLLHUP" },
+	{ EPOLLRDHUP,	"EPOLLRDHUP" },
+#ifdef EPOLLEXCLUSIVE
+	{ EPOLLEXCLUSIVE, "EPOLLEXCLUSIVE" },
+#endif
+#ifdef EPOLLWAKEUP
+	{ EPOLLWAKEUP,	"EPOLLWAKEUP" },
+#endif
+	{ EPOLLONESHOT,	"EPOLLONESHOT" },
+	{ EPOLLET,	"EPOLLET" },
+#endif  /* linux */
+
+	{ 0, "" },
+};
+
 /* Return the human-readable ASCII string corresponding to a given
  * flag value, or "???" if none matches.
  */
@@ -307,6 +436,7 @@ void free_expression(struct expression *expression)
 		free_expression(expression->value.msghdr->msg_namelen);
 		free_expression(expression->value.msghdr->msg_iov);
 		free_expression(expression->value.msghdr->msg_iovlen);
+		free_expression(expression->value.msghdr->msg_control);
 		free_expression(expression->value.msghdr->msg_flags);
 		break;
 	case EXPR_POLLFD:
@@ -315,6 +445,57 @@ void free_expression(struct expression *expression)
 		free_expression(expression->value.pollfd->events);
 		free_expression(expression->value.pollfd->revents);
 		break;
+	case EXPR_EPOLLEV:
+		assert(expression->value.epollev);
+		free_expression(expression->value.epollev->events);
+		free_expression(expression->value.epollev->fd);
+		break;
+	case EXPR_MMSGHDR:
+		assert(expression->value.mmsghdr);
+		free_expression(expression->value.mmsghdr->msg_hdr);
+		free_expression(expression->value.mmsghdr->msg_len);
+		break;
+	case EXPR_CMSGHDR:
+		assert(expression->value.cmsghdr);
+		free_expression(expression->value.cmsghdr->cmsg_level);
+		free_expression(expression->value.cmsghdr->cmsg_type);
+		free_expression(expression->value.cmsghdr->cmsg_data);
+		break;
+	case EXPR_SOCK_EXTENDED_ERR:
+		assert(expression->value.sock_extended_err);
+		free_expression(expression->value.sock_extended_err->ee_errno);
+		free_expression(expression->value.sock_extended_err->ee_origin);
+		free_expression(expression->value.sock_extended_err->ee_type);
+		free_expression(expression->value.sock_extended_err->ee_code);
+		free_expression(expression->value.sock_extended_err->ee_info);
+		free_expression(expression->value.sock_extended_err->ee_data);
+		break;
+	case EXPR_IO_URING_SQE:
+		assert(expression->value.io_uring_sqe);
+		free_expression(expression->value.io_uring_sqe->opcode);
+		free_expression(expression->value.io_uring_sqe->fd);
+		free_expression(expression->value.io_uring_sqe->len);
+		free_expression(expression->value.io_uring_sqe->msg_flags);
+		free_expression(expression->value.io_uring_sqe->user_data);
+		break;
+	case EXPR_IO_URING_CQE:
+		assert(expression->value.io_uring_cqe);
+		free_expression(expression->value.io_uring_cqe->user_data);
+		free_expression(expression->value.io_uring_cqe->res);
+		break;
+	case EXPR_TCP_ZEROCOPY_RECEIVE:
+		assert(expression->value.tcp_zerocopy_receive);
+		free_expression(expression->value.tcp_zerocopy_receive->address);
+		free_expression(expression->value.tcp_zerocopy_receive->length);
+		free_expression(
+			expression->value.tcp_zerocopy_receive->recv_skip_hint);
+		break;
+	case EXPR_FIELD:
+		assert(expression->value.field);
+		free(expression->value.field->name);
+		free_expression(expression->value.field->value);
+		free(expression->value.field);
+		break;
 	case EXPR_NONE:
 	case NUM_EXPR_TYPES:
 		break;
@@ -424,6 +605,9 @@ static int evaluate_msghdr_expression(struct expression *in,
 		return STATUS_ERR;
 	if (evaluate(in_msg->msg_iovlen,	&out_msg->msg_iovlen,	error))
 		return STATUS_ERR;
+	if (in_msg->msg_control != NULL &&
+	    evaluate(in_msg->msg_control,	&out_msg->msg_control,	error))
+		return STATUS_ERR;
 	if (evaluate(in_msg->msg_flags,		&out_msg->msg_flags,	error))
 		return STATUS_ERR;
 
@@ -455,6 +639,206 @@ static int evaluate_pollfd_expression(struct expression *in,
 	return STATUS_OK;
 }
 
+static int evaluate_epollev_expression(struct expression *in,
+				       struct expression *out, char **error)
+{
+	struct epollev_expr *in_epollev;
+	struct epollev_expr *out_epollev;
+
+	assert(in->type == EXPR_EPOLLEV);
+	assert(in->value.epollev);
+	assert(out->type == EXPR_EPOLLEV);
+
+	out->value.epollev = calloc(1, sizeof(struct epollev_expr));
+
+	in_epollev = in->value.epollev;
+	out_epollev = out->value.epollev;
+
+	if (evaluate(in_epollev->events,	&out_epollev->events,	error))
+		return STATUS_ERR;
+	if (evaluate(in_epollev->fd,		&out_epollev->fd,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_mmsghdr_expression(struct expression *in,
+				       struct expression *out, char **error)
+{
+	struct mmsghdr_expr *in_mmsg;
+	struct mmsghdr_expr *out_mmsg;
+
+	assert(in->type == EXPR_MMSGHDR);
+	assert(in->value.mmsghdr);
+	assert(out->type == EXPR_MMSGHDR);
+
+	out->value.mmsghdr = calloc(1, sizeof(struct mmsghdr_expr));
+
+	in_mmsg = in->value.mmsghdr;
+	out_mmsg = out->value.mmsghdr;
+
+	if (evaluate(in_mmsg->msg_hdr,		&out_mmsg->msg_hdr,	error))
+		return STATUS_ERR;
+	if (evaluate(in_mmsg->msg_len,		&out_mmsg->msg_len,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_cmsghdr_expression(struct expression *in,
+				       struct expression *out, char **error)
+{
+	struct cmsghdr_expr *in_cmsg;
+	struct cmsghdr_expr *out_cmsg;
+
+	assert(in->type == EXPR_CMSGHDR);
+	assert(in->value.cmsghdr);
+	assert(out->type == EXPR_CMSGHDR);
+
+	out->value.cmsghdr = calloc(1, sizeof(struct cmsghdr_expr));
+
+	in_cmsg = in->value.cmsghdr;
+	out_cmsg = out->value.cmsghdr;
+
+	if (evaluate(in_cmsg->cmsg_level,	&out_cmsg->cmsg_level,	error))
+		return STATUS_ERR;
+	if (evaluate(in_cmsg->cmsg_type,	&out_cmsg->cmsg_type,	error))
+		return STATUS_ERR;
+	if (evaluate(in_cmsg->cmsg_data,	&out_cmsg->cmsg_data,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_sock_extended_err_expression(struct expression *in,
+						 struct expression *out,
+						 char **error)
+{
+	struct sock_extended_err_expr *in_ee;
+	struct sock_extended_err_expr *out_ee;
+
+	assert(in->type == EXPR_SOCK_EXTENDED_ERR);
+	assert(in->value.sock_extended_err);
+	assert(out->type == EXPR_SOCK_EXTENDED_ERR);
+
+	out->value.sock_extended_err =
+		calloc(1, sizeof(struct sock_extended_err_expr));
+
+	in_ee = in->value.sock_extended_err;
+	out_ee = out->value.sock_extended_err;
+
+	if (evaluate(in_ee->ee_errno,		&out_ee->ee_errno,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_origin,		&out_ee->ee_origin,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_type,		&out_ee->ee_type,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_code,		&out_ee->ee_code,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_info,		&out_ee->ee_info,	error))
+		return STATUS_ERR;
+	if (evaluate(in_ee->ee_data,		&out_ee->ee_data,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_io_uring_sqe_expression(struct expression *in,
+					    struct expression *out,
+					    char **error)
+{
+	struct io_uring_sqe_expr *in_sqe;
+	struct io_uring_sqe_expr *out_sqe;
+
+	assert(in->type == EXPR_IO_URING_SQE);
+	assert(in->value.io_uring_sqe);
+	assert(out->type == EXPR_IO_URING_SQE);
+
+	out->value.io_uring_sqe = calloc(1, sizeof(struct io_uring_sqe_expr));
+
+	in_sqe = in->value.io_uring_sqe;
+	out_sqe = out->value.io_uring_sqe;
+
+	if (evaluate(in_sqe->opcode,		&out_sqe->opcode,	error))
+		return STATUS_ERR;
+	if (evaluate(in_sqe->fd,		&out_sqe->fd,		error))
+		return STATUS_ERR;
+	if (evaluate(in_sqe->len,		&out_sqe->len,		error))
+		return STATUS_ERR;
+	if (evaluate(in_sqe->msg_flags,		&out_sqe->msg_flags,	error))
+		return STATUS_ERR;
+	if (evaluate(in_sqe->user_data,		&out_sqe->user_data,	error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_io_uring_cqe_expression(struct expression *in,
+					    struct expression *out,
+					    char **error)
+{
+	struct io_uring_cqe_expr *in_cqe;
+	struct io_uring_cqe_expr *out_cqe;
+
+	assert(in->type == EXPR_IO_URING_CQE);
+	assert(in->value.io_uring_cqe);
+	assert(out->type == EXPR_IO_URING_CQE);
+
+	out->value.io_uring_cqe = calloc(1, sizeof(struct io_uring_cqe_expr));
+
+	in_cqe = in->value.io_uring_cqe;
+	out_cqe = out->value.io_uring_cqe;
+
+	if (evaluate(in_cqe->user_data,		&out_cqe->user_data,	error))
+		return STATUS_ERR;
+	if (evaluate(in_cqe->res,		&out_cqe->res,		error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_tcp_zerocopy_receive_expression(struct expression *in,
+						    struct expression *out,
+						    char **error)
+{
+	struct tcp_zerocopy_receive_expr *in_zc;
+	struct tcp_zerocopy_receive_expr *out_zc;
+
+	assert(in->type == EXPR_TCP_ZEROCOPY_RECEIVE);
+	assert(in->value.tcp_zerocopy_receive);
+	assert(out->type == EXPR_TCP_ZEROCOPY_RECEIVE);
+
+	out->value.tcp_zerocopy_receive =
+		calloc(1, sizeof(struct tcp_zerocopy_receive_expr));
+
+	in_zc = in->value.tcp_zerocopy_receive;
+	out_zc = out->value.tcp_zerocopy_receive;
+
+	if (evaluate(in_zc->address,		&out_zc->address,	error))
+		return STATUS_ERR;
+	if (evaluate(in_zc->length,		&out_zc->length,	error))
+		return STATUS_ERR;
+	if (evaluate(in_zc->recv_skip_hint,	&out_zc->recv_skip_hint,
+		     error))
+		return STATUS_ERR;
+
+	return STATUS_OK;
+}
+
+static int evaluate_field_expression(struct expression *in,
+				     struct expression *out, char **error)
+{
+	assert(in->type == EXPR_FIELD);
+	assert(in->value.field);
+	assert(out->type == EXPR_FIELD);
+
+	out->value.field = calloc(1, sizeof(struct field_expr));
+	out->value.field->name = strdup(in->value.field->name);
+
+	return evaluate(in->value.field->value, &out->value.field->value,
+			error);
+}
+
 static int evaluate(struct expression *in,
 		    struct expression **out_ptr, char **error)
 {
@@ -517,6 +901,31 @@ static int evaluate(struct expression *in,
 	case EXPR_POLLFD:
 		result = evaluate_pollfd_expression(in, out, error);
 		break;
+	case EXPR_EPOLLEV:
+		result = evaluate_epollev_expression(in, out, error);
+		break;
+	case EXPR_MMSGHDR:
+		result = evaluate_mmsghdr_expression(in, out, error);
+		break;
+	case EXPR_CMSGHDR:
+		result = evaluate_cmsghdr_expression(in, out, error);
+		break;
+	case EXPR_SOCK_EXTENDED_ERR:
+		result = evaluate_sock_extended_err_expression(in, out, error);
+		break;
+	case EXPR_IO_URING_SQE:
+		result = evaluate_io_uring_sqe_expression(in, out, error);
+		break;
+	case EXPR_IO_URING_CQE:
+		result = evaluate_io_uring_cqe_expression(in, out, error);
+		break;
+	case EXPR_TCP_ZEROCOPY_RECEIVE:
+		result = evaluate_tcp_zerocopy_receive_expression(in, out,
+								  error);
+		break;
+	case EXPR_FIELD:
+		result = evaluate_field_expression(in, out, error);
+		break;
 	case EXPR_NONE:
 	case NUM_EXPR_TYPES:
 		break;
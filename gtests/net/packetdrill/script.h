@@ -28,8 +28,11 @@
 #include "types.h"
 
 #include <sys/time.h>
+#include "arena.h"
 #include "packet.h"
 
+struct event_stream;
+
 /* The types of expressions in a script */
 enum expression_t {
 	EXPR_NONE,
@@ -45,6 +48,14 @@ enum expression_t {
 	EXPR_IOVEC,		  /* expression tree for an iovec struct */
 	EXPR_MSGHDR,		  /* expression tree for a msghdr struct */
 	EXPR_POLLFD,		  /* expression tree for a pollfd struct */
+	EXPR_EPOLLEV,		  /* expression tree for an epoll_event struct */
+	EXPR_MMSGHDR,		  /* expression tree for a mmsghdr struct */
+	EXPR_CMSGHDR,		  /* expression tree for a cmsghdr struct */
+	EXPR_SOCK_EXTENDED_ERR,	  /* expression tree for sock_extended_err */
+	EXPR_IO_URING_SQE,	  /* expression tree for an io_uring SQE */
+	EXPR_IO_URING_CQE,	  /* expression tree for an io_uring CQE */
+	EXPR_TCP_ZEROCOPY_RECEIVE, /* expression tree for TCP_ZEROCOPY_RECEIVE */
+	EXPR_FIELD,		  /* name=value pair, e.g. for sock_diag */
 	NUM_EXPR_TYPES,
 };
 /* Convert an expression type to a human-readable string */
@@ -64,6 +75,14 @@ struct expression {
 		struct iovec_expr *iovec;
 		struct msghdr_expr *msghdr;
 		struct pollfd_expr *pollfd;
+		struct epollev_expr *epollev;
+		struct mmsghdr_expr *mmsghdr;
+		struct cmsghdr_expr *cmsghdr;
+		struct sock_extended_err_expr *sock_extended_err;
+		struct io_uring_sqe_expr *io_uring_sqe;
+		struct io_uring_cqe_expr *io_uring_cqe;
+		struct tcp_zerocopy_receive_expr *tcp_zerocopy_receive;
+		struct field_expr *field;
 	} value;
 	const char *format;	/* the printf format for printing the value */
 };
@@ -95,9 +114,39 @@ struct msghdr_expr {
 	struct expression *msg_namelen;
 	struct expression *msg_iov;
 	struct expression *msg_iovlen;
+	struct expression *msg_control;	/* list of cmsghdr, or NULL */
 	struct expression *msg_flags;
 };
 
+/* Parse tree for a mmsghdr struct in a sendmmsg/recvmmsg syscall. */
+struct mmsghdr_expr {
+	struct expression *msg_hdr;	/* msghdr */
+	struct expression *msg_len;	/* bytes transferred for this msg */
+};
+
+/* Parse tree for a cmsghdr struct in the msg_control of a recvmsg
+ * syscall. The cmsg_data is an integer, a sock_extended_err, or ...
+ * if the script does not care about the ancillary data itself.
+ */
+struct cmsghdr_expr {
+	struct expression *cmsg_level;
+	struct expression *cmsg_type;
+	struct expression *cmsg_data;
+};
+
+/* Parse tree for a sock_extended_err struct, as read from the socket
+ * error queue with recvmsg(MSG_ERRQUEUE), e.g. for MSG_ZEROCOPY
+ * completion notifications.
+ */
+struct sock_extended_err_expr {
+	struct expression *ee_errno;
+	struct expression *ee_origin;
+	struct expression *ee_type;
+	struct expression *ee_code;
+	struct expression *ee_info;
+	struct expression *ee_data;
+};
+
 /* Parse tree for a pollfd struct in a poll syscall. */
 struct pollfd_expr {
 	struct expression *fd;		/* file descriptor */
@@ -105,6 +154,52 @@ struct pollfd_expr {
 	struct expression *revents;	/* returned events */
 };
 
+/* Parse tree for an epoll_event struct in an epoll_ctl/epoll_wait
+ * syscall. We only support the data.fd member of the data union.
+ */
+struct epollev_expr {
+	struct expression *events;	/* epoll event bit mask */
+	struct expression *fd;		/* file descriptor in data.fd */
+};
+
+/* Parse tree for an io_uring submission queue entry in an
+ * io_uring_submit call. The harness fills in buffers and addresses.
+ */
+struct io_uring_sqe_expr {
+	struct expression *opcode;	/* IORING_OP_* */
+	struct expression *fd;		/* socket to operate on */
+	struct expression *len;		/* bytes to send or receive */
+	struct expression *msg_flags;	/* flags for send/recv */
+	struct expression *user_data;	/* tag to match the CQE */
+};
+
+/* Parse tree for an io_uring completion queue entry in an
+ * io_uring_wait call.
+ */
+struct io_uring_cqe_expr {
+	struct expression *user_data;	/* tag from the SQE */
+	struct expression *res;		/* result of the operation */
+};
+
+/* Parse tree for the tcp_zerocopy_receive struct passed to
+ * getsockopt(TCP_ZEROCOPY_RECEIVE). The harness supplies the address
+ * and length of the socket's mmap()-ed area, so the address is always
+ * ... and length and recv_skip_hint are the expected outputs.
+ */
+struct tcp_zerocopy_receive_expr {
+	struct expression *address;
+	struct expression *length;
+	struct expression *recv_skip_hint;
+};
+
+/* Parse tree for a named value, as in the list of socket fields that
+ * a sock_diag call checks: [state=TCP_ESTABLISHED, rqueue=0].
+ */
+struct field_expr {
+	char *name;			/* name of the field */
+	struct expression *value;	/* expected value */
+};
+
 /* The errno-related info from strace to summarize a system call error */
 struct errno_spec {
 	const char *errno_macro;	/* errno symbol (C macro name) */
@@ -137,6 +232,19 @@ struct command_spec {
 	const char *command_line;	/* executed with /bin/sh */
 };
 
+/* A pacing assertion for the train of outbound packets that follows
+ * it, up to the next pacing event. Each packet must depart within
+ * tolerance_usecs of the expected gap after the previous one: either
+ * a fixed gap_usecs, or the time the previous packet takes at
+ * rate bytes/sec. A NULL pacing_spec turns the checks off.
+ */
+struct pacing_spec {
+	s64 gap_usecs;		/* expected gap, or NO_PACING_GAP */
+	s64 rate;		/* expected rate in bytes/sec, if no gap */
+	s64 tolerance_usecs;	/* allowed error of each gap */
+};
+#define NO_PACING_GAP	-1		/* gap_usecs if pacing by rate */
+
 /* An ASCII text snippet of code to insert in the post-processing
  * output. This can be, for example, a snippet of Python to execute.
  */
@@ -151,6 +259,7 @@ enum event_t {
 	SYSCALL_EVENT,
 	COMMAND_EVENT,
 	CODE_EVENT,
+	PACING_EVENT,
 	NUM_EVENT_TYPES,
 };
 
@@ -178,6 +287,7 @@ struct event {
 		struct syscall_spec	*syscall;
 		struct command_spec	*command;
 		struct code_spec	*code;
+		struct pacing_spec	*pacing;
 	} event;		/* pointer to the event */
 	struct event *next;	/* next in linked list of events */
 };
@@ -197,8 +307,13 @@ struct option_list {
 };
 
 /* A parsed script. The script owns all of the data to which
- * it points. TODO: add a script_free() to free everything when we are
- * done executing the script, instead of leaking all that memory.
+ * it points. The options, events, and expressions the parser builds,
+ * and the strings they hold, are allocated from the script's arena;
+ * only the packets are allocated individually. script_free() frees
+ * it all once we are done executing the script.
+ *
+ * With --stream, the events are not in event_list; the run loop takes
+ * them from the stream while the parser is still running.
  */
 struct script {
 	struct option_list *option_list;    /* linked list of options */
@@ -206,6 +321,8 @@ struct script {
 	struct event	*event_list;	    /* linked list of all events */
 	char		*buffer;	    /* raw input text of the script */
 	int		length;		    /* number of bytes in the script */
+	struct arena	*arena;		    /* parse-time objects */
+	struct event_stream *stream;	    /* streamed events, or NULL */
 };
 
 /* A table entry mapping a bit mask to its human-readable name.
@@ -220,6 +337,11 @@ struct flag_name {
 /* Initialize a script object */
 extern void init_script(struct script *script);
 
+/* Free everything the script owns. The script must not be used again
+ * until it is re-initialized with init_script().
+ */
+extern void script_free(struct script *script);
+
 /* Look up the value of the given symbol, and fill it in. On success,
  * return STATUS_OK; if the symbol cannot be found, return
  * STATUS_ERR and fill in an error message in *error.
@@ -232,10 +354,13 @@ extern int symbol_to_int(const char *input_symbol, s64 *output_integer,
  * string. Caller must free() the memory.
  */
 extern struct flag_name poll_flags[];
+extern struct flag_name epoll_flags[];
 char *flags_to_string(struct flag_name *flags_array, u64 flags);
 
-/* Do a deep deallocation of a heap-allocated expression list,
- * including any other space that it points too.
+/* Do a deep deallocation of a heap-allocated expression,
+ * including any other space that it points too. This is for the
+ * evaluated copies we make at run time; expressions in a parsed script
+ * live in the script's arena and are freed by script_free().
  */
 extern void free_expression(struct expression *expression);
 
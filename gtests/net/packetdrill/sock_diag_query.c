@@ -0,0 +1,490 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for in-process NETLINK_SOCK_DIAG queries.
+ */
+
+#include "sock_diag_query.h"
+
+#ifdef linux
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/inet_diag.h>
+#include <linux/mptcp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include "logging.h"
+#include "tcp.h"
+
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP		262
+#endif
+
+/* Big enough for a batch of replies, as the kernel sizes its dumps. */
+#define SOCK_DIAG_BUFFER_BYTES	32768
+
+struct sock_diag_field {
+	const char *name;		/* name in scripts */
+	enum sock_diag_source source;	/* part of the reply it is in */
+	int offset;			/* byte offset in that part */
+	int bytes;			/* size of the value: 1, 2, 4 or 8 */
+};
+
+/* The offset and size of a struct member. */
+#define MEMBER(type, member)	offsetof(type, member), \
+				sizeof(((type *)0)->member)
+
+/* The offset and size of an SK_MEMINFO_* or MPTCP_SUBFLOW_ATTR_* value. */
+#define MEMINFO(index)		((index) * sizeof(u32)), sizeof(u32)
+#define SUBFLOW(attr)		((attr) * sizeof(u64)), sizeof(u64)
+
+static const struct sock_diag_field sock_diag_fields[] = {
+	{ "state",		DIAG_MSG, MEMBER(struct inet_diag_msg,
+						 idiag_state) },
+	{ "timer",		DIAG_MSG, MEMBER(struct inet_diag_msg,
+						 idiag_timer) },
+	{ "retrans",		DIAG_MSG, MEMBER(struct inet_diag_msg,
+						 idiag_retrans) },
+	{ "rqueue",		DIAG_MSG, MEMBER(struct inet_diag_msg,
+						 idiag_rqueue) },
+	{ "wqueue",		DIAG_MSG, MEMBER(struct inet_diag_msg,
+						 idiag_wqueue) },
+
+	{ "skmem_rmem_alloc",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_RMEM_ALLOC) },
+	{ "skmem_rcvbuf",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_RCVBUF) },
+	{ "skmem_wmem_alloc",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_WMEM_ALLOC) },
+	{ "skmem_sndbuf",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_SNDBUF) },
+	{ "skmem_fwd_alloc",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_FWD_ALLOC) },
+	{ "skmem_wmem_queued",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_WMEM_QUEUED) },
+	{ "skmem_optmem",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_OPTMEM) },
+	{ "skmem_backlog",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_BACKLOG) },
+	{ "skmem_drops",	DIAG_MEMINFO, MEMINFO(SK_MEMINFO_DROPS) },
+
+	{ "tcpi_state",		DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_state) },
+	{ "tcpi_ca_state",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_ca_state) },
+	{ "tcpi_retransmits",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_retransmits) },
+	{ "tcpi_probes",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_probes) },
+	{ "tcpi_backoff",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_backoff) },
+	{ "tcpi_options",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_options) },
+	{ "tcpi_rto",		DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rto) },
+	{ "tcpi_ato",		DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_ato) },
+	{ "tcpi_snd_mss",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_snd_mss) },
+	{ "tcpi_rcv_mss",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rcv_mss) },
+	{ "tcpi_unacked",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_unacked) },
+	{ "tcpi_sacked",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_sacked) },
+	{ "tcpi_lost",		DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_lost) },
+	{ "tcpi_retrans",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_retrans) },
+	{ "tcpi_fackets",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_fackets) },
+	{ "tcpi_pmtu",		DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_pmtu) },
+	{ "tcpi_rcv_ssthresh",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rcv_ssthresh) },
+	{ "tcpi_rtt",		DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rtt) },
+	{ "tcpi_rttvar",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rttvar) },
+	{ "tcpi_snd_ssthresh",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_snd_ssthresh) },
+	{ "tcpi_snd_cwnd",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_snd_cwnd) },
+	{ "tcpi_advmss",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_advmss) },
+	{ "tcpi_reordering",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_reordering) },
+	{ "tcpi_rcv_rtt",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rcv_rtt) },
+	{ "tcpi_rcv_space",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_rcv_space) },
+	{ "tcpi_total_retrans",	DIAG_TCP_INFO, MEMBER(struct _tcp_info,
+						      tcpi_total_retrans) },
+
+	{ "mptcpi_subflows",	DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_subflows) },
+	{ "mptcpi_add_addr_signal", DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_add_addr_signal) },
+	{ "mptcpi_add_addr_accepted", DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_add_addr_accepted) },
+	{ "mptcpi_subflows_max", DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_subflows_max) },
+	{ "mptcpi_add_addr_signal_max", DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_add_addr_signal_max) },
+	{ "mptcpi_add_addr_accepted_max", DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_add_addr_accepted_max) },
+	{ "mptcpi_flags",	DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_flags) },
+	{ "mptcpi_token",	DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_token) },
+	{ "mptcpi_write_seq",	DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_write_seq) },
+	{ "mptcpi_snd_una",	DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_snd_una) },
+	{ "mptcpi_rcv_nxt",	DIAG_MPTCP_INFO,
+	  MEMBER(struct mptcp_info, mptcpi_rcv_nxt) },
+
+	{ "subflow_token_rem",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_TOKEN_REM) },
+	{ "subflow_token_loc",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_TOKEN_LOC) },
+	{ "subflow_relwrite_seq", DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_RELWRITE_SEQ) },
+	{ "subflow_map_seq",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_MAP_SEQ) },
+	{ "subflow_map_sfseq",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_MAP_SFSEQ) },
+	{ "subflow_ssn_offset",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_SSN_OFFSET) },
+	{ "subflow_map_datalen", DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_MAP_DATALEN) },
+	{ "subflow_flags",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_FLAGS) },
+	{ "subflow_id_rem",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_ID_REM) },
+	{ "subflow_id_loc",	DIAG_SUBFLOW,
+	  SUBFLOW(MPTCP_SUBFLOW_ATTR_ID_LOC) },
+};
+
+static const char *sock_diag_source_names[NUM_DIAG_SOURCES] = {
+	[DIAG_MSG]		= "inet_diag_msg",
+	[DIAG_MEMINFO]		= "SK_MEMINFO",
+	[DIAG_TCP_INFO]		= "tcp_info",
+	[DIAG_MPTCP_INFO]	= "mptcp_info",
+	[DIAG_SUBFLOW]		= "MPTCP subflow info",
+};
+
+const struct sock_diag_field *sock_diag_field_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sock_diag_fields); ++i) {
+		if (strcmp(sock_diag_fields[i].name, name) == 0)
+			return &sock_diag_fields[i];
+	}
+	return NULL;
+}
+
+/* Keep a copy of the given bytes as the given part of the reply. */
+static void set_source(struct sock_diag_socket *socket,
+		       enum sock_diag_source source,
+		       const void *data, int bytes)
+{
+	free(socket->data[source]);
+	socket->data[source] = malloc(bytes);
+	memcpy(socket->data[source], data, bytes);
+	socket->bytes[source] = bytes;
+}
+
+/* Return the type of a netlink attribute, without the nested and byte
+ * order flags.
+ */
+static int attr_type(const struct rtattr *attr)
+{
+	return attr->rta_type & NLA_TYPE_MASK;
+}
+
+/* Widen the MPTCP subflow attributes in an INET_DIAG_ULP_INFO
+ * attribute to u64s indexed by attribute type.
+ */
+static void parse_ulp_info(struct sock_diag_socket *socket,
+			   struct rtattr *ulp)
+{
+	u64 subflow[MPTCP_SUBFLOW_ATTR_MAX + 1];
+	struct rtattr *attr, *nested;
+	int len, nested_len;
+
+	memset(subflow, 0, sizeof(subflow));
+	len = RTA_PAYLOAD(ulp);
+	for (attr = RTA_DATA(ulp); RTA_OK(attr, len);
+	     attr = RTA_NEXT(attr, len)) {
+		if (attr_type(attr) != INET_ULP_INFO_MPTCP)
+			continue;
+		nested_len = RTA_PAYLOAD(attr);
+		for (nested = RTA_DATA(attr); RTA_OK(nested, nested_len);
+		     nested = RTA_NEXT(nested, nested_len)) {
+			int type = attr_type(nested);
+			int bytes = RTA_PAYLOAD(nested);
+			const u8 *data = RTA_DATA(nested);
+
+			if (type > MPTCP_SUBFLOW_ATTR_MAX)
+				continue;
+			if (bytes == sizeof(u8))
+				subflow[type] = *data;
+			else if (bytes == sizeof(u16))
+				subflow[type] = *(const u16 *)data;
+			else if (bytes == sizeof(u32))
+				subflow[type] = *(const u32 *)data;
+			else if (bytes == sizeof(u64))
+				memcpy(&subflow[type], data, sizeof(u64));
+		}
+		set_source(socket, DIAG_SUBFLOW, subflow, sizeof(subflow));
+	}
+}
+
+/* Fill in the socket from a SOCK_DIAG_BY_FAMILY reply. */
+static void parse_reply(struct sock_diag_socket *socket,
+			const struct nlmsghdr *nlh, int protocol)
+{
+	struct inet_diag_msg *msg = NLMSG_DATA(nlh);
+	struct rtattr *attr = (struct rtattr *)(msg + 1);
+	int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+
+	memset(socket, 0, sizeof(*socket));
+	set_source(socket, DIAG_MSG, msg, sizeof(*msg));
+	for (; RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		switch (attr_type(attr)) {
+		case INET_DIAG_SKMEMINFO:
+			set_source(socket, DIAG_MEMINFO,
+				   RTA_DATA(attr), RTA_PAYLOAD(attr));
+			break;
+		case INET_DIAG_INFO:
+			set_source(socket,
+				   protocol == IPPROTO_MPTCP ?
+				   DIAG_MPTCP_INFO : DIAG_TCP_INFO,
+				   RTA_DATA(attr), RTA_PAYLOAD(attr));
+			break;
+		case INET_DIAG_ULP_INFO:
+			parse_ulp_info(socket, attr);
+			break;
+		}
+	}
+}
+
+/* Return the port of the given IPv4 or IPv6 address, in network order. */
+static __be16 sockaddr_port(const struct sockaddr_storage *addr)
+{
+	if (addr->ss_family == AF_INET)
+		return ((const struct sockaddr_in *)addr)->sin_port;
+	return ((const struct sockaddr_in6 *)addr)->sin6_port;
+}
+
+/* Return true if the remote end of the reported socket is the given
+ * address.
+ */
+static bool is_same_remote(const struct inet_diag_msg *msg,
+			   const struct sockaddr_storage *remote)
+{
+	if (msg->id.idiag_dport != sockaddr_port(remote))
+		return false;
+	if (remote->ss_family == AF_INET) {
+		const struct sockaddr_in *sin = (const void *)remote;
+
+		return memcmp(msg->id.idiag_dst, &sin->sin_addr,
+			      sizeof(sin->sin_addr)) == 0;
+	} else {
+		const struct sockaddr_in6 *sin6 = (const void *)remote;
+
+		return memcmp(msg->id.idiag_dst, &sin6->sin6_addr,
+			      sizeof(sin6->sin6_addr)) == 0;
+	}
+}
+
+int sock_diag_query(int fd, u32 states, struct sock_diag_socket **sockets)
+{
+	struct sockaddr_storage local, remote;
+	socklen_t local_len = sizeof(local), remote_len = sizeof(remote);
+	bool is_connected;
+	int protocol;
+	socklen_t protocol_len = sizeof(protocol);
+	struct {
+		struct nlmsghdr nlh;
+		struct inet_diag_req_v2 req;
+		struct rtattr protocol_attr;
+		u32 protocol;
+	} request;
+	struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+	u8 *buffer = NULL;
+	int nl = -1, num_sockets = 0, max_sockets = 0, saved_errno;
+	bool done = false;
+
+	*sockets = NULL;
+	if (getsockname(fd, (struct sockaddr *)&local, &local_len) < 0)
+		return -1;
+	if (local.ss_family != AF_INET && local.ss_family != AF_INET6) {
+		errno = EAFNOSUPPORT;
+		return -1;
+	}
+	is_connected = (getpeername(fd, (struct sockaddr *)&remote,
+				    &remote_len) == 0);
+	if (getsockopt(fd, SOL_SOCKET, SO_PROTOCOL,
+		       &protocol, &protocol_len) < 0)
+		return -1;
+
+	nl = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+	if (nl < 0)
+		return -1;
+
+	/* Ask only for sockets on our ports, so the reply stays small. */
+	memset(&request, 0, sizeof(request));
+	request.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(request.req));
+	request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	request.req.sdiag_family = local.ss_family;
+	if (protocol <= 0xff) {
+		request.req.sdiag_protocol = protocol;
+	} else {
+		/* sdiag_protocol is a u8, so IPPROTO_MPTCP goes in an
+		 * INET_DIAG_REQ_PROTOCOL attribute instead.
+		 */
+		request.req.sdiag_protocol = IPPROTO_TCP;
+		request.protocol_attr.rta_type = INET_DIAG_REQ_PROTOCOL;
+		request.protocol_attr.rta_len = RTA_LENGTH(sizeof(u32));
+		request.protocol = protocol;
+		request.nlh.nlmsg_len = sizeof(request);
+	}
+	request.req.idiag_states = states;
+	request.req.idiag_ext = (1 << (INET_DIAG_INFO - 1)) |
+				(1 << (INET_DIAG_SKMEMINFO - 1));
+	request.req.id.idiag_sport = sockaddr_port(&local);
+	if (is_connected)
+		request.req.id.idiag_dport = sockaddr_port(&remote);
+	request.req.id.idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+	request.req.id.idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+
+	if (sendto(nl, &request, request.nlh.nlmsg_len, 0,
+		   (struct sockaddr *)&kernel, sizeof(kernel)) < 0)
+		goto error_out;
+
+	buffer = malloc(SOCK_DIAG_BUFFER_BYTES);
+	while (!done) {
+		ssize_t len = recv(nl, buffer, SOCK_DIAG_BUFFER_BYTES, 0);
+		struct nlmsghdr *nlh = (struct nlmsghdr *)buffer;
+
+		if (len < 0)
+			goto error_out;
+		for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			const struct inet_diag_msg *msg = NLMSG_DATA(nlh);
+
+			if (nlh->nlmsg_type == NLMSG_DONE) {
+				done = true;
+				break;
+			}
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				const struct nlmsgerr *err = NLMSG_DATA(nlh);
+
+				errno = -err->error;
+				goto error_out;
+			}
+			if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+				continue;
+
+			/* Older kernels and the MPTCP dump do not filter
+			 * by port, so we always check here too.
+			 */
+			if (msg->id.idiag_sport != sockaddr_port(&local))
+				continue;
+			if (is_connected && !is_same_remote(msg, &remote))
+				continue;
+
+			if (num_sockets == max_sockets) {
+				max_sockets = max_sockets ? 2 * max_sockets : 4;
+				*sockets = realloc(*sockets,
+						   max_sockets *
+						   sizeof(struct sock_diag_socket));
+			}
+			parse_reply(&(*sockets)[num_sockets++], nlh, protocol);
+		}
+	}
+
+	free(buffer);
+	close(nl);
+	return num_sockets;
+
+error_out:
+	saved_errno = errno;
+	sock_diag_sockets_free(*sockets, num_sockets);
+	*sockets = NULL;
+	free(buffer);
+	close(nl);
+	errno = saved_errno;
+	return -1;
+}
+
+void sock_diag_sockets_free(struct sock_diag_socket *sockets, int num_sockets)
+{
+	int i, j;
+
+	for (i = 0; i < num_sockets; ++i) {
+		for (j = 0; j < NUM_DIAG_SOURCES; ++j)
+			free(sockets[i].data[j]);
+	}
+	free(sockets);
+}
+
+int sock_diag_field_value(const struct sock_diag_socket *socket,
+			  const struct sock_diag_field *field,
+			  s64 *value, char **error)
+{
+	const u8 *data = socket->data[field->source];
+	u8 value_u8;
+	u16 value_u16;
+	u32 value_u32;
+	u64 value_u64;
+
+	if (data == NULL ||
+	    field->offset + field->bytes > socket->bytes[field->source]) {
+		asprintf(error, "%s: kernel did not report %s",
+			 field->name, sock_diag_source_names[field->source]);
+		return STATUS_ERR;
+	}
+	data += field->offset;
+	switch (field->bytes) {
+	case sizeof(u8):
+		memcpy(&value_u8, data, sizeof(value_u8));
+		*value = value_u8;
+		break;
+	case sizeof(u16):
+		memcpy(&value_u16, data, sizeof(value_u16));
+		*value = value_u16;
+		break;
+	case sizeof(u32):
+		memcpy(&value_u32, data, sizeof(value_u32));
+		*value = value_u32;
+		break;
+	case sizeof(u64):
+		memcpy(&value_u64, data, sizeof(value_u64));
+		*value = value_u64;
+		break;
+	default:
+		assert(!"bad field size");
+	}
+	return STATUS_OK;
+}
+
+#endif  /* linux */
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * In-process NETLINK_SOCK_DIAG queries, so that scripts can check the
+ * kernel's view of their sockets (state, queues, SK_MEMINFO, tcp_info
+ * and the MPTCP diag extensions) without running "ss".
+ */
+
+#ifndef __SOCK_DIAG_QUERY_H__
+#define __SOCK_DIAG_QUERY_H__
+
+#include "types.h"
+
+#ifdef linux
+
+/* Bit mask for sock_diag_query() to select sockets in any TCP state. */
+#define SOCK_DIAG_ALL_STATES	0xffffffff
+
+/* The parts of a sock_diag reply that fields can come from. */
+enum sock_diag_source {
+	DIAG_MSG,		/* struct inet_diag_msg */
+	DIAG_MEMINFO,		/* INET_DIAG_SKMEMINFO array of u32 */
+	DIAG_TCP_INFO,		/* INET_DIAG_INFO for a TCP socket */
+	DIAG_MPTCP_INFO,	/* INET_DIAG_INFO for an MPTCP socket */
+	DIAG_SUBFLOW,		/* MPTCP subflow attributes, as u64s */
+	NUM_DIAG_SOURCES,
+};
+
+/* What the kernel reported about one socket: the raw bytes of each
+ * part of the reply, or NULL for parts it did not send.
+ */
+struct sock_diag_socket {
+	u8 *data[NUM_DIAG_SOURCES];
+	int bytes[NUM_DIAG_SOURCES];
+};
+
+/* A value about a socket that a script can check. */
+struct sock_diag_field;
+
+/* Return the field with the given name, or NULL if there is none. */
+extern const struct sock_diag_field *sock_diag_field_lookup(const char *name);
+
+/* Ask the kernel about the sockets with the same protocol, address
+ * family and local port as the given socket, and if it is connected,
+ * the same remote address and port, that are in any of the given TCP
+ * states (bit N for state N). On success, fills in a new array of
+ * sockets and returns how many there are. On failure, returns -1 and
+ * sets errno, like a system call.
+ */
+extern int sock_diag_query(int fd, u32 states,
+			   struct sock_diag_socket **sockets);
+
+/* Free an array of sockets from sock_diag_query(). */
+extern void sock_diag_sockets_free(struct sock_diag_socket *sockets,
+				   int num_sockets);
+
+/* Fill in *value with the value of the field for the socket. Returns
+ * STATUS_OK on success; on failure, e.g. if the kernel did not report
+ * it, returns STATUS_ERR and sets error message.
+ */
+extern int sock_diag_field_value(const struct sock_diag_socket *socket,
+				 const struct sock_diag_field *field,
+				 s64 *value, char **error);
+
+#endif  /* linux */
+
+#endif /* __SOCK_DIAG_QUERY_H__ */
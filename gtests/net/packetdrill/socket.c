@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "run.h"
 
 struct socket *socket_new(struct state *state)
@@ -40,6 +41,8 @@ struct socket *socket_new(struct state *state)
 void socket_free(struct socket *socket)
 {
 	hash_map_free(socket->ts_val_map);
+	if (socket->mmap_addr != NULL)
+		munmap(socket->mmap_addr, socket->mmap_len);
 	memset(socket, 0, sizeof(*socket));  /* paranoia to help catch bugs */
 	free(socket);
 }
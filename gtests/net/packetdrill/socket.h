@@ -105,6 +105,19 @@ struct socket {
 	struct tcp last_injected_tcp_header;
 	u32 last_injected_tcp_payload_len;
 
+	/* The area the script mmap()-ed on this socket, which we pass to
+	 * getsockopt(TCP_ZEROCOPY_RECEIVE), or NULL.
+	 */
+	void *mmap_addr;
+	size_t mmap_len;
+
+	/* After an inbound packet train, the kernel's ACKs of the train
+	 * segments are not in the script, so we skip pure ACKs below the
+	 * live sequence number that ends the train.
+	 */
+	bool train_acks_pending;
+	u32 train_ack_end;
+
 	struct socket *next;	/* next in linked list of sockets */
 };
 
@@ -34,16 +34,24 @@
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/unistd.h>
 
+#include <linux/errqueue.h>
+#include <linux/io_uring.h>
 #include <linux/sockios.h>
 
 #include "tcp.h"
 
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP		262
+#endif
+
 /* A table of platform-specific string->int mappings. */
 struct int_symbol platform_symbols_table[] = {
 	{ SOL_IP,                           "SOL_IP"                          },
@@ -51,6 +59,8 @@ struct int_symbol platform_symbols_table[] = {
 	{ SOL_TCP,                          "SOL_TCP"                         },
 	{ SOL_UDP,                          "SOL_UDP"                         },
 
+	{ IPPROTO_MPTCP,                    "IPPROTO_MPTCP"                   },
+
 	{ SO_ACCEPTCONN,                    "SO_ACCEPTCONN"                   },
 	{ SO_ATTACH_FILTER,                 "SO_ATTACH_FILTER"                },
 	{ SO_BINDTODEVICE,                  "SO_BINDTODEVICE"                 },
@@ -82,6 +92,12 @@ struct int_symbol platform_symbols_table[] = {
 	{ SO_SNDTIMEO,                      "SO_SNDTIMEO"                     },
 	{ SO_TIMESTAMP,                     "SO_TIMESTAMP"                    },
 	{ SO_TYPE,                          "SO_TYPE"                         },
+#ifdef SO_MAX_PACING_RATE
+	{ SO_MAX_PACING_RATE,               "SO_MAX_PACING_RATE"              },
+#endif
+#ifdef SO_ZEROCOPY
+	{ SO_ZEROCOPY,                      "SO_ZEROCOPY"                     },
+#endif
 
 	{ IP_TOS,                           "IP_TOS"                          },
 	{ IP_MTU_DISCOVER,                  "IP_MTU_DISCOVER"                 },
@@ -89,6 +105,8 @@ struct int_symbol platform_symbols_table[] = {
 	{ IP_PMTUDISC_DONT,                 "IP_PMTUDISC_DONT"                },
 	{ IP_PMTUDISC_DO,                   "IP_PMTUDISC_DO"                  },
 	{ IP_PMTUDISC_PROBE,                "IP_PMTUDISC_PROBE"               },
+	{ IP_RECVERR,                       "IP_RECVERR"                      },
+	{ IPV6_RECVERR,                     "IPV6_RECVERR"                    },
 #ifdef IP_MTU
 	{ IP_MTU,                           "IP_MTU"                          },
 #endif
@@ -114,6 +132,25 @@ struct int_symbol platform_symbols_table[] = {
 	{ TCP_THIN_LINEAR_TIMEOUTS,         "TCP_THIN_LINEAR_TIMEOUTS"        },
 	{ TCP_THIN_DUPACK,                  "TCP_THIN_DUPACK"                 },
 	{ TCP_USER_TIMEOUT,                 "TCP_USER_TIMEOUT"                },
+	{ TCP_ZEROCOPY_RECEIVE,             "TCP_ZEROCOPY_RECEIVE"            },
+
+	/* TCP states and congestion control states, for sock_diag */
+	{ TCP_ESTABLISHED,                  "TCP_ESTABLISHED"                 },
+	{ TCP_SYN_SENT,                     "TCP_SYN_SENT"                    },
+	{ TCP_SYN_RECV,                     "TCP_SYN_RECV"                    },
+	{ TCP_FIN_WAIT1,                    "TCP_FIN_WAIT1"                   },
+	{ TCP_FIN_WAIT2,                    "TCP_FIN_WAIT2"                   },
+	{ TCP_TIME_WAIT,                    "TCP_TIME_WAIT"                   },
+	{ TCP_CLOSE,                        "TCP_CLOSE"                       },
+	{ TCP_CLOSE_WAIT,                   "TCP_CLOSE_WAIT"                  },
+	{ TCP_LAST_ACK,                     "TCP_LAST_ACK"                    },
+	{ TCP_LISTEN,                       "TCP_LISTEN"                      },
+	{ TCP_CLOSING,                      "TCP_CLOSING"                     },
+	{ TCP_CA_Open,                      "TCP_CA_Open"                     },
+	{ TCP_CA_Disorder,                  "TCP_CA_Disorder"                 },
+	{ TCP_CA_CWR,                       "TCP_CA_CWR"                      },
+	{ TCP_CA_Recovery,                  "TCP_CA_Recovery"                 },
+	{ TCP_CA_Loss,                      "TCP_CA_Loss"                     },
 
 	{ O_RDONLY,                         "O_RDONLY"                        },
 	{ O_WRONLY,                         "O_WRONLY"                        },
@@ -186,6 +223,21 @@ struct int_symbol platform_symbols_table[] = {
 	{ MSG_MORE,                         "MSG_MORE"                        },
 	{ MSG_CMSG_CLOEXEC,                 "MSG_CMSG_CLOEXEC"                },
 	{ MSG_FASTOPEN,                     "MSG_FASTOPEN"                    },
+#ifdef MSG_ZEROCOPY
+	{ MSG_ZEROCOPY,                     "MSG_ZEROCOPY"                    },
+#endif
+
+	{ SO_EE_ORIGIN_NONE,                "SO_EE_ORIGIN_NONE"               },
+	{ SO_EE_ORIGIN_LOCAL,               "SO_EE_ORIGIN_LOCAL"              },
+	{ SO_EE_ORIGIN_ICMP,                "SO_EE_ORIGIN_ICMP"               },
+	{ SO_EE_ORIGIN_ICMP6,               "SO_EE_ORIGIN_ICMP6"              },
+	{ SO_EE_ORIGIN_TXSTATUS,            "SO_EE_ORIGIN_TXSTATUS"           },
+#ifdef SO_EE_ORIGIN_ZEROCOPY
+	{ SO_EE_ORIGIN_ZEROCOPY,            "SO_EE_ORIGIN_ZEROCOPY"           },
+#endif
+#ifdef SO_EE_CODE_ZEROCOPY_COPIED
+	{ SO_EE_CODE_ZEROCOPY_COPIED,       "SO_EE_CODE_ZEROCOPY_COPIED"      },
+#endif
 
 #ifdef SIOCINQ
 	{ SIOCINQ,                          "SIOCINQ"                         },
@@ -224,6 +276,54 @@ struct int_symbol platform_symbols_table[] = {
 	{ POLLHUP,                          "POLLHUP"                         },
 	{ POLLNVAL,                         "POLLNVAL"                        },
 
+	{ EPOLLIN,                          "EPOLLIN"                         },
+	{ EPOLLPRI,                         "EPOLLPRI"                        },
+	{ EPOLLOUT,                         "EPOLLOUT"                        },
+	{ EPOLLRDNORM,                      "EPOLLRDNORM"                     },
+	{ EPOLLRDBAND,                      "EPOLLRDBAND"                     },
+	{ EPOLLWRNORM,                      "EPOLLWRNORM"                     },
+	{ EPOLLWRBAND,                      "EPOLLWRBAND"                     },
+	{ EPOLLMSG,                         "EPOLLMSG"                        },
+	{ EPOLLERR,                         "EPOLLERR"                        },
+	{ EPOLLHUP,                         "EPOLLHUP"                        },
+	{ EPOLLRDHUP,                       "EPOLLRDHUP"                      },
+#ifdef EPOLLEXCLUSIVE
+	{ EPOLLEXCLUSIVE,                   "EPOLLEXCLUSIVE"                  },
+#endif
+#ifdef EPOLLWAKEUP
+	{ EPOLLWAKEUP,                      "EPOLLWAKEUP"                     },
+#endif
+	{ EPOLLONESHOT,                     "EPOLLONESHOT"                    },
+	{ EPOLLET,                          "EPOLLET"                         },
+
+	{ EPOLL_CTL_ADD,                    "EPOLL_CTL_ADD"                   },
+	{ EPOLL_CTL_MOD,                    "EPOLL_CTL_MOD"                   },
+	{ EPOLL_CTL_DEL,                    "EPOLL_CTL_DEL"                   },
+	{ EPOLL_CLOEXEC,                    "EPOLL_CLOEXEC"                   },
+
+	{ SPLICE_F_MOVE,                    "SPLICE_F_MOVE"                   },
+	{ SPLICE_F_NONBLOCK,                "SPLICE_F_NONBLOCK"               },
+	{ SPLICE_F_MORE,                    "SPLICE_F_MORE"                   },
+	{ SPLICE_F_GIFT,                    "SPLICE_F_GIFT"                   },
+#ifdef MFD_CLOEXEC
+	{ MFD_CLOEXEC,                      "MFD_CLOEXEC"                     },
+#endif
+#ifdef MFD_ALLOW_SEALING
+	{ MFD_ALLOW_SEALING,                "MFD_ALLOW_SEALING"               },
+#endif
+
+	{ PROT_NONE,                        "PROT_NONE"                       },
+	{ PROT_READ,                        "PROT_READ"                       },
+	{ PROT_WRITE,                       "PROT_WRITE"                      },
+	{ MAP_SHARED,                       "MAP_SHARED"                      },
+	{ MAP_PRIVATE,                      "MAP_PRIVATE"                     },
+
+	{ IORING_OP_NOP,                    "IORING_OP_NOP"                   },
+	{ IORING_OP_SEND,                   "IORING_OP_SEND"                  },
+	{ IORING_OP_RECV,                   "IORING_OP_RECV"                  },
+	{ IORING_OP_ACCEPT,                 "IORING_OP_ACCEPT"                },
+	{ IORING_OP_CONNECT,                "IORING_OP_CONNECT"               },
+
 	{ EPERM,                            "EPERM"                           },
 	{ ENOENT,                           "ENOENT"                          },
 	{ ESRCH,                            "ESRCH"                           },
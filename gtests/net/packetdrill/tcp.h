@@ -54,6 +54,9 @@
 #define TCP_THIN_DUPACK          17  /* Fast retrans. after 1 dupack */
 #define TCP_USER_TIMEOUT         18  /* How long to retry losses */
 #define TCP_FASTOPEN             23  /* TCP Fast Open: data in SYN */
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE     35  /* Map received pages into user space */
+#endif
 
 /* TODO: remove these when netinet/tcp.h has them */
 #ifndef TCPI_OPT_ECN_SEEN
@@ -168,6 +171,15 @@ struct _tcp_info {
 	__u32	tcpi_total_retrans;
 };
 
+/* Argument of the TCP_ZEROCOPY_RECEIVE socket option. Newer kernels
+ * have more fields, but accept this original layout.
+ */
+struct _tcp_zerocopy_receive {
+	__u64	address;		/* in: address of mapping */
+	__u32	length;			/* in/out: bytes to map/mapped */
+	__u32	recv_skip_hint;		/* out: bytes to read instead */
+};
+
 #endif  /* linux */
 
 #if defined(__FreeBSD__)
@@ -317,3 +317,40 @@ extern struct tcp_option *get_mptcp_option(struct packet *packet, u8 subtype){
 	}
 	return tcp_opt;
 }
+
+void tcp_options_index_build(struct packet *packet,
+			     struct tcp_options_index *index)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	const u8 *start = packet_tcp_options(packet);
+
+	memset(index, 0, sizeof(*index));
+	for (option = tcp_options_begin(packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, NULL)) {
+		u8 slot = (u8 *)option - start + 1;
+
+		if (index->kind[option->kind] == 0)
+			index->kind[option->kind] = slot;
+		if (option->kind == TCPOPT_MPTCP &&
+		    index->mptcp_subtype[option->data.mp_capable.subtype] == 0)
+			index->mptcp_subtype[option->data.mp_capable.subtype] =
+				slot;
+	}
+}
+
+struct tcp_option *tcp_options_index_find(
+	struct packet *packet,
+	const struct tcp_options_index *index,
+	const struct tcp_option *option)
+{
+	u8 slot;
+
+	if (option->kind == TCPOPT_MPTCP)
+		slot = index->mptcp_subtype[option->data.mp_capable.subtype];
+	else
+		slot = index->kind[option->kind];
+	if (slot == 0)
+		return NULL;
+	return (struct tcp_option *)(packet_tcp_options(packet) + slot - 1);
+}
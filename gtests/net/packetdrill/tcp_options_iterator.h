@@ -51,6 +51,29 @@ extern struct tcp_option *tcp_options_begin(
 extern struct tcp_option *tcp_options_next(
 	struct tcp_options_iterator *iter, char **error);
 
+/* The offset of the first TCP option of each kind in a packet, and of
+ * the first MPTCP option of each subtype, so that we can look up an
+ * option without scanning the options. Each entry is one plus the
+ * offset from the start of the TCP options, or 0 if there is none.
+ */
+struct tcp_options_index {
+	u8 kind[256];
+	u8 mptcp_subtype[16];
+};
+
+/* Fill in the index of the TCP options in the given packet. */
+extern void tcp_options_index_build(struct packet *packet,
+				    struct tcp_options_index *index);
+
+/* Using an index built for the given packet, return the first option
+ * in the packet with the kind of the given option (and for MPTCP, its
+ * subtype), or NULL if there is none.
+ */
+extern struct tcp_option *tcp_options_index_find(
+	struct packet *packet,
+	const struct tcp_options_index *index,
+	const struct tcp_option *option);
+
 extern struct tcp_option *get_tcp_option(struct packet *packet, u8 kind);
 extern struct tcp_option *get_mptcp_option(struct packet *packet, u8 subtype);
 
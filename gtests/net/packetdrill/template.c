@@ -0,0 +1,262 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for the expansion of connection templates in test
+ * scripts. This is a purely textual pass that runs before the lexer,
+ * so the parser never sees the template syntax.
+ */
+
+#include "template.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The most instances a single template block may have. */
+#define MAX_TEMPLATE_INSTANCES	1000000
+
+/* The longest name of a template variable. */
+#define MAX_TEMPLATE_VAR_LEN	32
+
+/* A line of script text, which is not NUL-terminated. */
+struct line {
+	const char *start;
+	int len;		/* bytes, including any trailing newline */
+};
+
+/* Return the line of text starting at *pos and advance *pos past it. */
+static struct line next_line(const char *text, int length, int *pos)
+{
+	struct line line;
+	const char *end = memchr(text + *pos, '\n', length - *pos);
+
+	line.start = text + *pos;
+	line.len = end ? (end + 1 - line.start) : (length - *pos);
+	*pos += line.len;
+	return line;
+}
+
+/* Return true if only white space or a comment remains on the line. */
+static bool is_rest_empty(const char *p, const char *end)
+{
+	while (p < end && isspace((unsigned char)*p))
+		++p;
+	return (p == end) || (end - p >= 2 && p[0] == '/' && p[1] == '/');
+}
+
+/* Return true if the line holds nothing but the "}" ending a block. */
+static bool is_block_end(struct line line)
+{
+	const char *p = line.start, *end = line.start + line.len;
+
+	while (p < end && isspace((unsigned char)*p))
+		++p;
+	return (p < end) && (*p == '}') && is_rest_empty(p + 1, end);
+}
+
+/* See if the line is the header of a template block. If so, set
+ * *is_header and fill in the instance count and variable name. A
+ * line that starts with "repeat" but is not a valid header is an
+ * error.
+ */
+static int parse_block_header(struct line line, int line_number,
+			      bool *is_header, int *count, char *var,
+			      char **error)
+{
+	char *buf = strndup(line.start, line.len);
+	char *p = buf;
+	char brace[2];
+	int n = 0;
+	int result = STATUS_ERR;
+
+	*is_header = false;
+	while (*p == ' ' || *p == '\t')
+		++p;
+	if (strncmp(p, "repeat", 6) != 0 || !isspace((unsigned char)p[6])) {
+		result = STATUS_OK;
+		goto out;
+	}
+
+	if (sscanf(p, "repeat %d as %32[A-Za-z0-9_] %1[{]%n",
+		   count, var, brace, &n) != 3 ||
+	    !is_rest_empty(p + n, buf + strlen(buf))) {
+		asprintf(error, "%d: template error: expected "
+			 "'repeat <count> as <name> {'", line_number);
+		goto out;
+	}
+	if (*count < 1 || *count > MAX_TEMPLATE_INSTANCES) {
+		asprintf(error, "%d: template error: repeat count %d "
+			 "out of range", line_number, *count);
+		goto out;
+	}
+	*is_header = true;
+	result = STATUS_OK;
+
+out:
+	free(buf);
+	return result;
+}
+
+/* Write out one line of one instance of a template block, replacing
+ * each ${var}, ${var+N} or ${var-N} with the value for the instance.
+ */
+static int write_instance_line(FILE *s, struct line line, const char *var,
+			       int instance, int line_number, char **error)
+{
+	const char *p = line.start, *end = line.start + line.len;
+	const int var_len = strlen(var);
+
+	while (p < end) {
+		const char *name = NULL;
+		long offset = 0;
+		char *offset_end = NULL;
+
+		if (!(end - p >= 2 && p[0] == '$' && p[1] == '{')) {
+			fputc(*p++, s);
+			continue;
+		}
+
+		name = p + 2;
+		p = name;
+		while (p < end && (isalnum((unsigned char)*p) || *p == '_'))
+			++p;
+		if (p - name != var_len || memcmp(name, var, var_len) != 0) {
+			asprintf(error, "%d: template error: unknown "
+				 "template variable '%.*s'", line_number,
+				 (int)(p - name), name);
+			return STATUS_ERR;
+		}
+		if (p < end && (*p == '+' || *p == '-')) {
+			offset = strtol(p, &offset_end, 10);
+			if (offset_end == p + 1) {
+				asprintf(error, "%d: template error: "
+					 "expected number after '%c'",
+					 line_number, *p);
+				return STATUS_ERR;
+			}
+			p = offset_end;
+		}
+		if (p >= end || *p != '}') {
+			asprintf(error, "%d: template error: expected '}' "
+				 "after template variable", line_number);
+			return STATUS_ERR;
+		}
+		++p;
+		fprintf(s, "%ld", instance + offset);
+	}
+	return STATUS_OK;
+}
+
+/* Tell the lexer that the next line of expanded text is the given
+ * line of the script as written, so that parse errors and events
+ * carry the line numbers the user sees.
+ */
+static void write_line_marker(FILE *s, int line_number)
+{
+	fprintf(s, "#line %d\n", line_number);
+}
+
+int expand_templates(const char *text, int length,
+		     char **expanded, int *expanded_length,
+		     char **error)
+{
+	size_t size = 0;
+	FILE *s = open_memstream(expanded, &size);
+	int pos = 0, line_number = 0;
+	int result = STATUS_ERR;
+
+	while (pos < length) {
+		struct line line = next_line(text, length, &pos);
+		char var[MAX_TEMPLATE_VAR_LEN + 1];
+		bool is_header = false;
+		int count = 0, header_line = 0, body_line = 0;
+		int body_start = 0, body_end = -1;
+		int i;
+
+		++line_number;
+		if (parse_block_header(line, line_number, &is_header,
+				       &count, var, error))
+			goto out;
+		if (!is_header) {
+			fwrite(line.start, 1, line.len, s);
+			continue;
+		}
+
+		/* Find the closing line of the block. */
+		header_line = line_number;
+		body_line = line_number + 1;
+		body_start = pos;
+		while (pos < length) {
+			int line_start = pos;
+			bool is_nested = false;
+			int nested_count = 0;
+			char nested_var[MAX_TEMPLATE_VAR_LEN + 1];
+
+			line = next_line(text, length, &pos);
+			++line_number;
+			if (is_block_end(line)) {
+				body_end = line_start;
+				break;
+			}
+			if (parse_block_header(line, line_number, &is_nested,
+					       &nested_count, nested_var,
+					       error))
+				goto out;
+			if (is_nested) {
+				asprintf(error, "%d: template error: template "
+					 "blocks cannot be nested",
+					 line_number);
+				goto out;
+			}
+		}
+		if (body_end < 0) {
+			asprintf(error, "%d: template error: no '}' line "
+				 "ends the template block", header_line);
+			goto out;
+		}
+
+		/* Write out a copy of the block for each instance. */
+		for (i = 0; i < count; ++i) {
+			int body_pos = body_start;
+			int n = body_line;
+
+			write_line_marker(s, body_line);
+			while (body_pos < body_end) {
+				line = next_line(text, body_end, &body_pos);
+				if (write_instance_line(s, line, var, i, n++,
+							error))
+					goto out;
+			}
+		}
+		if (pos < length)
+			write_line_marker(s, line_number + 1);
+	}
+	result = STATUS_OK;
+
+out:
+	fclose(s);
+	if (result == STATUS_OK) {
+		*expanded_length = size;
+	} else {
+		free(*expanded);
+		*expanded = NULL;
+	}
+	return result;
+}
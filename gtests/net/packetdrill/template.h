@@ -0,0 +1,54 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Expansion of connection templates in test scripts. A template is a
+ * block of script lines that is instantiated a number of times:
+ *
+ *   repeat 1000 as i {
+ *   +0 < S 0:0(0) win 32792 <mss 1000> sock(${i+4})
+ *   ...
+ *   +0 accept(3, ..., ...) = ${i+4}
+ *   }
+ *
+ * Each instance gets a copy of the lines between the header and the
+ * closing "}" line, with ${i} replaced by the instance number,
+ * counting from 0, and ${i+N} or ${i-N} by that number plus or
+ * minus N. Blocks do not nest.
+ *
+ * Each instance, and the script text after a block, starts with a
+ * "#line <N>" marker line, which sets the lexer's line number back
+ * to that of the script as written.
+ */
+
+#ifndef __TEMPLATE_H__
+#define __TEMPLATE_H__
+
+#include "types.h"
+
+/* Expand all template blocks in the given script text. On success,
+ * return STATUS_OK and fill in *expanded with a malloc-allocated
+ * copy of the text with each block replaced by its instances, and
+ * *expanded_length with its length. On failure, return STATUS_ERR
+ * and fill in a malloc-allocated error message in *error.
+ */
+extern int expand_templates(const char *text, int length,
+			    char **expanded, int *expanded_length,
+			    char **error);
+
+#endif /* __TEMPLATE_H__ */
@@ -1,6 +1,38 @@
 #!/bin/bash
+kernel=`uname -r | sed 's/[^0-9.].*//'`
 for f in `find . -name "*.pkt" | sort`; do
+  # Scripts for newer kernels say so in a "// min_kernel: X.Y" line.
+  min_kernel=`sed -n 's|^// min_kernel: *||p' $f`
+  if [ -n "$min_kernel" ] && [ "`printf '%s\n' $min_kernel $kernel | \
+       sort -V | head -n1`" != "$min_kernel" ]; then
+    echo "Skipping $f (needs Linux $min_kernel, have $kernel)"
+    continue
+  fi
   echo "Running $f ..."
   ip tcp_metrics flush all > /dev/null 2>&1
   ../../packetdrill $f
+  status=$?
+  # Scripts named *-fail.pkt check that a script error is reported,
+  # so they must exit with status 1, neither passing nor crashing.
+  case $f in
+  *-fail.pkt)
+    if [ $status -ne 1 ]; then
+      echo "$f: expected a script error, got exit status $status"
+    fi
+    ;;
+  esac
+  # Scripts named *-replay.pkt are also replayed from a trace of the
+  # run above. The replay must not run init scripts, so give it one
+  # that would fail.
+  case $f in
+  *-replay.pkt)
+    trace=`mktemp`
+    ../../packetdrill --pcap_out=$trace $f && \
+      ../../packetdrill --replay=$trace --init_scripts=false $f
+    if [ $? -ne 0 ]; then
+      echo "$f: replay of the captured run failed"
+    fi
+    rm -f $trace
+    ;;
+  esac
 done
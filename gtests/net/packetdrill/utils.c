@@ -1,5 +1,7 @@
 #include "utils.h"
 #include <linux/kernel.h>
+#include "pcapng_writer.h"
+#include "replay_netdev.h"
 
 /*#include <linux/export.h>
 #include <linux/bitops.h>
@@ -209,19 +211,28 @@ void seed_generator() {
 	srand(time(NULL ));
 }
 
+/* Random numbers go in the --pcap_out trace, so --replay draws the same. */
 u64 rand_64() {
-	seed_generator();
 	u64 r;
+	if (replay_random(&r))
+		return r;
+	seed_generator();
 	unsigned int *part1 = (unsigned int*) &r;
 	unsigned int *part2 = &(((unsigned int*) &r)[1]);
 	*part1 = rand();
 	*part2 = rand();
+	pcapng_writer_random(r);
 	return r;
 }
 
 u32 generate_32() {
+	u64 r;
+	if (replay_random(&r))
+		return r;
 	seed_generator();
-	return rand();
+	r = rand();
+	pcapng_writer_random(r);
+	return r;
 }
 
 void hash_key_sha1(uint8_t *hash, key64 key) {
@@ -232,7 +243,9 @@ void hash_key_sha1(uint8_t *hash, key64 key) {
 }
 
 key64 get_barray_from_key64(unsigned long long key) {
-	return *(key64 *) (unsigned char*) &key;
+	key64 barray;
+	memcpy(&barray, &key, sizeof(barray));
+	return barray;
 }
 
 void hmac_sha1(const unsigned char *key, u32 key_length, char *data,
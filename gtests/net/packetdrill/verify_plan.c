@@ -0,0 +1,157 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for compiling and running packet verification plans.
+ * The masks here must cover every bit that verify_ipv4(),
+ * verify_ipv6(), verify_gre(), verify_mpls(), verify_tcp() and
+ * verify_udp() in run_packet.c check.
+ */
+
+#include "verify_plan.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "ip.h"
+#include "tcp.h"
+#include "udp.h"
+
+/* Set the mask bits for the given bytes of a header. */
+static void mask_bytes(struct verify_plan *plan, int offset, int bytes,
+		       u8 bits)
+{
+	assert(offset + bytes <= PACKET_MAX_HEADER_BYTES);
+	memset(plan->mask + offset, bits, bytes);
+}
+
+struct verify_plan *verify_plan_new(struct packet *script_packet)
+{
+	struct verify_plan *plan = calloc(1, sizeof(struct verify_plan));
+	const u8 *start = packet_start(script_packet);
+	const u8 ecn_bits =
+		(script_packet->ecn == ECN_NOCHECK) ? 0 : IP_ECN_MASK;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(script_packet->headers); ++i) {
+		const struct header *header = &script_packet->headers[i];
+		const int offset = header->h.ptr - start;
+		int bytes = header->header_bytes;
+
+		if (header->type == HEADER_NONE)
+			break;
+
+		switch (header->type) {
+		case HEADER_IPV4:
+			/* Version and header length, ECN, total length,
+			 * and protocol.
+			 */
+			mask_bytes(plan, offset, 1, 0xff);
+			mask_bytes(plan, offset + 1, 1, ecn_bits);
+			mask_bytes(plan, offset + 2, 2, 0xff);
+			mask_bytes(plan, offset + 9, 1, 0xff);
+			break;
+		case HEADER_IPV6:
+			/* Version, ECN, payload length, and next header. */
+			mask_bytes(plan, offset, 1, 0xf0);
+			mask_bytes(plan, offset + 1, 1, ecn_bits << 4);
+			mask_bytes(plan, offset + 4, 3, 0xff);
+			break;
+		case HEADER_GRE:
+			/* The flags that give the GRE header length. */
+			mask_bytes(plan, offset, 2, 0xff);
+			break;
+		case HEADER_MPLS:
+			mask_bytes(plan, offset, bytes, 0xff);
+			break;
+		case HEADER_TCP:
+			/* Sequence and ACK numbers, data offset and
+			 * reserved bits, flags, window, and urgent pointer.
+			 * The options have their own index.
+			 */
+			bytes = sizeof(struct tcp);
+			mask_bytes(plan, offset + 4, 10, 0xff);
+			if (script_packet->flags & FLAG_PSH_NOCHECK)
+				plan->mask[offset + 13] &= ~0x08;
+			if (!(script_packet->flags & FLAG_WIN_NOCHECK))
+				mask_bytes(plan, offset + 14, 2, 0xff);
+			mask_bytes(plan, offset + 18, 2, 0xff);
+			tcp_options_index_build(script_packet, &plan->options);
+			break;
+		case HEADER_UDP:
+			/* Length. */
+			mask_bytes(plan, offset + 4, 2, 0xff);
+			break;
+		default:
+			free(plan);
+			return NULL;
+		}
+		plan->header_bytes = offset + bytes;
+	}
+
+	return plan;
+}
+
+struct verify_plan *verify_plan_copy(const struct verify_plan *plan)
+{
+	struct verify_plan *copy = NULL;
+
+	if (plan == NULL)
+		return NULL;
+	copy = malloc(sizeof(*copy));
+	memcpy(copy, plan, sizeof(*copy));
+	return copy;
+}
+
+void verify_plan_free(struct verify_plan *plan)
+{
+	free(plan);
+}
+
+bool verify_plan_match_headers(const struct verify_plan *plan,
+			       const struct packet *script_packet,
+			       const struct packet *actual_packet)
+{
+	const u8 *script = script_packet->headers[0].h.ptr;
+	const u8 *actual = actual_packet->headers[0].h.ptr;
+	u8 diff = 0;
+	int i;
+
+	if (actual_packet->ip_bytes < plan->header_bytes)
+		return false;
+
+	/* Each header must start at the same place in both packets. */
+	for (i = 0; i < ARRAY_SIZE(script_packet->headers); ++i) {
+		const struct header *script_header =
+			&script_packet->headers[i];
+		const struct header *actual_header =
+			&actual_packet->headers[i];
+
+		if (script_header->type != actual_header->type)
+			return false;
+		if (script_header->type == HEADER_NONE)
+			break;
+		if (script_header->h.ptr - script !=
+		    actual_header->h.ptr - actual)
+			return false;
+	}
+
+	/* No early exit, so the compiler can vectorize this. */
+	for (i = 0; i < plan->header_bytes; ++i)
+		diff |= (script[i] ^ actual[i]) & plan->mask[i];
+	return diff == 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Plans for verifying outbound live packets against a script packet,
+ * compiled once when the script is parsed. A plan holds a byte mask
+ * over the script packet's headers, with a bit set for each header
+ * bit the per-field verifiers in run_packet.c check, and an index of
+ * the script packet's TCP options.
+ *
+ * A masked compare that passes means the per-field checks would
+ * pass too, so the common case costs a single pass over the header
+ * bytes. When it fails, or the live packet's header layout differs,
+ * we fall back to the per-field checks, which explain the mismatch.
+ */
+
+#ifndef __VERIFY_PLAN_H__
+#define __VERIFY_PLAN_H__
+
+#include "types.h"
+
+#include "packet.h"
+#include "tcp_options_iterator.h"
+
+struct verify_plan {
+	int header_bytes;		/* bytes of headers under the mask */
+	u8 mask[PACKET_MAX_HEADER_BYTES];	/* bits that must match */
+	struct tcp_options_index options;	/* script TCP options */
+};
+
+/* Compile a verification plan for the given script packet, or return
+ * NULL if it has headers we have no plan for.
+ */
+extern struct verify_plan *verify_plan_new(struct packet *script_packet);
+
+/* Return a copy of the plan, or NULL if plan is NULL. */
+extern struct verify_plan *verify_plan_copy(const struct verify_plan *plan);
+
+/* Free the plan, if it is not NULL. */
+extern void verify_plan_free(struct verify_plan *plan);
+
+/* Return true if the actual packet has the same header layout as the
+ * script packet, and all header bits under the plan's mask match.
+ */
+extern bool verify_plan_match_headers(const struct verify_plan *plan,
+				      const struct packet *script_packet,
+				      const struct packet *actual_packet);
+
+#endif /* __VERIFY_PLAN_H__ */
@@ -415,6 +415,11 @@ static int wire_server_run_script(struct wire_server *wire_server,
 		case CODE_EVENT:
 			DEBUGP("CODE_EVENT happens on client side...\n");
 			break;
+		case PACING_EVENT:
+			/* The server sniffs, so it checks the pacing. */
+			run_pacing_event(state, event,
+					 event->event.pacing);
+			break;
 		case INVALID_EVENT:
 		case NUM_EVENT_TYPES:
 			assert(!"bogus type");
@@ -492,6 +497,7 @@ error_done:
 
 	if (wire_server->state != NULL)
 		state_free(wire_server->state);
+	script_free(&wire_server->script);
 
 	DEBUGP("wire_server_thread: connection is done\n");
 	wire_server_free(wire_server);
@@ -0,0 +1,664 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for a "virtual network device" for purely local
+ * tests that injects and sniffs packets through an AF_XDP socket.
+ *
+ * We create a veth pair. The "kernel" end gets the local test IP
+ * address and a route to the remote test prefix, exactly like the
+ * tun device in netdev.c. The "xdp" end has a tiny XDP program
+ * attached (in generic or native mode) that redirects every frame
+ * into an AF_XDP socket, so packets the kernel under test sends land
+ * directly in our UMEM, and packets we put on the TX ring show up
+ * on the kernel end as if they came from a neighbor. This needs no
+ * special hardware: veth supports both XDP modes, though it does not
+ * support XDP zero-copy, so we bind the socket in copy mode.
+ */
+
+#include "xdp_netdev.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#ifdef linux
+
+#include <net/if.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+
+#include "ethernet.h"
+#include "link_layer.h"
+#include "net_utils.h"
+#include "packet.h"
+#include "packet_parser.h"
+#include "run.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* UMEM geometry. Each frame holds one Ethernet frame. The first
+ * XDP_RING_SIZE frames are handed to the kernel on the fill ring for
+ * receiving; the rest form our pool of TX buffers.
+ */
+#define XDP_FRAME_SIZE		4096
+#define XDP_NUM_FRAMES		2048
+#define XDP_RING_SIZE		1024	/* must be a power of 2 */
+
+/* Our view of one of the four single-producer/single-consumer rings
+ * shared with the kernel (RX, TX, fill, completion).
+ */
+struct xdp_ring {
+	u32 *producer;		/* index of next entry to produce */
+	u32 *consumer;		/* index of next entry to consume */
+	void *entries;		/* array of struct xdp_desc or u64 addrs */
+	u32 mask;		/* ring size - 1 */
+	void *map;		/* start of mmap()-ed region */
+	size_t map_bytes;	/* length of mmap()-ed region */
+};
+
+/* Internal private state for the AF_XDP netdev. */
+struct xdp_netdev {
+	struct netdev netdev;		/* "inherit" from netdev */
+
+	char *kernel_name;	/* veth end owned by the kernel under test */
+	char *xdp_name;		/* veth end with our XDP program and socket */
+	int xdp_index;		/* interface index of xdp_name */
+	struct ether_addr kernel_ether_addr;	/* MAC of kernel_name */
+	struct ether_addr xdp_ether_addr;	/* MAC of xdp_name */
+
+	int map_fd;		/* BPF_MAP_TYPE_XSKMAP holding our socket */
+	int prog_fd;		/* XDP program redirecting into map_fd */
+	int link_fd;		/* bpf_link attaching prog_fd to xdp_name */
+	int xsk_fd;		/* the AF_XDP socket */
+
+	u8 *umem;		/* XDP_NUM_FRAMES * XDP_FRAME_SIZE bytes */
+	struct xdp_ring rx;
+	struct xdp_ring tx;
+	struct xdp_ring fill;
+	struct xdp_ring completion;
+
+	u64 free_frames[XDP_NUM_FRAMES];	/* stack of free TX frames */
+	int num_free_frames;
+};
+
+struct netdev_ops xdp_netdev_ops;
+
+/* "Downcast" an abstract netdev to our AF_XDP flavor. */
+static inline struct xdp_netdev *to_xdp_netdev(struct netdev *netdev)
+{
+	return (struct xdp_netdev *)netdev;
+}
+
+static int sys_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* Run a setup shell command, or die. */
+static void xdp_system(const char *command)
+{
+	int result;
+
+	DEBUGP("running: '%s'\n", command);
+	result = system(command);
+	if ((result == -1) || (WEXITSTATUS(result) != 0))
+		die("error executing command '%s'\n", command);
+}
+
+/* Turn off an ethtool offload, so the kernel hands us fully-formed,
+ * fully-checksummed, MTU-sized frames, just like a real NIC would
+ * put on the wire.
+ */
+static void disable_offload(const char *name, u32 cmd)
+{
+	struct ethtool_value value = { .cmd = cmd, .data = 0 };
+	struct ifreq ifr;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+	if (fd < 0)
+		die_perror("socket");
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+	ifr.ifr_data = (void *)&value;
+	if (ioctl(fd, SIOCETHTOOL, &ifr) < 0)
+		die_perror("SIOCETHTOOL");
+	close(fd);
+}
+
+/* Create the veth pair for the lifetime of this test. */
+static void create_veth_pair(struct config *config,
+			     struct xdp_netdev *netdev)
+{
+	char *command = NULL;
+
+	/* Include our pid, so concurrent tests do not collide. */
+	asprintf(&netdev->kernel_name, "pdk%d", getpid());
+	asprintf(&netdev->xdp_name, "pdx%d", getpid());
+
+	asprintf(&command,
+		 "ip link del %s > /dev/null 2>&1 ; "
+		 "ip link add %s mtu %d type veth peer name %s mtu %d && "
+		 "ip link set %s up && ip link set %s up",
+		 netdev->kernel_name,
+		 netdev->kernel_name, config->mtu,
+		 netdev->xdp_name, config->mtu,
+		 netdev->xdp_name, netdev->kernel_name);
+	xdp_system(command);
+	free(command);
+
+	disable_offload(netdev->kernel_name, ETHTOOL_STXCSUM);
+	disable_offload(netdev->kernel_name, ETHTOOL_STSO);
+	disable_offload(netdev->kernel_name, ETHTOOL_SGSO);
+
+	netdev->xdp_index = if_nametoindex(netdev->xdp_name);
+	if (netdev->xdp_index == 0)
+		die_perror("if_nametoindex");
+
+	get_hw_address(netdev->kernel_name, &netdev->kernel_ether_addr);
+	get_hw_address(netdev->xdp_name, &netdev->xdp_ether_addr);
+}
+
+/* Route traffic destined for our remote IP through the kernel end of
+ * the veth, and pin the gateway's neighbor entry to the xdp end's MAC
+ * so the kernel never needs ARP or neighbor discovery to reach us.
+ */
+static void route_traffic_to_veth(struct config *config,
+				  struct xdp_netdev *netdev)
+{
+	char *command = NULL;
+	const u8 *mac = netdev->xdp_ether_addr.ether_addr_octet;
+
+	asprintf(&command,
+		 "ip neigh replace %s lladdr "
+		 "%02x:%02x:%02x:%02x:%02x:%02x dev %s nud permanent && "
+		 "( ip route del %s > /dev/null 2>&1 ; "
+		 "ip route add %s dev %s via %s )",
+		 config->live_gateway_ip_string,
+		 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+		 netdev->kernel_name,
+		 config->live_remote_prefix_string,
+		 config->live_remote_prefix_string,
+		 netdev->kernel_name,
+		 config->live_gateway_ip_string);
+	xdp_system(command);
+	free(command);
+}
+
+/* Load an XDP program equivalent to:
+ *   return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+ * and attach it to the xdp end of the veth pair.
+ */
+static void attach_xdp_program(struct config *config,
+			       struct xdp_netdev *netdev)
+{
+	union bpf_attr attr;
+	char log[4096] = "";
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type		= BPF_MAP_TYPE_XSKMAP;
+	attr.key_size		= sizeof(u32);
+	attr.value_size		= sizeof(u32);
+	attr.max_entries	= 1;
+	netdev->map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+	if (netdev->map_fd < 0)
+		die_perror("bpf BPF_MAP_CREATE XSKMAP");
+
+	struct bpf_insn insns[] = {
+		/* r2 = ctx->rx_queue_index */
+		{ .code = BPF_LDX | BPF_MEM | BPF_W,
+		  .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1,
+		  .off = offsetof(struct xdp_md, rx_queue_index) },
+		/* r1 = xsks_map (a two-instruction 64-bit load) */
+		{ .code = BPF_LD | BPF_IMM | BPF_DW,
+		  .dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD,
+		  .imm = netdev->map_fd },
+		{ .code = 0 },
+		/* r3 = XDP_PASS, our action if the queue has no socket */
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_K,
+		  .dst_reg = BPF_REG_3, .imm = XDP_PASS },
+		{ .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+		{ .code = BPF_JMP | BPF_EXIT },
+	};
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type	= BPF_PROG_TYPE_XDP;
+	attr.insns	= (unsigned long)insns;
+	attr.insn_cnt	= ARRAY_SIZE(insns);
+	attr.license	= (unsigned long)"GPL";
+	attr.log_buf	= (unsigned long)log;
+	attr.log_size	= sizeof(log);
+	attr.log_level	= 1;
+	netdev->prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+	if (netdev->prog_fd < 0)
+		die("bpf BPF_PROG_LOAD: %s\n%s", strerror(errno), log);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd	= netdev->prog_fd;
+	attr.link_create.target_ifindex	= netdev->xdp_index;
+	attr.link_create.attach_type	= BPF_XDP;
+	attr.link_create.flags		= config->xdp_native ?
+		XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+	netdev->link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+	if (netdev->link_fd < 0)
+		die_perror("bpf BPF_LINK_CREATE BPF_XDP");
+}
+
+/* mmap() one of the rings of our AF_XDP socket. */
+static void map_ring(struct xdp_netdev *netdev, struct xdp_ring *ring,
+		     const struct xdp_ring_offset *off,
+		     size_t entry_bytes, off_t pgoff)
+{
+	ring->map_bytes = off->desc + XDP_RING_SIZE * entry_bytes;
+	ring->map = mmap(NULL, ring->map_bytes, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, netdev->xsk_fd, pgoff);
+	if (ring->map == MAP_FAILED)
+		die_perror("mmap AF_XDP ring");
+
+	ring->producer	= (u32 *)((u8 *)ring->map + off->producer);
+	ring->consumer	= (u32 *)((u8 *)ring->map + off->consumer);
+	ring->entries	= (u8 *)ring->map + off->desc;
+	ring->mask	= XDP_RING_SIZE - 1;
+}
+
+static void xsk_setsockopt(int fd, int optname, const void *optval,
+			   socklen_t optlen)
+{
+	if (setsockopt(fd, SOL_XDP, optname, optval, optlen) < 0)
+		die_perror("setsockopt SOL_XDP");
+}
+
+/* Hand the given UMEM frame to the kernel for receiving into. */
+static void fill_ring_put(struct xdp_netdev *netdev, u64 addr)
+{
+	struct xdp_ring *fill = &netdev->fill;
+	u32 prod = *fill->producer;
+
+	((u64 *)fill->entries)[prod & fill->mask] = addr;
+	__atomic_store_n(fill->producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+/* Create the AF_XDP socket and its UMEM, and plug it into the XSKMAP. */
+static void create_xdp_socket(struct xdp_netdev *netdev)
+{
+	struct xdp_umem_reg umem_reg;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp;
+	socklen_t optlen = sizeof(off);
+	const int ring_size = XDP_RING_SIZE;
+	const u32 key = 0;
+	union bpf_attr attr;
+	int i;
+
+	netdev->xsk_fd = socket(AF_XDP, SOCK_RAW, 0);
+	if (netdev->xsk_fd < 0)
+		die_perror("socket AF_XDP");
+
+	netdev->umem = mmap(NULL, XDP_NUM_FRAMES * XDP_FRAME_SIZE,
+			    PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (netdev->umem == MAP_FAILED)
+		die_perror("mmap AF_XDP UMEM");
+
+	memset(&umem_reg, 0, sizeof(umem_reg));
+	umem_reg.addr		= (unsigned long)netdev->umem;
+	umem_reg.len		= XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+	umem_reg.chunk_size	= XDP_FRAME_SIZE;
+	xsk_setsockopt(netdev->xsk_fd, XDP_UMEM_REG,
+		       &umem_reg, sizeof(umem_reg));
+	xsk_setsockopt(netdev->xsk_fd, XDP_UMEM_FILL_RING,
+		       &ring_size, sizeof(ring_size));
+	xsk_setsockopt(netdev->xsk_fd, XDP_UMEM_COMPLETION_RING,
+		       &ring_size, sizeof(ring_size));
+	xsk_setsockopt(netdev->xsk_fd, XDP_RX_RING,
+		       &ring_size, sizeof(ring_size));
+	xsk_setsockopt(netdev->xsk_fd, XDP_TX_RING,
+		       &ring_size, sizeof(ring_size));
+
+	if (getsockopt(netdev->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS,
+		       &off, &optlen) < 0)
+		die_perror("getsockopt XDP_MMAP_OFFSETS");
+
+	map_ring(netdev, &netdev->rx, &off.rx,
+		 sizeof(struct xdp_desc), XDP_PGOFF_RX_RING);
+	map_ring(netdev, &netdev->tx, &off.tx,
+		 sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+	map_ring(netdev, &netdev->fill, &off.fr,
+		 sizeof(u64), XDP_UMEM_PGOFF_FILL_RING);
+	map_ring(netdev, &netdev->completion, &off.cr,
+		 sizeof(u64), XDP_UMEM_PGOFF_COMPLETION_RING);
+
+	/* Split the UMEM between the fill ring and the TX pool. */
+	for (i = 0; i < XDP_RING_SIZE; ++i)
+		fill_ring_put(netdev, (u64)i * XDP_FRAME_SIZE);
+	for (i = XDP_RING_SIZE; i < XDP_NUM_FRAMES; ++i)
+		netdev->free_frames[netdev->num_free_frames++] =
+			(u64)i * XDP_FRAME_SIZE;
+
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family	= AF_XDP;
+	sxdp.sxdp_ifindex	= netdev->xdp_index;
+	sxdp.sxdp_queue_id	= 0;
+	sxdp.sxdp_flags		= XDP_COPY;
+	if (bind(netdev->xsk_fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0)
+		die_perror("bind AF_XDP");
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd	= netdev->map_fd;
+	attr.key	= (unsigned long)&key;
+	attr.value	= (unsigned long)&netdev->xsk_fd;
+	if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+		die_perror("bpf BPF_MAP_UPDATE_ELEM XSKMAP");
+}
+
+struct netdev *xdp_netdev_new(struct config *config)
+{
+	struct xdp_netdev *netdev = calloc(1, sizeof(struct xdp_netdev));
+
+	DEBUGP("xdp_netdev_new\n");
+
+	netdev->netdev.ops = &xdp_netdev_ops;
+	netdev->map_fd = -1;
+	netdev->prog_fd = -1;
+	netdev->link_fd = -1;
+	netdev->xsk_fd = -1;
+
+	if (is_ip_local(&config->live_remote_ip)) {
+		die("error: live_remote_ip %s is not remote\n",
+		    config->live_remote_ip_string);
+	}
+
+	create_veth_pair(config, netdev);
+	attach_xdp_program(config, netdev);
+	create_xdp_socket(netdev);
+
+	net_setup_dev_address(netdev->kernel_name,
+			      &config->live_local_ip,
+			      config->live_prefix_len);
+
+	route_traffic_to_veth(config, netdev);
+	if (config->net_cpu >= 0)
+		net_set_rps_cpu(netdev->kernel_name, config->net_cpu);
+
+	return (struct netdev *)netdev;
+}
+
+static void unmap_ring(struct xdp_ring *ring)
+{
+	if (ring->map != NULL)
+		munmap(ring->map, ring->map_bytes);
+}
+
+static void xdp_netdev_free(struct netdev *a_netdev)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+	char *command = NULL;
+
+	DEBUGP("xdp_netdev_free\n");
+
+	unmap_ring(&netdev->rx);
+	unmap_ring(&netdev->tx);
+	unmap_ring(&netdev->fill);
+	unmap_ring(&netdev->completion);
+	if (netdev->xsk_fd >= 0)
+		close(netdev->xsk_fd);
+	if (netdev->umem != NULL)
+		munmap(netdev->umem, XDP_NUM_FRAMES * XDP_FRAME_SIZE);
+	if (netdev->link_fd >= 0)
+		close(netdev->link_fd);		/* detaches the program */
+	if (netdev->prog_fd >= 0)
+		close(netdev->prog_fd);
+	if (netdev->map_fd >= 0)
+		close(netdev->map_fd);
+
+	/* Deleting one end of a veth pair deletes both ends. */
+	if (netdev->kernel_name != NULL) {
+		asprintf(&command, "ip link del %s > /dev/null 2>&1",
+			 netdev->kernel_name);
+		system(command);
+		free(command);
+	}
+
+	free(netdev->kernel_name);
+	free(netdev->xdp_name);
+	memset(netdev, 0, sizeof(*netdev));  /* paranoia to help catch bugs */
+	free(netdev);
+}
+
+/* Move the TX frames the kernel has finished with back to our pool. */
+static void reclaim_tx_frames(struct xdp_netdev *netdev)
+{
+	struct xdp_ring *cq = &netdev->completion;
+	u32 prod = __atomic_load_n(cq->producer, __ATOMIC_ACQUIRE);
+	u32 cons = *cq->consumer;
+
+	while (cons != prod) {
+		assert(netdev->num_free_frames < XDP_NUM_FRAMES);
+		netdev->free_frames[netdev->num_free_frames++] =
+			((u64 *)cq->entries)[cons & cq->mask];
+		++cons;
+	}
+	__atomic_store_n(cq->consumer, cons, __ATOMIC_RELEASE);
+}
+
+/* Ask the kernel to transmit what is on the TX ring. In copy mode
+ * the kernel never looks at the TX ring on its own.
+ */
+static void kick_tx(struct xdp_netdev *netdev)
+{
+	if (sendto(netdev->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+	    errno != EAGAIN && errno != EBUSY && errno != ENOBUFS)
+		die_perror("AF_XDP sendto()");
+}
+
+static int xdp_netdev_send(struct netdev *a_netdev,
+			   struct packet *packet)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+	struct xdp_ring *tx = &netdev->tx;
+	struct ether_header *ether = NULL;
+	struct xdp_desc *desc = NULL;
+	u32 frame_bytes = sizeof(*ether) + packet->ip_bytes;
+	u32 prod;
+	u64 addr;
+
+	assert(packet->ip_bytes > 0);
+	/* We do IPv4 and IPv6 */
+	assert(packet->ipv4 || packet->ipv6);
+	/* We only do TCP, UDP, and ICMP */
+	assert(packet->tcp || packet->udp || packet->icmpv4 || packet->icmpv6);
+
+	DEBUGP("xdp_netdev_send\n");
+
+	if (frame_bytes > XDP_FRAME_SIZE)
+		die("%u byte packet too big for AF_XDP frame\n", frame_bytes);
+
+	reclaim_tx_frames(netdev);
+	while (netdev->num_free_frames == 0) {
+		kick_tx(netdev);
+		reclaim_tx_frames(netdev);
+	}
+	addr = netdev->free_frames[--netdev->num_free_frames];
+
+	/* Prepend an ethernet header, as if from the gateway. */
+	ether = (struct ether_header *)(netdev->umem + addr);
+	ether_copy(ether->ether_dhost, &netdev->kernel_ether_addr);
+	ether_copy(ether->ether_shost, &netdev->xdp_ether_addr);
+	ether->ether_type =
+		htons(ether_type_for_family(packet_address_family(packet)));
+
+	/* Then after that we have the IP datagram. */
+	memcpy(ether + 1, packet_start(packet), packet->ip_bytes);
+
+	prod = *tx->producer;
+	desc = &((struct xdp_desc *)tx->entries)[prod & tx->mask];
+	desc->addr	= addr;
+	desc->len	= frame_bytes;
+	desc->options	= 0;
+	__atomic_store_n(tx->producer, prod + 1, __ATOMIC_RELEASE);
+
+	kick_tx(netdev);
+
+	return STATUS_OK;
+}
+
+/* Wait for the next frame on the RX ring, copy it into the given
+ * packet, and recycle its UMEM frame onto the fill ring. Returns the
+ * number of bytes in the frame.
+ */
+static int xdp_rx_one(struct xdp_netdev *netdev, struct packet *packet)
+{
+	struct xdp_ring *rx = &netdev->rx;
+	struct pollfd pfd = { .fd = netdev->xsk_fd, .events = POLLIN };
+	const struct xdp_desc *desc = NULL;
+	u32 cons = *rx->consumer;
+	u32 len;
+
+	while (__atomic_load_n(rx->producer, __ATOMIC_ACQUIRE) == cons) {
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			die_perror("AF_XDP poll()");
+	}
+
+	desc = &((const struct xdp_desc *)rx->entries)[cons & rx->mask];
+	len = desc->len;
+	if (len > packet->buffer_bytes)
+		len = packet->buffer_bytes;
+	memcpy(packet->buffer, netdev->umem + desc->addr, len);
+
+	/* There is no kernel RX timestamp for XDP frames. */
+	packet->time_usecs = now_usecs();
+
+	fill_ring_put(netdev, desc->addr & ~((u64)XDP_FRAME_SIZE - 1));
+	__atomic_store_n(rx->consumer, cons + 1, __ATOMIC_RELEASE);
+
+	return len;
+}
+
+static int xdp_netdev_receive(struct netdev *a_netdev,
+			      struct packet **packet, char **error)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+
+	DEBUGP("xdp_netdev_receive\n");
+
+	assert(*packet == NULL);	/* should be no packet yet */
+
+	while (1) {
+		enum packet_parse_result_t result;
+		int in_bytes = 0;
+
+		*packet = packet_new(PACKET_READ_BYTES);
+
+		/* Everything arriving on the xdp end left the kernel. */
+		in_bytes = xdp_rx_one(netdev, *packet);
+
+		result = parse_packet(*packet, in_bytes,
+				      PACKET_LAYER_2_ETHERNET, error);
+		if (result == PACKET_OK)
+			return STATUS_OK;
+
+		packet_free(*packet);
+		*packet = NULL;
+
+		if (result == PACKET_BAD)
+			return STATUS_ERR;
+
+		DEBUGP("parse_result:%d; error parsing packet: %s\n",
+		       result, *error);
+	}
+
+	assert(!"should not be reached");
+	return STATUS_ERR;	/* not reached */
+}
+
+/* Recycle every frame waiting on the RX ring, without blocking. */
+static void xdp_netdev_drain(struct netdev *a_netdev)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+	struct xdp_ring *rx = &netdev->rx;
+	const struct xdp_desc *entries = rx->entries;
+	u32 cons = *rx->consumer;
+
+	DEBUGP("xdp_netdev_drain\n");
+
+	while (__atomic_load_n(rx->producer, __ATOMIC_ACQUIRE) != cons) {
+		const struct xdp_desc *desc = &entries[cons & rx->mask];
+
+		fill_ring_put(netdev, desc->addr & ~((u64)XDP_FRAME_SIZE - 1));
+		__atomic_store_n(rx->consumer, ++cons, __ATOMIC_RELEASE);
+	}
+}
+
+static bool xdp_netdev_wait(struct netdev *a_netdev, s64 timeout_usecs)
+{
+	struct xdp_netdev *netdev = to_xdp_netdev(a_netdev);
+	struct xdp_ring *rx = &netdev->rx;
+	struct pollfd pfd = { .fd = netdev->xsk_fd, .events = POLLIN };
+	const s64 deadline_usecs = now_usecs() + timeout_usecs;
+
+	while (__atomic_load_n(rx->producer, __ATOMIC_ACQUIRE) ==
+	       *rx->consumer) {
+		s64 left_usecs = deadline_usecs - now_usecs();
+
+		if (left_usecs <= 0)
+			return false;
+		if (poll(&pfd, 1, (left_usecs + 999) / 1000) < 0 &&
+		    errno != EINTR)
+			die_perror("AF_XDP poll()");
+	}
+	return true;
+}
+
+struct netdev_ops xdp_netdev_ops = {
+	.free = xdp_netdev_free,
+	.send = xdp_netdev_send,
+	.receive = xdp_netdev_receive,
+	.drain = xdp_netdev_drain,
+	.wait = xdp_netdev_wait,
+};
+
+#else  /* !linux */
+
+struct netdev *xdp_netdev_new(struct config *config)
+{
+	die("AF_XDP is only supported on Linux\n");
+	return NULL;	/* not reached */
+}
+
+#endif  /* linux */
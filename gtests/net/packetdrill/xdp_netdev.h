@@ -0,0 +1,36 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Network device for purely local tests that injects and sniffs
+ * packets through an AF_XDP socket bound to one end of a veth pair,
+ * instead of going through a tun device and a packet socket.
+ */
+
+#ifndef __XDP_NETDEV_H__
+#define __XDP_NETDEV_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "netdev.h"
+
+/* Allocate and return a new AF_XDP veth netdev for purely local tests. */
+extern struct netdev *xdp_netdev_new(struct config *config);
+
+#endif /* __XDP_NETDEV_H__ */